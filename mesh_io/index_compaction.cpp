@@ -0,0 +1,60 @@
+#include "index_compaction.hpp"
+
+index_buffer_range append_indices(compact_index_buffer & buffer, std::span<std::uint32_t const> indices, std::size_t vertex_count)
+{
+    index_buffer_range result{buffer.parts.size(), 0};
+
+    if (indices.empty())
+        return result;
+
+    if (vertex_count <= max_16bit_vertices)
+    {
+        buffer.parts.push_back({std::uint32_t(buffer.indices.size()), std::uint32_t(indices.size()), 0, std::uint32_t(vertex_count)});
+        buffer.indices.insert(buffer.indices.end(), indices.begin(), indices.end());
+        result.part_count = 1;
+        return result;
+    }
+
+    // Vertices of the current part are tagged with its number plus one, and
+    // numbered in first-use order
+    std::vector<std::uint32_t> part_tag(vertex_count, 0);
+    std::vector<std::uint16_t> local_index(vertex_count);
+
+    auto begin_part = [&]{
+        buffer.parts.push_back({std::uint32_t(buffer.indices.size()), 0, std::int32_t(buffer.vertex_remap.size()), 0});
+        ++result.part_count;
+    };
+
+    begin_part();
+
+    for (std::size_t i = 0; i + 2 < indices.size(); i += 3)
+    {
+        std::uint32_t tag = buffer.parts.size();
+
+        std::size_t new_vertices = 0;
+        for (std::size_t k = 0; k < 3; ++k)
+            new_vertices += (part_tag[indices[i + k]] != tag);
+
+        if (buffer.parts.back().vertex_count + new_vertices > max_16bit_vertices)
+        {
+            begin_part();
+            ++tag;
+        }
+
+        auto & part = buffer.parts.back();
+        for (std::size_t k = 0; k < 3; ++k)
+        {
+            auto const v = indices[i + k];
+            if (part_tag[v] != tag)
+            {
+                part_tag[v] = tag;
+                local_index[v] = part.vertex_count++;
+                buffer.vertex_remap.push_back(v);
+            }
+            buffer.indices.push_back(local_index[v]);
+        }
+        part.index_count += 3;
+    }
+
+    return result;
+}
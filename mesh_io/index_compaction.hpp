@@ -0,0 +1,56 @@
+#pragma once
+
+#include <span>
+#include <vector>
+#include <cstdint>
+
+// 16-bit index buffers for upload. Meshes with at most 65536 vertices keep their
+// vertex buffer and simply get narrower indices. Larger meshes are split into parts:
+// runs of consecutive triangles referencing at most 65536 distinct vertices, each
+// part getting its own range of a new vertex buffer and drawn with that base vertex
+// (glDrawElementsBaseVertex). Only vertices shared by several parts are duplicated,
+// which stays cheap when triangles are in vertex cache order.
+
+struct index_buffer_part
+{
+    // Range in compact_index_buffer::indices, in indices
+    std::uint32_t index_offset;
+    std::uint32_t index_count;
+    std::int32_t base_vertex;
+    std::uint32_t vertex_count;
+};
+
+struct compact_index_buffer
+{
+    std::vector<std::uint16_t> indices;
+    std::vector<index_buffer_part> parts;
+
+    // Source vertex of every vertex of the split vertex buffer; empty when the
+    // source vertex buffer is used as is
+    std::vector<std::uint32_t> vertex_remap;
+};
+
+// Parts appended by one call of append_indices
+struct index_buffer_range
+{
+    std::size_t first_part;
+    std::size_t part_count;
+};
+
+constexpr std::size_t max_16bit_vertices = 65536;
+
+// Appends a 16-bit version of indices to the buffer. Several index buffers over the
+// same vertices, such as levels of detail, can share one compact buffer; vertex_count
+// must then be the same for all of them
+index_buffer_range append_indices(compact_index_buffer & buffer, std::span<std::uint32_t const> indices, std::size_t vertex_count);
+
+// Vertex buffer matching the parts of a buffer whose vertex_remap is not empty
+template <typename Vertex>
+std::vector<Vertex> split_vertices(std::span<Vertex const> vertices, compact_index_buffer const & buffer)
+{
+    std::vector<Vertex> result;
+    result.reserve(buffer.vertex_remap.size());
+    for (auto v : buffer.vertex_remap)
+        result.push_back(vertices[v]);
+    return result;
+}
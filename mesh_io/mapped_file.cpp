@@ -0,0 +1,138 @@
+#include "mapped_file.hpp"
+
+#include <stdexcept>
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+mapped_file::mapped_file(std::filesystem::path const & path, access mode)
+{
+#ifdef _WIN32
+    file_ = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file_ == INVALID_HANDLE_VALUE)
+    {
+        file_ = nullptr;
+        throw std::runtime_error("Failed to open " + path.string());
+    }
+
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file_, &file_size))
+    {
+        close();
+        throw std::runtime_error("Failed to get size of " + path.string());
+    }
+
+    size_ = file_size.QuadPart;
+
+    // Empty files cannot be mapped, they are represented by an empty view
+    if (size_ == 0)
+        return;
+
+    mapping_ = CreateFileMappingW(file_, nullptr, mode == copy_on_write ? PAGE_WRITECOPY : PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping_)
+    {
+        close();
+        throw std::runtime_error("Failed to map " + path.string());
+    }
+
+    data_ = static_cast<char const *>(MapViewOfFile(mapping_, mode == copy_on_write ? FILE_MAP_COPY : FILE_MAP_READ, 0, 0, 0));
+    if (!data_)
+    {
+        close();
+        throw std::runtime_error("Failed to map " + path.string());
+    }
+#else
+    file_ = ::open(path.c_str(), O_RDONLY);
+    if (file_ == -1)
+        throw std::runtime_error("Failed to open " + path.string());
+
+    struct stat file_stat;
+    if (::fstat(file_, &file_stat) != 0)
+    {
+        close();
+        throw std::runtime_error("Failed to get size of " + path.string());
+    }
+
+    size_ = file_stat.st_size;
+
+    // Empty files cannot be mapped, they are represented by an empty view
+    if (size_ == 0)
+        return;
+
+    // MAP_PRIVATE already makes writes private to the process
+    void * data = ::mmap(nullptr, size_, mode == copy_on_write ? PROT_READ | PROT_WRITE : PROT_READ, MAP_PRIVATE, file_, 0);
+    if (data == MAP_FAILED)
+    {
+        close();
+        throw std::runtime_error("Failed to map " + path.string());
+    }
+
+    ::madvise(data, size_, MADV_SEQUENTIAL);
+
+    data_ = static_cast<char const *>(data);
+#endif
+}
+
+mapped_file::~mapped_file()
+{
+    close();
+}
+
+mapped_file::mapped_file(mapped_file && other) noexcept
+    : data_(std::exchange(other.data_, nullptr))
+    , size_(std::exchange(other.size_, 0))
+#ifdef _WIN32
+    , file_(std::exchange(other.file_, nullptr))
+    , mapping_(std::exchange(other.mapping_, nullptr))
+#else
+    , file_(std::exchange(other.file_, -1))
+#endif
+{}
+
+mapped_file & mapped_file::operator = (mapped_file && other) noexcept
+{
+    if (this != &other)
+    {
+        close();
+        data_ = std::exchange(other.data_, nullptr);
+        size_ = std::exchange(other.size_, 0);
+#ifdef _WIN32
+        file_ = std::exchange(other.file_, nullptr);
+        mapping_ = std::exchange(other.mapping_, nullptr);
+#else
+        file_ = std::exchange(other.file_, -1);
+#endif
+    }
+    return *this;
+}
+
+void mapped_file::close()
+{
+#ifdef _WIN32
+    if (data_)
+        UnmapViewOfFile(data_);
+    if (mapping_)
+        CloseHandle(mapping_);
+    if (file_)
+        CloseHandle(file_);
+    mapping_ = nullptr;
+    file_ = nullptr;
+#else
+    if (data_)
+        ::munmap(const_cast<char *>(data_), size_);
+    if (file_ != -1)
+        ::close(file_);
+    file_ = -1;
+#endif
+    data_ = nullptr;
+    size_ = 0;
+}
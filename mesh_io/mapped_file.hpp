@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <string_view>
+
+// Memory mapping of a whole file. Copy-on-write mappings can be modified in place:
+// touched pages become private copies, the file itself is never written
+struct mapped_file
+{
+    enum access
+    {
+        read_only,
+        copy_on_write,
+    };
+
+    mapped_file() = default;
+    explicit mapped_file(std::filesystem::path const & path, access mode = read_only);
+    ~mapped_file();
+
+    mapped_file(mapped_file && other) noexcept;
+    mapped_file & operator = (mapped_file && other) noexcept;
+
+    char const * data() const { return data_; }
+    std::size_t size() const { return size_; }
+    std::string_view view() const { return {data_, size_}; }
+
+    // Only for copy-on-write mappings
+    char * mutable_data() { return const_cast<char *>(data_); }
+
+private:
+    char const * data_ = nullptr;
+    std::size_t size_ = 0;
+
+#ifdef _WIN32
+    void * file_ = nullptr;
+    void * mapping_ = nullptr;
+#else
+    int file_ = -1;
+#endif
+
+    void close();
+};
@@ -0,0 +1,530 @@
+#include "mesh_cache.hpp"
+
+#include <bit>
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <type_traits>
+
+namespace
+{
+
+    constexpr char mesh_cache_magic[8] = {'O', 'B', 'J', 'C', 'A', 'C', 'H', 'E'};
+    constexpr std::uint32_t mesh_cache_endian_tag = 0x01020304;
+
+    std::size_t align_up(std::size_t offset)
+    {
+        return (offset + mesh_cache_alignment - 1) / mesh_cache_alignment * mesh_cache_alignment;
+    }
+
+    std::uint64_t load_u64(unsigned char const * p)
+    {
+        std::uint64_t result;
+        std::memcpy(&result, p, sizeof(result));
+        return result;
+    }
+
+    std::uint64_t mix(std::uint64_t h)
+    {
+        h ^= h >> 33;
+        h *= 0xFF51AFD7ED558CCDull;
+        h ^= h >> 33;
+        h *= 0xC4CEB9FE1A85EC53ull;
+        h ^= h >> 33;
+        return h;
+    }
+
+    template <typename T>
+    std::span<T const> section_span(mapped_file const & file, mesh_cache_section const & section)
+    {
+        return {reinterpret_cast<T const *>(file.data() + section.offset), section.size / sizeof(T)};
+    }
+
+    std::uint32_t settings_hash(mesh_cache_options const & options)
+    {
+        float const values[] = {options.overdraw_threshold, float(options.normal_weights), options.crease_angle};
+        return mesh_cache_hash(values, sizeof(values));
+    }
+
+    // Names never contain line breaks, as OBJ and MTL records end at them
+    std::string join_lines(auto const & names)
+    {
+        std::string result;
+        for (auto const & name : names)
+        {
+            result += name;
+            result += '\n';
+        }
+        return result;
+    }
+
+    std::vector<std::string> split_lines(std::string_view text)
+    {
+        std::vector<std::string> result;
+        while (!text.empty())
+        {
+            auto const end = text.find('\n');
+            if (end == std::string_view::npos)
+                break;
+            result.emplace_back(text.substr(0, end));
+            text.remove_prefix(end + 1);
+        }
+        return result;
+    }
+
+    bool same_lod_ratios(std::span<mesh_cache_lod const> lods, std::vector<float> const & ratios)
+    {
+        return std::equal(lods.begin(), lods.end(), ratios.begin(), ratios.end(),
+            [](mesh_cache_lod const & lod, float ratio){ return lod.ratio == ratio; });
+    }
+
+}
+
+std::filesystem::path default_mesh_cache_directory()
+{
+    return std::filesystem::temp_directory_path() / "graphics-course-mesh-cache";
+}
+
+std::filesystem::path mesh_cache_path(std::filesystem::path const & source_path, std::filesystem::path const & cache_directory)
+{
+    auto const key = std::filesystem::absolute(source_path).lexically_normal().string();
+    auto const hash = mesh_cache_hash(key.data(), key.size());
+
+    char name[17];
+    for (int i = 0; i < 16; ++i)
+        name[i] = "0123456789abcdef"[(hash >> (60 - 4 * i)) & 15];
+    name[16] = '\0';
+
+    return cache_directory / (std::string(name) + ".mesh");
+}
+
+mesh_cache_source_key mesh_cache_stat(std::filesystem::path const & source_path)
+{
+    mesh_cache_source_key result;
+    result.size = std::filesystem::file_size(source_path);
+    result.mtime = std::filesystem::last_write_time(source_path).time_since_epoch().count();
+    return result;
+}
+
+std::uint64_t mesh_cache_hash(void const * data, std::size_t size)
+{
+    // Four independent multiply-rotate lanes over 32-byte blocks, then a tail and a finalizer;
+    // not cryptographic, but fast enough to hash the OBJ text on every cold load
+    constexpr std::uint64_t prime = 0x9E3779B97F4A7C15ull;
+
+    auto p = static_cast<unsigned char const *>(data);
+    auto const end = p + size;
+
+    std::uint64_t lanes[4] = {prime, prime * 3, prime * 5, prime * 7};
+
+    for (; end - p >= 32; p += 32)
+    {
+        for (int i = 0; i < 4; ++i)
+            lanes[i] = std::rotl((lanes[i] ^ load_u64(p + 8 * i)) * prime, 31);
+    }
+
+    std::uint64_t h = size;
+    for (int i = 0; i < 4; ++i)
+        h = (h ^ mix(lanes[i])) * prime;
+
+    for (; end - p >= 8; p += 8)
+        h = std::rotl((h ^ load_u64(p)) * prime, 27);
+
+    for (; p != end; ++p)
+        h = std::rotl((h ^ *p) * prime, 11);
+
+    return mix(h);
+}
+
+void write_mesh_cache(std::filesystem::path const & cache_path, cached_mesh const & mesh)
+{
+    static_assert(std::endian::native == std::endian::little, "mesh cache is stored little-endian");
+    static_assert(std::is_trivially_copyable_v<obj_data::vertex>);
+
+    std::vector<mesh_cache_submesh> submeshes;
+    std::vector<std::string_view> submesh_names;
+    for (auto const & submesh : mesh.submeshes)
+    {
+        auto & stored = submeshes.emplace_back();
+        stored.material = submesh.material;
+        stored.index_offset = submesh.index_offset;
+        stored.index_count = submesh.index_count;
+        std::copy(submesh.min.begin(), submesh.min.end(), stored.min);
+        std::copy(submesh.max.begin(), submesh.max.end(), stored.max);
+        submesh_names.push_back(submesh.name);
+    }
+
+    std::vector<std::string_view> material_names;
+    for (auto const & material : mesh.materials)
+        material_names.push_back(material.name);
+
+    auto const names = join_lines(submesh_names);
+    auto const materials = join_lines(material_names);
+    auto const libraries = join_lines(mesh.material_libraries);
+
+    auto const & source_path = mesh.source_path;
+
+    struct payload
+    {
+        mesh_cache_section_kind kind;
+        void const * data;
+        std::size_t size;
+    };
+
+    payload const payloads[] =
+    {
+        {mesh_cache_section_kind::source_path, source_path.data(), source_path.size()},
+        {mesh_cache_section_kind::vertices, mesh.vertices.data(), mesh.vertices.size_bytes()},
+        {mesh_cache_section_kind::indices, mesh.indices.data(), mesh.indices.size_bytes()},
+        {mesh_cache_section_kind::lods, mesh.lods.data(), mesh.lods.size_bytes()},
+        {mesh_cache_section_kind::lod_indices, mesh.lod_indices.data(), mesh.lod_indices.size_bytes()},
+        {mesh_cache_section_kind::tangents, mesh.tangents.data(), mesh.tangents.size_bytes()},
+        {mesh_cache_section_kind::submeshes, submeshes.data(), submeshes.size() * sizeof(mesh_cache_submesh)},
+        {mesh_cache_section_kind::submesh_names, names.data(), names.size()},
+        {mesh_cache_section_kind::material_names, materials.data(), materials.size()},
+        {mesh_cache_section_kind::material_libraries, libraries.data(), libraries.size()},
+        {mesh_cache_section_kind::lod_submeshes, mesh.lod_submeshes.data(), mesh.lod_submeshes.size_bytes()},
+    };
+
+    constexpr std::size_t section_count = sizeof(payloads) / sizeof(payloads[0]);
+
+    mesh_cache_header header{};
+    std::memcpy(header.magic, mesh_cache_magic, sizeof(header.magic));
+    header.version = mesh_cache_version;
+    header.endian_tag = mesh_cache_endian_tag;
+    header.vertex_size = sizeof(obj_data::vertex);
+    header.section_count = section_count;
+    header.flags = mesh.flags;
+    header.settings = mesh.settings;
+    header.source = mesh.source;
+
+    mesh_cache_section sections[section_count];
+
+    std::size_t offset = sizeof(mesh_cache_header) + sizeof(sections);
+    for (std::size_t i = 0; i < section_count; ++i)
+    {
+        offset = align_up(offset);
+        sections[i] = {payloads[i].kind, 0, offset, payloads[i].size};
+        offset += payloads[i].size;
+    }
+
+    std::vector<char> image(offset, 0);
+    std::memcpy(image.data() + sizeof(mesh_cache_header), sections, sizeof(sections));
+    for (std::size_t i = 0; i < section_count; ++i)
+        if (payloads[i].size > 0)
+            std::memcpy(image.data() + sections[i].offset, payloads[i].data, payloads[i].size);
+
+    header.checksum = mesh_cache_hash(image.data() + sizeof(mesh_cache_header), image.size() - sizeof(mesh_cache_header));
+    std::memcpy(image.data(), &header, sizeof(header));
+
+    std::filesystem::create_directories(cache_path.parent_path());
+
+    auto temporary_path = cache_path;
+    temporary_path += ".tmp";
+
+    {
+        std::ofstream output(temporary_path, std::ios::binary | std::ios::trunc);
+        output.write(image.data(), image.size());
+        if (!output)
+            throw std::runtime_error("Failed to write mesh cache " + temporary_path.string());
+    }
+
+    std::filesystem::rename(temporary_path, cache_path);
+}
+
+std::optional<cached_mesh> read_mesh_cache(std::filesystem::path const & cache_path)
+{
+    std::error_code error;
+    if (!std::filesystem::is_regular_file(cache_path, error))
+        return std::nullopt;
+
+    cached_mesh result;
+
+    try
+    {
+        result.file = mapped_file(cache_path);
+    }
+    catch (std::runtime_error const &)
+    {
+        return std::nullopt;
+    }
+
+    auto const & file = result.file;
+
+    if (file.size() < sizeof(mesh_cache_header))
+        return std::nullopt;
+
+    mesh_cache_header header;
+    std::memcpy(&header, file.data(), sizeof(header));
+
+    if (std::memcmp(header.magic, mesh_cache_magic, sizeof(header.magic)) != 0
+        || header.version != mesh_cache_version
+        || header.endian_tag != mesh_cache_endian_tag
+        || header.vertex_size != sizeof(obj_data::vertex))
+        return std::nullopt;
+
+    if (header.section_count > (file.size() - sizeof(mesh_cache_header)) / sizeof(mesh_cache_section))
+        return std::nullopt;
+
+    if (header.checksum != mesh_cache_hash(file.data() + sizeof(mesh_cache_header), file.size() - sizeof(mesh_cache_header)))
+        return std::nullopt;
+
+    std::vector<mesh_cache_section> sections(header.section_count);
+    std::memcpy(sections.data(), file.data() + sizeof(mesh_cache_header), sections.size() * sizeof(mesh_cache_section));
+
+    bool has_vertices = false;
+    bool has_indices = false;
+    std::vector<std::string> submesh_names;
+
+    for (auto const & section : sections)
+    {
+        if (section.offset % mesh_cache_alignment != 0 || section.offset > file.size() || section.size > file.size() - section.offset)
+            return std::nullopt;
+
+        switch (section.kind)
+        {
+        case mesh_cache_section_kind::source_path:
+            result.source_path.assign(file.data() + section.offset, section.size);
+            break;
+        case mesh_cache_section_kind::vertices:
+            if (section.size % sizeof(obj_data::vertex) != 0)
+                return std::nullopt;
+            result.vertices = section_span<obj_data::vertex>(file, section);
+            has_vertices = true;
+            break;
+        case mesh_cache_section_kind::indices:
+            if (section.size % sizeof(std::uint32_t) != 0)
+                return std::nullopt;
+            result.indices = section_span<std::uint32_t>(file, section);
+            has_indices = true;
+            break;
+        case mesh_cache_section_kind::lods:
+            if (section.size % sizeof(mesh_cache_lod) != 0)
+                return std::nullopt;
+            result.lods = section_span<mesh_cache_lod>(file, section);
+            break;
+        case mesh_cache_section_kind::lod_indices:
+            if (section.size % sizeof(std::uint32_t) != 0)
+                return std::nullopt;
+            result.lod_indices = section_span<std::uint32_t>(file, section);
+            break;
+        case mesh_cache_section_kind::tangents:
+            if (section.size % sizeof(std::array<float, 4>) != 0)
+                return std::nullopt;
+            result.tangents = section_span<std::array<float, 4>>(file, section);
+            break;
+        case mesh_cache_section_kind::submeshes:
+            if (section.size % sizeof(mesh_cache_submesh) != 0)
+                return std::nullopt;
+            for (auto const & stored : section_span<mesh_cache_submesh>(file, section))
+            {
+                auto & submesh = result.submeshes.emplace_back();
+                submesh.material = stored.material;
+                submesh.index_offset = stored.index_offset;
+                submesh.index_count = stored.index_count;
+                std::copy(stored.min, stored.min + 3, submesh.min.begin());
+                std::copy(stored.max, stored.max + 3, submesh.max.begin());
+            }
+            break;
+        case mesh_cache_section_kind::submesh_names:
+            submesh_names = split_lines({file.data() + section.offset, section.size});
+            break;
+        case mesh_cache_section_kind::material_names:
+            for (auto & name : split_lines({file.data() + section.offset, section.size}))
+                result.materials.emplace_back().name = std::move(name);
+            break;
+        case mesh_cache_section_kind::material_libraries:
+            result.material_libraries = split_lines({file.data() + section.offset, section.size});
+            break;
+        case mesh_cache_section_kind::lod_submeshes:
+            if (section.size % sizeof(mesh_cache_range) != 0)
+                return std::nullopt;
+            result.lod_submeshes = section_span<mesh_cache_range>(file, section);
+            break;
+        default:
+            // Unknown sections are skipped, so that readers of the same version
+            // tolerate optional additions
+            break;
+        }
+    }
+
+    if (!has_vertices || !has_indices)
+        return std::nullopt;
+
+    if (!result.tangents.empty() && result.tangents.size() != result.vertices.size())
+        return std::nullopt;
+
+    auto in_range = [](std::uint32_t offset, std::uint32_t count, std::size_t size){
+        return offset <= size && count <= size - offset;
+    };
+
+    for (auto const & lod : result.lods)
+        if (!in_range(lod.index_offset, lod.index_count, result.lod_indices.size()))
+            return std::nullopt;
+
+    if (submesh_names.size() != result.submeshes.size() || result.lod_submeshes.size() != result.lods.size() * result.submeshes.size())
+        return std::nullopt;
+
+    for (std::size_t i = 0; i < result.submeshes.size(); ++i)
+    {
+        auto & submesh = result.submeshes[i];
+        submesh.name = std::move(submesh_names[i]);
+        if (!in_range(submesh.index_offset, submesh.index_count, result.indices.size())
+            || (submesh.material != obj_no_material && submesh.material >= result.materials.size()))
+            return std::nullopt;
+    }
+
+    for (auto const & range : result.lod_submeshes)
+        if (!in_range(range.index_offset, range.index_count, result.lod_indices.size()))
+            return std::nullopt;
+
+    result.source = header.source;
+    result.flags = header.flags;
+    result.settings = header.settings;
+    result.from_cache = true;
+    return result;
+}
+
+cached_mesh load_obj_cached(std::filesystem::path const & path, mesh_cache_options const & options)
+{
+    auto const source_path = std::filesystem::absolute(path).lexically_normal().string();
+    auto const cache_path = mesh_cache_path(path, options.cache_directory);
+
+    std::uint32_t flags = 0;
+    if (options.optimize_vertex_cache)
+        flags |= mesh_cache_vertex_cache_optimized;
+    if (options.optimize_overdraw)
+        flags |= mesh_cache_overdraw_optimized;
+    if (options.optimize_vertex_fetch)
+        flags |= mesh_cache_vertex_fetch_optimized;
+    if (!options.lod_ratios.empty())
+        flags |= mesh_cache_lods_built;
+    if (options.generate_normals)
+        flags |= mesh_cache_normals_generated;
+    if (options.generate_tangents)
+        flags |= mesh_cache_tangents_generated;
+
+    auto const settings = settings_hash(options);
+
+    auto key = mesh_cache_stat(path);
+
+    mapped_file source;
+
+    auto hash_source = [&]{
+        source = mapped_file(path);
+        key.content_hash = mesh_cache_hash(source.data(), source.size());
+    };
+
+    // The cache is only an optimization, failing to update it is not an error
+    auto try_write = [&](cached_mesh const & mesh){
+        try
+        {
+            write_mesh_cache(cache_path, mesh);
+        }
+        catch (std::exception const &)
+        {}
+    };
+
+    // Materials are not cached, the libraries may have been edited since
+    auto const directory = path.parent_path();
+
+    if (auto cached = read_mesh_cache(cache_path); cached && cached->source_path == source_path
+        && cached->source.size == key.size && cached->flags == flags
+        && cached->settings == settings && same_lod_ratios(cached->lods, options.lod_ratios))
+    {
+        bool hit = cached->source.mtime == key.mtime;
+        if (!hit)
+        {
+            // The file was touched, but may still have the same contents
+            hash_source();
+            hit = cached->source.content_hash == key.content_hash;
+            if (hit)
+            {
+                cached->source = key;
+                try_write(*cached);
+            }
+        }
+
+        if (hit)
+        {
+            load_materials(cached->materials, cached->material_libraries, directory);
+            return std::move(*cached);
+        }
+    }
+
+    if (!source.data())
+        hash_source();
+
+    cached_mesh result;
+    result.data = parse_obj_source(source.view(), options.thread_count);
+    load_materials(result.data, directory);
+    if (options.generate_normals)
+        result.normals = generate_normals(result.data, {options.normal_weights, options.crease_angle, options.thread_count});
+    // Before the optimizations, which then reorder the split vertices along with the rest
+    if (options.generate_tangents)
+        result.tangent_splits = generate_tangents(result.data, options.thread_count);
+    if (options.optimize_vertex_cache)
+        result.vertex_cache = optimize_vertex_cache(result.data);
+    if (options.optimize_overdraw)
+    {
+        optimize_overdraw(result.data, options.overdraw_threshold);
+        if (options.optimize_vertex_cache)
+            result.vertex_cache.after = analyze_vertex_cache(result.data);
+    }
+    if (options.optimize_vertex_fetch)
+        optimize_vertex_fetch(result.data);
+
+    // Levels are simplified from the final vertex and index buffers, so that they
+    // share the vertex buffer as it is stored. Each submesh is simplified on its own,
+    // keeping the material boundaries, and a level is the submesh levels back to back
+    if (!options.lod_ratios.empty())
+    {
+        auto & data = result.data;
+
+        std::vector<std::vector<mesh_lod<std::uint32_t>>> submesh_lods;
+        for (auto const & submesh : data.submeshes)
+        {
+            auto const indices = std::span<std::uint32_t const>(data.indices).subspan(submesh.index_offset, submesh.index_count);
+            submesh_lods.push_back(build_lod_chain(indices, mesh_positions(data), data.vertices.size(),
+                sizeof(data.vertices[0]), options.lod_ratios, options.thread_count));
+        }
+
+        for (std::size_t level = 0; level < options.lod_ratios.size(); ++level)
+        {
+            mesh_cache_lod lod{std::uint32_t(result.lod_index_data.size()), 0, options.lod_ratios[level], 0.f};
+
+            for (auto & lods : submesh_lods)
+            {
+                auto & indices = lods[level].indices;
+                if (options.optimize_vertex_cache)
+                    optimize_vertex_cache(std::span(indices), data.vertices.size());
+
+                result.lod_submesh_table.push_back({std::uint32_t(result.lod_index_data.size()), std::uint32_t(indices.size())});
+                result.lod_index_data.insert(result.lod_index_data.end(), indices.begin(), indices.end());
+                lod.error = std::max(lod.error, lods[level].error);
+            }
+
+            lod.index_count = std::uint32_t(result.lod_index_data.size()) - lod.index_offset;
+            result.lod_table.push_back(lod);
+        }
+    }
+
+    result.vertices = result.data.vertices;
+    result.indices = result.data.indices;
+    result.lods = result.lod_table;
+    result.lod_indices = result.lod_index_data;
+    result.tangents = result.data.tangents;
+    result.submeshes = result.data.submeshes;
+    result.materials = result.data.materials;
+    result.material_libraries = result.data.material_libraries;
+    result.lod_submeshes = result.lod_submesh_table;
+    result.source_path = source_path;
+    result.source = key;
+    result.flags = flags;
+    result.settings = settings;
+
+    try_write(result);
+
+    return result;
+}
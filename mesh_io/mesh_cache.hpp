@@ -0,0 +1,231 @@
+#pragma once
+
+#include "obj_parser.hpp"
+#include "mapped_file.hpp"
+#include "mesh_optimizer.hpp"
+#include "mesh_simplifier.hpp"
+#include "normal_generation.hpp"
+#include "tangent_generation.hpp"
+
+#include <span>
+#include <array>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <optional>
+#include <filesystem>
+
+// Binary container for obj_data.
+//
+// Layout (little-endian):
+//   mesh_cache_header
+//   mesh_cache_section[section_count]
+//   section payloads, each aligned to mesh_cache_alignment bytes
+//
+// The checksum covers everything after the header. The source key lets a
+// cache entry be validated against the OBJ file it was built from.
+// Levels of detail are extra index buffers into the same vertices, stored
+// back to back in one section and described by a table of mesh_cache_lod.
+// Tangents, when generated, are a separate per-vertex section.
+// Submeshes are index ranges by material; their names and the material names
+// are stored as newline-terminated lists, while the materials themselves are
+// read from the MTL libraries on every load, so editing those needs no rebuild.
+// Every level of detail keeps one index range per submesh.
+
+constexpr std::uint32_t mesh_cache_version = 6;
+constexpr std::size_t mesh_cache_alignment = 64;
+
+enum class mesh_cache_section_kind : std::uint32_t
+{
+    source_path = 1,
+    vertices = 2,
+    indices = 3,
+    lods = 4,
+    lod_indices = 5,
+    tangents = 6,
+    submeshes = 7,
+    submesh_names = 8,
+    material_names = 9,
+    material_libraries = 10,
+    lod_submeshes = 11,
+};
+
+// Post-processing applied to the mesh before it was written
+enum mesh_cache_flags : std::uint32_t
+{
+    mesh_cache_vertex_cache_optimized = 1,
+    mesh_cache_overdraw_optimized = 2,
+    mesh_cache_vertex_fetch_optimized = 4,
+    mesh_cache_lods_built = 8,
+    mesh_cache_normals_generated = 16,
+    mesh_cache_tangents_generated = 32,
+};
+
+struct mesh_cache_source_key
+{
+    std::uint64_t size = 0;
+    std::int64_t mtime = 0;
+    std::uint64_t content_hash = 0;
+};
+
+struct mesh_cache_header
+{
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t endian_tag;
+    std::uint32_t vertex_size;
+    std::uint32_t section_count;
+    std::uint32_t flags;
+    // Hash of the numeric options the entry was built with
+    std::uint32_t settings;
+    mesh_cache_source_key source;
+    std::uint64_t checksum;
+};
+
+// Range of the level in the LOD index section, the requested fraction of the
+// source triangles and the simplification error relative to the mesh extent
+struct mesh_cache_lod
+{
+    std::uint32_t index_offset;
+    std::uint32_t index_count;
+    float ratio;
+    float error;
+};
+
+// obj_submesh without its name
+struct mesh_cache_submesh
+{
+    std::uint32_t material;
+    std::uint32_t index_offset;
+    std::uint32_t index_count;
+    float min[3];
+    float max[3];
+};
+
+// Index range of a submesh within a level of the LOD index section
+struct mesh_cache_range
+{
+    std::uint32_t index_offset;
+    std::uint32_t index_count;
+};
+
+struct mesh_cache_section
+{
+    mesh_cache_section_kind kind;
+    std::uint32_t reserved;
+    std::uint64_t offset;
+    std::uint64_t size;
+};
+
+// Mesh loaded through the cache. The spans point either into the mapped cache
+// file or into the freshly parsed obj_data, so they can be handed to
+// glBufferData directly
+struct cached_mesh
+{
+    std::span<obj_data::vertex const> vertices;
+    std::span<std::uint32_t const> indices;
+
+    // Coarser levels of detail, from finest to coarsest
+    std::span<mesh_cache_lod const> lods;
+    std::span<std::uint32_t const> lod_indices;
+
+    // Per-vertex tangent and bitangent sign, empty unless generated
+    std::span<std::array<float, 4> const> tangents;
+
+    std::vector<obj_submesh> submeshes;
+    std::vector<obj_material> materials;
+    std::vector<std::string> material_libraries;
+    // Range of every submesh in every level of detail, level by level
+    std::span<mesh_cache_range const> lod_submeshes;
+
+    std::string source_path;
+    mesh_cache_source_key source;
+    std::uint32_t flags = 0;
+    std::uint32_t settings = 0;
+    bool from_cache = false;
+
+    // Filled only when the mesh was parsed and optimized by this load
+    vertex_cache_report vertex_cache;
+    normal_generation_stats normals;
+    std::size_t tangent_splits = 0;
+
+    // Storage backing the spans, either the mapped file or the rest
+    mapped_file file;
+    obj_data data;
+    std::vector<mesh_cache_lod> lod_table;
+    std::vector<std::uint32_t> lod_index_data;
+    std::vector<mesh_cache_range> lod_submesh_table;
+
+    // Index buffer of a level of detail, level 0 being the full mesh
+    std::span<std::uint32_t const> level_indices(std::size_t level) const
+    {
+        if (level == 0)
+            return indices;
+        auto const & lod = lods[level - 1];
+        return lod_indices.subspan(lod.index_offset, lod.index_count);
+    }
+
+    // Index buffer of a submesh in a level of detail
+    std::span<std::uint32_t const> submesh_indices(std::size_t level, std::size_t submesh) const
+    {
+        if (level == 0)
+            return indices.subspan(submeshes[submesh].index_offset, submeshes[submesh].index_count);
+        auto const & range = lod_submeshes[(level - 1) * submeshes.size() + submesh];
+        return lod_indices.subspan(range.index_offset, range.index_count);
+    }
+
+    cached_mesh() = default;
+    cached_mesh(cached_mesh &&) = default;
+    cached_mesh & operator = (cached_mesh &&) = default;
+
+    cached_mesh(cached_mesh const &) = delete;
+    cached_mesh & operator = (cached_mesh const &) = delete;
+};
+
+std::filesystem::path default_mesh_cache_directory();
+
+struct mesh_cache_options
+{
+    std::filesystem::path cache_directory = default_mesh_cache_directory();
+    // 0 means all hardware threads
+    unsigned int thread_count = 1;
+    // Fill in the normals of faces without vn references, see generate_normals
+    bool generate_normals = true;
+    normal_weighting normal_weights = normal_weighting::angle;
+    float crease_angle = 60.f;
+    // Compute MikkTSpace tangents from the final normals, see generate_tangents
+    bool generate_tangents = true;
+    // Reorder triangles for the post-transform vertex cache before writing the entry
+    bool optimize_vertex_cache = true;
+    // Then sort triangle clusters to reduce overdraw, within this ACMR threshold
+    bool optimize_overdraw = true;
+    float overdraw_threshold = 1.05f;
+    // Renumber vertices in first-use order
+    bool optimize_vertex_fetch = true;
+    // Fractions of the triangle count to simplify the mesh to, each level sharing the
+    // vertex buffer; empty disables levels of detail
+    std::vector<float> lod_ratios = {default_lod_ratios.begin(), default_lod_ratios.end()};
+};
+
+// Cache file used for the given OBJ file, named after a hash of its absolute path
+std::filesystem::path mesh_cache_path(std::filesystem::path const & source_path, std::filesystem::path const & cache_directory);
+
+// Size and modification time of the source; the content hash is left empty
+mesh_cache_source_key mesh_cache_stat(std::filesystem::path const & source_path);
+
+std::uint64_t mesh_cache_hash(void const * data, std::size_t size);
+
+// Writes the cache atomically (through a temporary file and a rename); the materials
+// themselves are not stored
+void write_mesh_cache(std::filesystem::path const & cache_path, cached_mesh const & mesh);
+
+// Maps a cache file; returns nothing if it is missing, truncated, corrupted
+// or of another version. Materials are only named, see load_materials
+std::optional<cached_mesh> read_mesh_cache(std::filesystem::path const & cache_path);
+
+// Loads an OBJ file through the cache: a valid cache entry is memory-mapped, otherwise
+// the file is parsed and the entry is (re)written. A cache entry is valid if the source
+// size and mtime match, or if only the mtime differs but the content hash matches, and if
+// it was post-processed with the requested options. Levels of detail are built per
+// submesh, on options.thread_count threads
+cached_mesh load_obj_cached(std::filesystem::path const & path, mesh_cache_options const & options = {});
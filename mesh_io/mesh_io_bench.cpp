@@ -0,0 +1,398 @@
+#include "obj_parser.hpp"
+#include "mapped_file.hpp"
+#include "vertex_dedup_table.hpp"
+#include "mesh_cache.hpp"
+#include "mesh_optimizer.hpp"
+#include "index_compaction.hpp"
+#include "vertex_quantization.hpp"
+
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Times the stages between an OBJ file and buffers ready for upload, on the given files
+// (the repository meshes by default) and on generated stress meshes, then the parse of a
+// large generated mesh on 1, 2, 4... up to --threads threads:
+//
+//   mesh_io_bench [--threads N] [--repeat N] [--stress-size N] [--no-stress]
+//                 [--scaling-triangles N] [--no-scaling] [file.obj...]
+//
+// Every stage reports the best of --repeat runs.
+
+namespace
+{
+
+    struct bench_options
+    {
+        // 0 means all hardware threads
+        unsigned int thread_count = 0;
+        int repeat = 3;
+        // Side of the generated grids, in quads; the soup gets the same triangle count
+        std::size_t stress_size = 512;
+        bool stress = true;
+        // Triangles of the mesh parsed by the thread sweep
+        std::size_t scaling_triangles = 10'000'000;
+        bool scaling = true;
+        std::vector<std::filesystem::path> files;
+    };
+
+    bench_options parse_options(int argc, char ** argv)
+    {
+        bench_options options;
+
+        for (int i = 1; i < argc; ++i)
+        {
+            std::string const arg = argv[i];
+
+            auto value = [&]{
+                if (i + 1 == argc)
+                    throw std::runtime_error("Missing value for " + arg);
+                return std::stoul(argv[++i]);
+            };
+
+            if (arg == "--threads")
+                options.thread_count = value();
+            else if (arg == "--repeat")
+                options.repeat = std::max(1ul, value());
+            else if (arg == "--stress-size")
+                options.stress_size = value();
+            else if (arg == "--no-stress")
+                options.stress = false;
+            else if (arg == "--scaling-triangles")
+                options.scaling_triangles = std::max(2ul, value());
+            else if (arg == "--no-scaling")
+                options.scaling = false;
+            else if (arg.starts_with("--"))
+                throw std::runtime_error("Unknown option " + arg);
+            else
+                options.files.push_back(arg);
+        }
+
+        if (options.thread_count == 0)
+            options.thread_count = std::max(1u, std::thread::hardware_concurrency());
+
+        if (options.files.empty())
+        {
+            std::filesystem::path const root = MESH_IO_REPO_ROOT;
+            options.files = {root / "practice4" / "bunny_lowres.obj", root / "practice5" / "cow.obj", root / "practice7" / "suzanne.obj"};
+        }
+
+        return options;
+    }
+
+    template <typename Function>
+    double best_time(int repeat, Function const & function)
+    {
+        double best = 0.0;
+        for (int i = 0; i < repeat; ++i)
+        {
+            auto const start = std::chrono::steady_clock::now();
+            function();
+            double const ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            if (i == 0 || ms < best)
+                best = ms;
+        }
+        return best;
+    }
+
+    // Slightly bumpy grid of size x size quads with positions, texcoords and normals,
+    // written as quad faces; relative grids reference vertices with negative indices
+    std::string grid_obj(std::size_t size, bool relative)
+    {
+        std::ostringstream out;
+        out << std::setprecision(6);
+
+        std::size_t const side = size + 1;
+        for (std::size_t y = 0; y < side; ++y)
+        {
+            for (std::size_t x = 0; x < side; ++x)
+            {
+                float const u = float(x) / size;
+                float const v = float(y) / size;
+                float const height = 0.01f * float((x * 7919 + y * 104729) % 101) / 101.f;
+                out << "v " << u << ' ' << height << ' ' << v << '\n';
+                out << "vt " << u << ' ' << v << '\n';
+                out << "vn 0 1 0\n";
+            }
+        }
+
+        long long const vertex_count = side * side;
+        for (std::size_t y = 0; y < size; ++y)
+        {
+            for (std::size_t x = 0; x < size; ++x)
+            {
+                long long const corners[4] = {
+                    (long long)(y * side + x), (long long)((y + 1) * side + x), (long long)((y + 1) * side + x + 1), (long long)(y * side + x + 1),
+                };
+
+                out << 'f';
+                for (auto c : corners)
+                {
+                    long long const index = relative ? c - vertex_count : c + 1;
+                    out << ' ' << index << '/' << index << '/' << index;
+                }
+                out << '\n';
+            }
+        }
+
+        return std::move(out).str();
+    }
+
+    // Triangles sharing no vertices, each written right after its positions with relative
+    // indices: every corner is a new vertex, the worst case for deduplication
+    std::string soup_obj(std::size_t triangle_count)
+    {
+        std::ostringstream out;
+        out << std::setprecision(6);
+
+        for (std::size_t t = 0; t < triangle_count; ++t)
+        {
+            float const x = float(t % 1024);
+            float const y = float(t / 1024);
+            out << "v " << x << ' ' << y << " 0\n";
+            out << "v " << x + 1.f << ' ' << y << " 0\n";
+            out << "v " << x << ' ' << y + 1.f << " 0.5\n";
+            out << "f -3 -2 -1\n";
+        }
+
+        return std::move(out).str();
+    }
+
+    // Flat grid of quads with about triangle_count triangles, positions only, written with
+    // to_chars since the streams of grid_obj take longer than the parse at this size
+    std::string scaling_obj(std::size_t triangle_count)
+    {
+        std::size_t const size = std::max<std::size_t>(1, std::ceil(std::sqrt(triangle_count / 2.0)));
+        std::size_t const side = size + 1;
+
+        std::string result;
+        result.reserve(side * side * 24 + size * size * 40);
+
+        char buffer[32];
+        auto append = [&](auto value){
+            result.append(buffer, std::to_chars(buffer, buffer + sizeof(buffer), value).ptr);
+        };
+
+        for (std::size_t y = 0; y < side; ++y)
+            for (std::size_t x = 0; x < side; ++x)
+            {
+                result += "v ";
+                append(float(x) / size);
+                result += " 0 ";
+                append(float(y) / size);
+                result += '\n';
+            }
+
+        for (std::size_t y = 0; y < size; ++y)
+            for (std::size_t x = 0; x < size; ++x)
+            {
+                result += 'f';
+                for (std::size_t corner : {y * side + x, (y + 1) * side + x, (y + 1) * side + x + 1, y * side + x + 1})
+                {
+                    result += ' ';
+                    append(corner + 1);
+                }
+                result += '\n';
+            }
+
+        return result;
+    }
+
+    bool same_mesh(obj_data const & a, obj_data const & b)
+    {
+        return a.vertices.size() == b.vertices.size() && a.indices == b.indices && a.submeshes.size() == b.submeshes.size()
+            && std::memcmp(a.vertices.data(), b.vertices.data(), a.vertices.size() * sizeof(obj_data::vertex)) == 0;
+    }
+
+    void report(std::string const & stage, double ms, std::string const & detail = {})
+    {
+        std::cout << "  " << std::left << std::setw(24) << stage << std::right << std::setw(10) << std::fixed << std::setprecision(2) << ms << " ms";
+        if (!detail.empty())
+            std::cout << "   " << detail;
+        std::cout << '\n';
+    }
+
+    // amount is in units of unit / 1e6
+    std::string rate(double amount, double ms, char const * unit)
+    {
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(1) << amount / (ms * 1e3) << ' ' << unit << "/s";
+        return std::move(out).str();
+    }
+
+    void bench_source(std::string const & name, std::string_view source, bench_options const & options)
+    {
+        obj_data mesh = parse_obj_source(source, options.thread_count);
+        std::size_t const triangle_count = mesh.indices.size() / 3;
+
+        std::cout << name << ": " << std::fixed << std::setprecision(1) << source.size() / 1e6 << " MB, "
+            << mesh.vertices.size() << " vertices, " << triangle_count << " triangles\n";
+
+        // Parsing, which includes deduplicating the OBJ index triples
+        double ms = best_time(options.repeat, [&]{
+            std::istringstream input{std::string(source)};
+            parse_obj_stream(input);
+        });
+        report("parse (iostream)", ms, rate(source.size(), ms, "MB"));
+
+        ms = best_time(options.repeat, [&]{ parse_obj_source(source, 1); });
+        report("parse (1 thread)", ms, rate(source.size(), ms, "MB"));
+
+        if (options.thread_count > 1)
+        {
+            ms = best_time(options.repeat, [&]{ parse_obj_source(source, options.thread_count); });
+            report("parse (" + std::to_string(options.thread_count) + " threads)", ms, rate(source.size(), ms, "MB"));
+        }
+
+        // Into a context and output kept between runs; the first run sizes them, so
+        // the counts are those of the steady state
+        {
+            obj_parse_context context;
+            obj_data result;
+            parse_obj_source(source, result, context, options.thread_count);
+
+            obj_parse_stats stats;
+            ms = best_time(options.repeat, [&]{ stats = parse_obj_source(source, result, context, options.thread_count); });
+            report("parse (reused buffers)", ms, rate(source.size(), ms, "MB") + ", " + std::to_string(stats.allocations) + " buffers grown ("
+                + std::to_string(stats.allocated_bytes / 1024) + " KB)");
+        }
+
+        // The dedup table on its own, welding corners by position bits
+        std::vector<vertex_dedup_table::key> keys(mesh.indices.size());
+        for (std::size_t c = 0; c < keys.size(); ++c)
+            std::memcpy(keys[c].data(), mesh.vertices[mesh.indices[c]].position.data(), sizeof(keys[c]));
+
+        std::size_t unique = 0;
+        ms = best_time(options.repeat, [&]{
+            vertex_dedup_table table(mesh.vertices.size());
+            for (auto const & key : keys)
+                table.insert(key, table.size());
+            unique = table.size();
+        });
+        report("dedup (weld positions)", ms, rate(keys.size(), ms, "M inserts") + ", " + std::to_string(unique) + " unique");
+
+        // Upload preparation, each stage on a fresh copy of the parsed mesh
+        vertex_cache_report cache_report;
+        ms = best_time(options.repeat, [&]{
+            auto indices = mesh.indices;
+            cache_report = optimize_vertex_cache(std::span(indices), mesh.vertices.size());
+        });
+        {
+            std::ostringstream detail;
+            detail << std::setprecision(3) << "ACMR " << cache_report.before.acmr << " -> " << cache_report.after.acmr;
+            report("vertex cache", ms, detail.str());
+        }
+
+        ms = best_time(options.repeat, [&]{
+            auto copy = mesh;
+            optimize_vertex_fetch(copy);
+        });
+        report("vertex fetch (w/ copy)", ms);
+
+        compact_index_buffer compact;
+        ms = best_time(options.repeat, [&]{
+            compact = {};
+            append_indices(compact, mesh.indices, mesh.vertices.size());
+        });
+        report("16-bit indices", ms, std::to_string(compact.parts.size()) + " parts, "
+            + std::to_string(compact.indices.size() * sizeof(std::uint16_t) / 1024) + " KB");
+
+        ms = best_time(options.repeat, [&]{ pack_vertices(mesh.vertices); });
+        report("quantize vertices", ms, std::to_string(mesh.vertices.size() * sizeof(packed_vertex) / 1024) + " KB");
+    }
+
+    // Cold and warm loads through the mesh cache, in a directory of its own
+    void bench_cache(std::filesystem::path const & path, bench_options const & options)
+    {
+        mesh_cache_options cache_options;
+        cache_options.cache_directory = default_mesh_cache_directory() / "mesh_io_bench";
+        cache_options.thread_count = options.thread_count;
+
+        std::filesystem::remove(mesh_cache_path(path, cache_options.cache_directory));
+
+        auto const start = std::chrono::steady_clock::now();
+        load_obj_cached(path, cache_options);
+        report("cache (cold)", std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+
+        bool from_cache = false;
+        double const ms = best_time(options.repeat, [&]{ from_cache = load_obj_cached(path, cache_options).from_cache; });
+        report("cache (warm)", ms, from_cache ? "" : "not served from the cache");
+    }
+
+    // Parse throughput from 1 thread up, every result checked against the serial parse
+    void bench_scaling(bench_options const & options)
+    {
+        std::string const source = scaling_obj(options.scaling_triangles);
+        obj_data const serial = parse_obj_source(source, 1);
+        std::cout << "scaling: " << std::fixed << std::setprecision(1) << source.size() / 1e6 << " MB, "
+            << serial.vertices.size() << " vertices, " << serial.indices.size() / 3 << " triangles\n";
+
+        std::vector<unsigned int> thread_counts;
+        for (unsigned int threads = 1; threads < options.thread_count; threads *= 2)
+            thread_counts.push_back(threads);
+        thread_counts.push_back(options.thread_count);
+
+        double serial_ms = 0.0;
+        for (unsigned int threads : thread_counts)
+        {
+            obj_data result;
+            double const ms = best_time(options.repeat, [&]{ result = parse_obj_source(source, threads); });
+            if (threads == 1)
+                serial_ms = ms;
+
+            std::ostringstream detail;
+            detail << rate(source.size(), ms, "MB") << ", " << std::fixed << std::setprecision(2) << serial_ms / ms << "x";
+            report("parse (" + std::to_string(threads) + (threads == 1 ? " thread)" : " threads)"), ms, detail.str());
+
+            if (!same_mesh(result, serial))
+                throw std::runtime_error("Parse on " + std::to_string(threads) + " threads differs from the serial parse");
+        }
+        std::cout << '\n';
+    }
+
+}
+
+int main(int argc, char ** argv) try
+{
+    auto const options = parse_options(argc, argv);
+
+    std::cout << "threads: " << options.thread_count << ", best of " << options.repeat << " runs\n\n";
+
+    for (auto const & path : options.files)
+    {
+        mapped_file file(path);
+        bench_source(path.filename().string(), file.view(), options);
+        bench_cache(path, options);
+        std::cout << '\n';
+    }
+
+    if (options.stress)
+    {
+        auto const size = options.stress_size;
+        auto const quads = std::to_string(size) + "x" + std::to_string(size);
+
+        bench_source("grid " + quads, grid_obj(size, false), options);
+        std::cout << '\n';
+        bench_source("grid " + quads + " (relative indices)", grid_obj(size, true), options);
+        std::cout << '\n';
+        bench_source("soup " + std::to_string(2 * size * size), soup_obj(2 * size * size), options);
+        std::cout << '\n';
+    }
+
+    if (options.scaling)
+        bench_scaling(options);
+}
+catch (std::exception const & e)
+{
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+}
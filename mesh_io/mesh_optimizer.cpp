@@ -0,0 +1,631 @@
+#include "mesh_optimizer.hpp"
+
+#include <cmath>
+#include <array>
+#include <vector>
+#include <limits>
+#include <numeric>
+#include <algorithm>
+
+namespace
+{
+
+    // Scoring parameters from the original article
+    constexpr std::size_t forsyth_cache_size = 32;
+    constexpr float cache_decay_power = 1.5f;
+    constexpr float last_triangle_score = 0.75f;
+    constexpr float valence_boost_scale = 2.f;
+    constexpr float valence_boost_power = 0.5f;
+
+    constexpr std::uint32_t no_triangle = -1;
+
+    struct score_tables
+    {
+        float cache[forsyth_cache_size];
+        float valence[64];
+
+        score_tables()
+        {
+            for (std::size_t i = 0; i < forsyth_cache_size; ++i)
+            {
+                if (i < 3)
+                    cache[i] = last_triangle_score;
+                else
+                {
+                    float const scaler = 1.f / (forsyth_cache_size - 3);
+                    cache[i] = std::pow(1.f - (i - 3) * scaler, cache_decay_power);
+                }
+            }
+
+            for (std::size_t i = 0; i < std::size(valence); ++i)
+                valence[i] = (i == 0) ? 0.f : valence_boost_scale * std::pow(float(i), -valence_boost_power);
+        }
+    };
+
+    score_tables const & scores()
+    {
+        static score_tables const tables;
+        return tables;
+    }
+
+    // position is -1 for vertices not in the cache
+    float vertex_score(int position, std::uint32_t remaining_triangles)
+    {
+        if (remaining_triangles == 0)
+            return -1.f;
+
+        auto const & tables = scores();
+
+        float score = (position >= 0) ? tables.cache[position] : 0.f;
+
+        if (remaining_triangles < std::size(tables.valence))
+            score += tables.valence[remaining_triangles];
+        else
+            score += valence_boost_scale * std::pow(float(remaining_triangles), -valence_boost_power);
+
+        return score;
+    }
+
+    using vec3 = std::array<float, 3>;
+
+    vec3 operator - (vec3 const & a, vec3 const & b)
+    {
+        return {a[0] - b[0], a[1] - b[1], a[2] - b[2]};
+    }
+
+    vec3 cross(vec3 const & a, vec3 const & b)
+    {
+        return {a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0]};
+    }
+
+    float dot(vec3 const & a, vec3 const & b)
+    {
+        return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+    }
+
+    // Strided access to vertex positions
+    struct position_stream
+    {
+        char const * data;
+        std::size_t stride;
+
+        vec3 operator[](std::size_t index) const
+        {
+            auto p = reinterpret_cast<float const *>(data + index * stride);
+            return {p[0], p[1], p[2]};
+        }
+    };
+
+    // FIFO post-transform cache simulation that can be flushed in constant time
+    struct fifo_cache
+    {
+        std::vector<std::size_t> entry_time;
+        std::size_t size;
+        std::size_t transforms;
+
+        fifo_cache(std::size_t vertex_count, std::size_t size)
+            : entry_time(vertex_count, 0)
+            , size(size)
+            , transforms(size)
+        {}
+
+        // Returns 1 for a miss, 0 for a hit
+        unsigned int access(std::uint32_t vertex)
+        {
+            if (transforms - entry_time[vertex] < size)
+                return 0;
+
+            entry_time[vertex] = ++transforms;
+            return 1;
+        }
+
+        void flush()
+        {
+            transforms += size;
+        }
+    };
+
+    constexpr int overdraw_resolution = 256;
+
+    struct overdraw_target
+    {
+        std::vector<float> depth;
+        std::size_t shaded = 0;
+
+        overdraw_target()
+            : depth(overdraw_resolution * overdraw_resolution, std::numeric_limits<float>::infinity())
+        {}
+
+        // Triangle in pixel units with depth in z; counter-clockwise triangles are front-facing
+        void rasterize(vec3 const & a, vec3 const & b, vec3 const & c)
+        {
+            float const area = (b[0] - a[0]) * (c[1] - a[1]) - (b[1] - a[1]) * (c[0] - a[0]);
+            if (area <= 0.f)
+                return;
+
+            int const x0 = std::max(0, int(std::floor(std::min({a[0], b[0], c[0]}))));
+            int const y0 = std::max(0, int(std::floor(std::min({a[1], b[1], c[1]}))));
+            int const x1 = std::min(overdraw_resolution - 1, int(std::ceil(std::max({a[0], b[0], c[0]}))));
+            int const y1 = std::min(overdraw_resolution - 1, int(std::ceil(std::max({a[1], b[1], c[1]}))));
+
+            // Edge functions and their per-pixel steps
+            auto edge = [](vec3 const & p, vec3 const & q, float x, float y){
+                return (q[0] - p[0]) * (y - p[1]) - (q[1] - p[1]) * (x - p[0]);
+            };
+
+            float const inv_area = 1.f / area;
+
+            for (int y = y0; y <= y1; ++y)
+            {
+                float const py = y + 0.5f;
+                float w0 = edge(b, c, x0 + 0.5f, py);
+                float w1 = edge(c, a, x0 + 0.5f, py);
+                float w2 = edge(a, b, x0 + 0.5f, py);
+
+                for (int x = x0; x <= x1; ++x)
+                {
+                    if (w0 >= 0.f && w1 >= 0.f && w2 >= 0.f)
+                    {
+                        float const z = (w0 * a[2] + w1 * b[2] + w2 * c[2]) * inv_area;
+                        float & stored = depth[y * overdraw_resolution + x];
+                        if (z <= stored)
+                        {
+                            stored = z;
+                            ++shaded;
+                        }
+                    }
+
+                    w0 -= c[1] - b[1];
+                    w1 -= a[1] - c[1];
+                    w2 -= b[1] - a[1];
+                }
+            }
+        }
+
+        std::size_t covered() const
+        {
+            return std::count_if(depth.begin(), depth.end(), [](float z){ return z != std::numeric_limits<float>::infinity(); });
+        }
+    };
+
+}
+
+template <typename Index>
+vertex_cache_stats analyze_vertex_cache(std::span<Index const> indices, std::size_t vertex_count, std::size_t cache_size)
+{
+    vertex_cache_stats result;
+
+    if (indices.empty())
+        return result;
+
+    // Each vertex remembers the transform counter value at the time it entered the FIFO
+    std::vector<std::size_t> entry_time(vertex_count, 0);
+    std::vector<bool> referenced(vertex_count, false);
+
+    std::size_t transforms = 0;
+    std::size_t referenced_count = 0;
+
+    for (auto index : indices)
+    {
+        if (!referenced[index])
+        {
+            referenced[index] = true;
+            ++referenced_count;
+        }
+
+        if (entry_time[index] == 0 || transforms - entry_time[index] >= cache_size)
+        {
+            ++transforms;
+            entry_time[index] = transforms;
+        }
+    }
+
+    result.acmr = float(transforms) / (indices.size() / 3);
+    result.atvr = float(transforms) / referenced_count;
+    return result;
+}
+
+template <typename Index>
+vertex_cache_report optimize_vertex_cache(std::span<Index> indices, std::size_t vertex_count)
+{
+    vertex_cache_report report;
+    report.before = analyze_vertex_cache<Index>(indices, vertex_count);
+
+    std::size_t const triangle_count = indices.size() / 3;
+
+    if (triangle_count == 0)
+    {
+        report.after = report.before;
+        return report;
+    }
+
+    // Vertex -> triangle adjacency in compressed form
+    std::vector<std::uint32_t> remaining(vertex_count, 0);
+    for (auto index : indices)
+        ++remaining[index];
+
+    std::vector<std::uint32_t> adjacency_offset(vertex_count + 1, 0);
+    for (std::size_t v = 0; v < vertex_count; ++v)
+        adjacency_offset[v + 1] = adjacency_offset[v] + remaining[v];
+
+    std::vector<std::uint32_t> adjacency(indices.size());
+    {
+        std::vector<std::uint32_t> fill(adjacency_offset.begin(), adjacency_offset.end() - 1);
+        for (std::size_t t = 0; t < triangle_count; ++t)
+            for (std::size_t k = 0; k < 3; ++k)
+                adjacency[fill[indices[3 * t + k]]++] = t;
+    }
+
+    std::vector<int> cache_position(vertex_count, -1);
+    std::vector<float> score(vertex_count);
+    for (std::size_t v = 0; v < vertex_count; ++v)
+        score[v] = vertex_score(-1, remaining[v]);
+
+    std::vector<float> triangle_score(triangle_count);
+    std::vector<bool> emitted(triangle_count, false);
+    for (std::size_t t = 0; t < triangle_count; ++t)
+        triangle_score[t] = score[indices[3 * t]] + score[indices[3 * t + 1]] + score[indices[3 * t + 2]];
+
+    std::vector<Index> output;
+    output.reserve(indices.size());
+
+    std::vector<std::uint32_t> cache;
+    std::vector<std::uint32_t> new_cache;
+    cache.reserve(forsyth_cache_size + 3);
+    new_cache.reserve(forsyth_cache_size + 3);
+
+    std::uint32_t best = no_triangle;
+    std::size_t scan_cursor = 0;
+
+    for (std::size_t emitted_count = 0; emitted_count < triangle_count; ++emitted_count)
+    {
+        // No candidate among the cached vertices: fall back to the best remaining
+        // triangle in input order, which keeps the search amortized linear
+        if (best == no_triangle)
+        {
+            while (emitted[scan_cursor])
+                ++scan_cursor;
+
+            best = scan_cursor;
+            for (std::size_t t = scan_cursor + 1; t < triangle_count && t < scan_cursor + 64; ++t)
+                if (!emitted[t] && triangle_score[t] > triangle_score[best])
+                    best = t;
+        }
+
+        std::uint32_t const triangle = best;
+        emitted[triangle] = true;
+
+        std::uint32_t const corners[3] = {
+            std::uint32_t(indices[3 * triangle]),
+            std::uint32_t(indices[3 * triangle + 1]),
+            std::uint32_t(indices[3 * triangle + 2]),
+        };
+
+        for (auto v : corners)
+        {
+            output.push_back(Index(v));
+
+            // Remove the triangle from the vertex's list of remaining triangles
+            auto begin = adjacency.begin() + adjacency_offset[v];
+            auto end = begin + remaining[v];
+            auto it = std::find(begin, end, triangle);
+            std::iter_swap(it, end - 1);
+            --remaining[v];
+        }
+
+        // Most recently used vertices go to the front
+        new_cache.assign(corners, corners + 3);
+        for (auto v : cache)
+            if (v != corners[0] && v != corners[1] && v != corners[2])
+                new_cache.push_back(v);
+
+        for (auto v : cache)
+            cache_position[v] = -1;
+
+        std::swap(cache, new_cache);
+
+        for (std::size_t i = 0; i < cache.size(); ++i)
+        {
+            auto v = cache[i];
+            cache_position[v] = (i < forsyth_cache_size) ? int(i) : -1;
+        }
+
+        // Rescore the vertices that moved, including the ones that fell out of
+        // the cache, and the triangles around them
+        best = no_triangle;
+        float best_score = -1.f;
+
+        for (auto v : cache)
+        {
+            float const new_score = vertex_score(cache_position[v], remaining[v]);
+            float const delta = new_score - score[v];
+            score[v] = new_score;
+
+            for (std::uint32_t i = 0; i < remaining[v]; ++i)
+            {
+                auto t = adjacency[adjacency_offset[v] + i];
+                triangle_score[t] += delta;
+                if (triangle_score[t] > best_score)
+                {
+                    best_score = triangle_score[t];
+                    best = t;
+                }
+            }
+        }
+
+        if (cache.size() > forsyth_cache_size)
+            cache.resize(forsyth_cache_size);
+    }
+
+    std::copy(output.begin(), output.end(), indices.begin());
+
+    report.after = analyze_vertex_cache<Index>(indices, vertex_count);
+    return report;
+}
+
+template <typename Index>
+overdraw_stats analyze_overdraw(std::span<Index const> indices, float const * positions, std::size_t vertex_count, std::size_t stride)
+{
+    overdraw_stats result;
+
+    if (indices.empty())
+        return result;
+
+    position_stream const stream{reinterpret_cast<char const *>(positions), stride};
+
+    // Fit the mesh into the unit cube keeping its proportions
+    vec3 min = stream[indices[0]];
+    vec3 max = min;
+    for (auto index : indices)
+    {
+        auto const p = stream[index];
+        for (int i = 0; i < 3; ++i)
+        {
+            min[i] = std::min(min[i], p[i]);
+            max[i] = std::max(max[i], p[i]);
+        }
+    }
+
+    float const extent = std::max({max[0] - min[0], max[1] - min[1], max[2] - min[2]});
+    float const scale = (extent > 0.f) ? 1.f / extent : 0.f;
+
+    std::vector<vec3> normalized(vertex_count);
+    for (auto index : indices)
+    {
+        auto const p = stream[index];
+        for (int i = 0; i < 3; ++i)
+            normalized[index][i] = (p[i] - min[i]) * scale;
+    }
+
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        for (int side = 0; side < 2; ++side)
+        {
+            overdraw_target target;
+
+            // (u, v, depth) must be left-handed like window coordinates for counter-clockwise
+            // triangles to be front-facing: one view mirrors a screen axis, the other the depth
+            auto project = [&](vec3 const & p){
+                float u = p[(axis + 1) % 3];
+                float v = p[(axis + 2) % 3];
+                float z = p[axis];
+                if (side == 0)
+                    u = 1.f - u;
+                else
+                    z = 1.f - z;
+                return vec3{u * (overdraw_resolution - 1), v * (overdraw_resolution - 1), z};
+            };
+
+            for (std::size_t i = 0; i + 2 < indices.size(); i += 3)
+                target.rasterize(project(normalized[indices[i]]), project(normalized[indices[i + 1]]), project(normalized[indices[i + 2]]));
+
+            result.pixels_shaded += target.shaded;
+            result.pixels_covered += target.covered();
+        }
+    }
+
+    result.overdraw = (result.pixels_covered > 0) ? float(result.pixels_shaded) / result.pixels_covered : 0.f;
+    return result;
+}
+
+template <typename Index>
+void optimize_overdraw(std::span<Index> indices, float const * positions, std::size_t vertex_count, std::size_t stride, float threshold)
+{
+    std::size_t const triangle_count = indices.size() / 3;
+    if (triangle_count == 0)
+        return;
+
+    position_stream const stream{reinterpret_cast<char const *>(positions), stride};
+
+    fifo_cache cache(vertex_count, 16);
+
+    auto misses = [&](std::size_t t){
+        return cache.access(indices[3 * t]) + cache.access(indices[3 * t + 1]) + cache.access(indices[3 * t + 2]);
+    };
+
+    // Hard boundaries: triangles where the cache restarts from scratch
+    std::vector<std::uint32_t> hard_boundaries;
+    for (std::size_t t = 0; t < triangle_count; ++t)
+        if (misses(t) == 3)
+            hard_boundaries.push_back(t);
+    hard_boundaries.push_back(triangle_count);
+
+    // Soft boundaries: cut a hard cluster as soon as the cache efficiency of the
+    // part cut so far is within threshold of the whole cluster's
+    std::vector<std::uint32_t> boundaries;
+    for (std::size_t c = 0; c + 1 < hard_boundaries.size(); ++c)
+    {
+        std::size_t const begin = hard_boundaries[c];
+        std::size_t const end = hard_boundaries[c + 1];
+
+        cache.flush();
+        std::size_t cluster_misses = 0;
+        for (std::size_t t = begin; t < end; ++t)
+            cluster_misses += misses(t);
+
+        float const cluster_threshold = threshold * cluster_misses / (end - begin);
+
+        cache.flush();
+        boundaries.push_back(begin);
+
+        std::size_t running_misses = 0;
+        std::size_t running_triangles = 0;
+        for (std::size_t t = begin; t < end; ++t)
+        {
+            running_misses += misses(t);
+            ++running_triangles;
+
+            if (t + 1 < end && running_misses <= cluster_threshold * running_triangles)
+            {
+                boundaries.push_back(t + 1);
+                cache.flush();
+                running_misses = 0;
+                running_triangles = 0;
+            }
+        }
+    }
+    boundaries.push_back(triangle_count);
+
+    std::size_t const cluster_count = boundaries.size() - 1;
+
+    // Area-weighted mesh centroid
+    vec3 mesh_centroid{0.f, 0.f, 0.f};
+    double mesh_area = 0.0;
+
+    std::vector<vec3> centroids(cluster_count);
+    std::vector<vec3> normals(cluster_count);
+
+    for (std::size_t c = 0; c < cluster_count; ++c)
+    {
+        vec3 centroid{0.f, 0.f, 0.f};
+        vec3 normal{0.f, 0.f, 0.f};
+        float area = 0.f;
+
+        for (std::size_t t = boundaries[c]; t < boundaries[c + 1]; ++t)
+        {
+            auto const p0 = stream[indices[3 * t]];
+            auto const p1 = stream[indices[3 * t + 1]];
+            auto const p2 = stream[indices[3 * t + 2]];
+
+            auto const n = cross(p1 - p0, p2 - p0);
+            float const a = std::sqrt(dot(n, n));
+
+            for (int i = 0; i < 3; ++i)
+            {
+                centroid[i] += (p0[i] + p1[i] + p2[i]) / 3.f * a;
+                normal[i] += n[i];
+            }
+            area += a;
+        }
+
+        for (int i = 0; i < 3; ++i)
+            mesh_centroid[i] += centroid[i];
+        mesh_area += area;
+
+        if (area > 0.f)
+            for (int i = 0; i < 3; ++i)
+                centroid[i] /= area;
+
+        float const length = std::sqrt(dot(normal, normal));
+        if (length > 0.f)
+            for (int i = 0; i < 3; ++i)
+                normal[i] /= length;
+
+        centroids[c] = centroid;
+        normals[c] = normal;
+    }
+
+    if (mesh_area > 0.0)
+        for (int i = 0; i < 3; ++i)
+            mesh_centroid[i] /= mesh_area;
+
+    // Clusters that face away from the center are likely to occlude the rest
+    std::vector<float> sort_key(cluster_count);
+    for (std::size_t c = 0; c < cluster_count; ++c)
+        sort_key[c] = dot(centroids[c] - mesh_centroid, normals[c]);
+
+    std::vector<std::uint32_t> order(cluster_count);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](std::uint32_t a, std::uint32_t b){ return sort_key[a] > sort_key[b]; });
+
+    std::vector<Index> output;
+    output.reserve(triangle_count * 3);
+    for (auto c : order)
+        output.insert(output.end(), indices.begin() + 3 * boundaries[c], indices.begin() + 3 * boundaries[c + 1]);
+
+    std::copy(output.begin(), output.end(), indices.begin());
+}
+
+template <typename Index>
+vertex_fetch_stats analyze_vertex_fetch(std::span<Index const> indices, std::size_t vertex_count, std::size_t vertex_size)
+{
+    vertex_fetch_stats result;
+
+    constexpr std::size_t line_size = 64;
+    constexpr std::size_t line_count = 256;
+
+    std::vector<std::size_t> lines(line_count, -1);
+    std::vector<bool> referenced(vertex_count, false);
+    std::size_t referenced_count = 0;
+
+    for (auto index : indices)
+    {
+        if (!referenced[index])
+        {
+            referenced[index] = true;
+            ++referenced_count;
+        }
+
+        std::size_t const first = index * vertex_size / line_size;
+        std::size_t const last = ((index + 1) * vertex_size - 1) / line_size;
+
+        for (std::size_t line = first; line <= last; ++line)
+        {
+            auto & slot = lines[line % line_count];
+            if (slot != line)
+            {
+                slot = line;
+                result.bytes_fetched += line_size;
+            }
+        }
+    }
+
+    if (referenced_count > 0)
+        result.overfetch = float(result.bytes_fetched) / (referenced_count * vertex_size);
+    return result;
+}
+
+template <typename Index>
+std::size_t optimize_vertex_fetch(std::span<Index> indices, std::span<std::uint32_t> remap)
+{
+    std::fill(remap.begin(), remap.end(), unused_vertex);
+
+    std::uint32_t next = 0;
+    for (auto & index : indices)
+    {
+        if (remap[index] == unused_vertex)
+            remap[index] = next++;
+        index = Index(remap[index]);
+    }
+
+    return next;
+}
+
+template vertex_cache_stats analyze_vertex_cache<std::uint8_t>(std::span<std::uint8_t const>, std::size_t, std::size_t);
+template vertex_cache_stats analyze_vertex_cache<std::uint16_t>(std::span<std::uint16_t const>, std::size_t, std::size_t);
+template vertex_cache_stats analyze_vertex_cache<std::uint32_t>(std::span<std::uint32_t const>, std::size_t, std::size_t);
+template vertex_cache_report optimize_vertex_cache<std::uint8_t>(std::span<std::uint8_t>, std::size_t);
+template vertex_cache_report optimize_vertex_cache<std::uint16_t>(std::span<std::uint16_t>, std::size_t);
+template vertex_cache_report optimize_vertex_cache<std::uint32_t>(std::span<std::uint32_t>, std::size_t);
+template overdraw_stats analyze_overdraw<std::uint8_t>(std::span<std::uint8_t const>, float const *, std::size_t, std::size_t);
+template overdraw_stats analyze_overdraw<std::uint16_t>(std::span<std::uint16_t const>, float const *, std::size_t, std::size_t);
+template overdraw_stats analyze_overdraw<std::uint32_t>(std::span<std::uint32_t const>, float const *, std::size_t, std::size_t);
+template void optimize_overdraw<std::uint8_t>(std::span<std::uint8_t>, float const *, std::size_t, std::size_t, float);
+template void optimize_overdraw<std::uint16_t>(std::span<std::uint16_t>, float const *, std::size_t, std::size_t, float);
+template void optimize_overdraw<std::uint32_t>(std::span<std::uint32_t>, float const *, std::size_t, std::size_t, float);
+template vertex_fetch_stats analyze_vertex_fetch<std::uint8_t>(std::span<std::uint8_t const>, std::size_t, std::size_t);
+template vertex_fetch_stats analyze_vertex_fetch<std::uint16_t>(std::span<std::uint16_t const>, std::size_t, std::size_t);
+template vertex_fetch_stats analyze_vertex_fetch<std::uint32_t>(std::span<std::uint32_t const>, std::size_t, std::size_t);
+template std::size_t optimize_vertex_fetch<std::uint8_t>(std::span<std::uint8_t>, std::span<std::uint32_t>);
+template std::size_t optimize_vertex_fetch<std::uint16_t>(std::span<std::uint16_t>, std::span<std::uint32_t>);
+template std::size_t optimize_vertex_fetch<std::uint32_t>(std::span<std::uint32_t>, std::span<std::uint32_t>);
@@ -0,0 +1,172 @@
+#pragma once
+
+#include <span>
+#include <cstdint>
+#include <vector>
+#include <utility>
+#include <type_traits>
+
+struct vertex_cache_stats
+{
+    // Average cache miss ratio: vertex shader invocations per triangle, 0.5 at best for large grids, 3 at worst
+    float acmr = 0.f;
+    // Average transform to vertex ratio: vertex shader invocations per referenced vertex, 1 at best
+    float atvr = 0.f;
+};
+
+struct vertex_cache_report
+{
+    vertex_cache_stats before;
+    vertex_cache_stats after;
+};
+
+// Simulates a FIFO post-transform cache with the given number of entries
+template <typename Index>
+vertex_cache_stats analyze_vertex_cache(std::span<Index const> indices, std::size_t vertex_count, std::size_t cache_size = 16);
+
+// Reorders triangles for post-transform cache locality using Tom Forsyth's
+// "Linear-Speed Vertex Cache Optimisation"; the set of triangles and their
+// winding are preserved
+template <typename Index>
+vertex_cache_report optimize_vertex_cache(std::span<Index> indices, std::size_t vertex_count);
+
+struct overdraw_stats
+{
+    std::size_t pixels_covered = 0;
+    std::size_t pixels_shaded = 0;
+    // Shaded per covered pixel, 1 at best
+    float overdraw = 0.f;
+};
+
+// Software-rasterizes the mesh from six axis-aligned orthographic views with back-face
+// culling and an early depth test, counting fragments that pass the test as shaded.
+// positions point to the first vertex position, stride is the distance between vertices in bytes
+template <typename Index>
+overdraw_stats analyze_overdraw(std::span<Index const> indices, float const * positions, std::size_t vertex_count, std::size_t stride);
+
+// Splits a cache-optimized index buffer into clusters at cache flushes, then further where the
+// running ACMR stays within threshold of the cluster's, and sorts the clusters so that the ones
+// facing away from the mesh center are drawn first. threshold trades cache efficiency for overdraw
+template <typename Index>
+void optimize_overdraw(std::span<Index> indices, float const * positions, std::size_t vertex_count, std::size_t stride, float threshold = 1.05f);
+
+struct vertex_fetch_stats
+{
+    std::size_t bytes_fetched = 0;
+    // Fetched bytes per byte of referenced vertex data, 1 at best
+    float overfetch = 0.f;
+};
+
+// Simulates a 16 KB direct-mapped cache of 64-byte lines in front of the vertex buffer
+template <typename Index>
+vertex_fetch_stats analyze_vertex_fetch(std::span<Index const> indices, std::size_t vertex_count, std::size_t vertex_size);
+
+constexpr std::uint32_t unused_vertex = -1;
+
+// Renumbers vertices in the order of their first use so that vertex fetch streams linearly
+// through memory. remap has one entry per vertex and receives the new index of each vertex,
+// or unused_vertex for unreferenced ones; returns the number of referenced vertices
+template <typename Index>
+std::size_t optimize_vertex_fetch(std::span<Index> indices, std::span<std::uint32_t> remap);
+
+// Convenience overloads for meshes with vertices and indices vectors, like obj_data
+template <typename Mesh>
+vertex_cache_stats analyze_vertex_cache(Mesh const & mesh)
+{
+    return analyze_vertex_cache(std::span(std::as_const(mesh.indices)), mesh.vertices.size());
+}
+
+// Meshes with several submeshes, like obj_data, are optimized one submesh at a time,
+// so that triangles stay within their submesh's index range
+template <typename Mesh>
+bool has_submeshes(Mesh const & mesh)
+{
+    if constexpr (requires { mesh.submeshes; })
+        return mesh.submeshes.size() > 1;
+    else
+        return false;
+}
+
+template <typename Mesh, typename Function>
+void for_each_submesh_range(Mesh & mesh, Function const & function)
+{
+    if constexpr (requires { mesh.submeshes; })
+    {
+        if (has_submeshes(mesh))
+        {
+            for (auto const & submesh : mesh.submeshes)
+                function(std::span(mesh.indices).subspan(submesh.index_offset, submesh.index_count));
+            return;
+        }
+    }
+
+    function(std::span(mesh.indices));
+}
+
+template <typename Mesh>
+vertex_cache_report optimize_vertex_cache(Mesh & mesh)
+{
+    if (!has_submeshes(mesh))
+        return optimize_vertex_cache(std::span(mesh.indices), mesh.vertices.size());
+
+    vertex_cache_report result;
+    result.before = analyze_vertex_cache(mesh);
+    for_each_submesh_range(mesh, [&](auto indices){ optimize_vertex_cache(indices, mesh.vertices.size()); });
+    result.after = analyze_vertex_cache(mesh);
+    return result;
+}
+
+template <typename Mesh>
+float const * mesh_positions(Mesh const & mesh)
+{
+    return mesh.vertices.empty() ? nullptr : mesh.vertices[0].position.data();
+}
+
+template <typename Mesh>
+overdraw_stats analyze_overdraw(Mesh const & mesh)
+{
+    return analyze_overdraw(std::span(std::as_const(mesh.indices)), mesh_positions(mesh), mesh.vertices.size(), sizeof(mesh.vertices[0]));
+}
+
+template <typename Mesh>
+void optimize_overdraw(Mesh & mesh, float threshold = 1.05f)
+{
+    for_each_submesh_range(mesh, [&](auto indices){
+        optimize_overdraw(indices, mesh_positions(mesh), mesh.vertices.size(), sizeof(mesh.vertices[0]), threshold);
+    });
+}
+
+template <typename Mesh>
+vertex_fetch_stats analyze_vertex_fetch(Mesh const & mesh)
+{
+    return analyze_vertex_fetch(std::span(std::as_const(mesh.indices)), mesh.vertices.size(), sizeof(mesh.vertices[0]));
+}
+
+// Reorders mesh.vertices in place, dropping unreferenced vertices
+template <typename Mesh>
+void optimize_vertex_fetch(Mesh & mesh)
+{
+    std::vector<std::uint32_t> remap(mesh.vertices.size());
+    auto const vertex_count = optimize_vertex_fetch(std::span(mesh.indices), std::span(remap));
+
+    std::remove_reference_t<decltype(mesh.vertices)> vertices(vertex_count);
+    for (std::size_t v = 0; v < remap.size(); ++v)
+        if (remap[v] != unused_vertex)
+            vertices[remap[v]] = mesh.vertices[v];
+
+    mesh.vertices = std::move(vertices);
+
+    // Attribute streams kept beside the vertices, such as obj_data::tangents
+    if constexpr (requires { mesh.tangents; })
+    {
+        if (!mesh.tangents.empty())
+        {
+            std::remove_reference_t<decltype(mesh.tangents)> tangents(vertex_count);
+            for (std::size_t v = 0; v < remap.size(); ++v)
+                if (remap[v] != unused_vertex)
+                    tangents[remap[v]] = mesh.tangents[v];
+
+            mesh.tangents = std::move(tangents);
+        }
+    }
+}
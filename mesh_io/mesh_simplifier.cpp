@@ -0,0 +1,605 @@
+#include "mesh_simplifier.hpp"
+#include "parallel.hpp"
+
+#include <cmath>
+#include <limits>
+#include <cstring>
+#include <algorithm>
+
+namespace
+{
+
+    using vec3 = std::array<float, 3>;
+
+    vec3 sub(vec3 const & a, vec3 const & b)
+    {
+        return {a[0] - b[0], a[1] - b[1], a[2] - b[2]};
+    }
+
+    float dot(vec3 const & a, vec3 const & b)
+    {
+        return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+    }
+
+    vec3 cross(vec3 const & a, vec3 const & b)
+    {
+        return {a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0]};
+    }
+
+    // Symmetric 4x4 error quadric, stored as its 10 distinct coefficients, plus the
+    // total weight of the planes summed into it
+    struct quadric
+    {
+        float a00 = 0.f, a11 = 0.f, a22 = 0.f;
+        float a10 = 0.f, a20 = 0.f, a21 = 0.f;
+        float b0 = 0.f, b1 = 0.f, b2 = 0.f;
+        float c = 0.f;
+        float weight = 0.f;
+
+        // Plane n.x + d = 0 with unit n
+        void add_plane(vec3 const & n, float d, float w)
+        {
+            a00 += w * n[0] * n[0];
+            a11 += w * n[1] * n[1];
+            a22 += w * n[2] * n[2];
+            a10 += w * n[1] * n[0];
+            a20 += w * n[2] * n[0];
+            a21 += w * n[2] * n[1];
+            b0 += w * n[0] * d;
+            b1 += w * n[1] * d;
+            b2 += w * n[2] * d;
+            c += w * d * d;
+            weight += w;
+        }
+
+        void operator += (quadric const & q)
+        {
+            a00 += q.a00; a11 += q.a11; a22 += q.a22;
+            a10 += q.a10; a20 += q.a20; a21 += q.a21;
+            b0 += q.b0; b1 += q.b1; b2 += q.b2;
+            c += q.c;
+            weight += q.weight;
+        }
+
+        // Weighted mean squared distance from p to the planes
+        float error(vec3 const & p) const
+        {
+            float const rx = a00 * p[0] + a10 * p[1] + a20 * p[2] + 2.f * b0;
+            float const ry = a10 * p[0] + a11 * p[1] + a21 * p[2] + 2.f * b1;
+            float const rz = a20 * p[0] + a21 * p[1] + a22 * p[2] + 2.f * b2;
+            float const r = rx * p[0] + ry * p[1] + rz * p[2] + c;
+            return (weight > 0.f) ? std::abs(r) / weight : 0.f;
+        }
+    };
+
+    // Border edges are preserved by a plane through the edge, perpendicular to the triangle
+    constexpr float edge_weight = 10.f;
+
+    enum class vertex_kind : std::uint8_t
+    {
+        manifold,
+        border,
+        seam,
+        locked,
+    };
+
+    constexpr std::uint32_t no_vertex = -1;
+    constexpr std::uint32_t many_vertices = -2;
+
+    struct collapse
+    {
+        std::uint32_t v0;
+        std::uint32_t v1;
+        float error;
+    };
+
+    template <typename Index>
+    struct simplifier
+    {
+        std::vector<Index> & indices;
+        std::size_t vertex_count;
+
+        // Positions scaled into the unit cube
+        std::vector<vec3> positions;
+
+        // First vertex with the same position, and a ring through all such vertices
+        std::vector<std::uint32_t> position_remap;
+        std::vector<std::uint32_t> wedge;
+
+        std::vector<vertex_kind> kind;
+        // Neighbours across the open edges of border and seam vertices; for borders
+        // in position space, for seams in index space
+        std::vector<std::uint32_t> open_next;
+        std::vector<std::uint32_t> open_prev;
+
+        // Where each vertex currently lives after the collapses so far
+        std::vector<std::uint32_t> current;
+
+        std::vector<quadric> quadrics;
+
+        // Vertex -> triangles adjacency of the current index buffer
+        std::vector<std::uint32_t> adjacency_offset;
+        std::vector<std::uint32_t> adjacency;
+
+        simplifier(std::vector<Index> & indices, float const * source_positions, std::size_t vertex_count, std::size_t stride)
+            : indices(indices)
+            , vertex_count(vertex_count)
+        {
+            load_positions(source_positions, stride);
+            build_adjacency();
+            classify();
+            build_quadrics();
+
+            current.resize(vertex_count);
+            for (std::size_t v = 0; v < vertex_count; ++v)
+                current[v] = v;
+        }
+
+        void load_positions(float const * source, std::size_t stride)
+        {
+            positions.resize(vertex_count);
+            position_remap.resize(vertex_count);
+            wedge.resize(vertex_count);
+
+            constexpr float inf = std::numeric_limits<float>::infinity();
+            vec3 min{inf, inf, inf};
+            vec3 max{-inf, -inf, -inf};
+
+            for (std::size_t v = 0; v < vertex_count; ++v)
+            {
+                auto p = reinterpret_cast<float const *>(reinterpret_cast<char const *>(source) + v * stride);
+                positions[v] = {p[0], p[1], p[2]};
+
+                for (int i = 0; i < 3; ++i)
+                {
+                    min[i] = std::min(min[i], p[i]);
+                    max[i] = std::max(max[i], p[i]);
+                }
+            }
+
+            // Group vertices with exactly equal positions by sorting them; every vertex maps
+            // to the lowest-numbered one of its group, and the group is linked into a ring
+            std::vector<std::uint32_t> order(vertex_count);
+            for (std::size_t v = 0; v < vertex_count; ++v)
+                order[v] = v;
+
+            std::sort(order.begin(), order.end(), [&](std::uint32_t a, std::uint32_t b){
+                if (positions[a] != positions[b])
+                    return positions[a] < positions[b];
+                return a < b;
+            });
+
+            for (std::size_t begin = 0, end = 0; begin < vertex_count; begin = end)
+            {
+                while (end < vertex_count && positions[order[end]] == positions[order[begin]])
+                    ++end;
+
+                for (std::size_t i = begin; i < end; ++i)
+                {
+                    position_remap[order[i]] = order[begin];
+                    wedge[order[i]] = order[(i + 1 < end) ? i + 1 : begin];
+                }
+            }
+
+            float const extent = std::max({max[0] - min[0], max[1] - min[1], max[2] - min[2]});
+            float const scale = (extent > 0.f) ? 1.f / extent : 0.f;
+
+            for (auto & p : positions)
+                for (int i = 0; i < 3; ++i)
+                    p[i] = (p[i] - min[i]) * scale;
+        }
+
+        void build_adjacency()
+        {
+            adjacency_offset.assign(vertex_count + 1, 0);
+            for (auto index : indices)
+                ++adjacency_offset[index + 1];
+            for (std::size_t v = 0; v < vertex_count; ++v)
+                adjacency_offset[v + 1] += adjacency_offset[v];
+
+            adjacency.resize(indices.size());
+            std::vector<std::uint32_t> fill(adjacency_offset.begin(), adjacency_offset.end() - 1);
+            for (std::size_t t = 0; t < indices.size() / 3; ++t)
+                for (std::size_t k = 0; k < 3; ++k)
+                    adjacency[fill[indices[3 * t + k]]++] = t;
+        }
+
+        template <typename F>
+        void for_each_triangle(std::uint32_t v, F const & f) const
+        {
+            for (auto i = adjacency_offset[v]; i < adjacency_offset[v + 1]; ++i)
+                f(adjacency[i]);
+        }
+
+        // Calls f(next, previous) with the other two corners of every triangle around v, in winding order
+        template <typename F>
+        void for_each_corner(std::uint32_t v, F const & f) const
+        {
+            for_each_triangle(v, [&](std::uint32_t t){
+                auto const * tri = indices.data() + 3 * t;
+                int const k = (tri[0] == v) ? 0 : (tri[1] == v) ? 1 : 2;
+                f(std::uint32_t(tri[(k + 1) % 3]), std::uint32_t(tri[(k + 2) % 3]));
+            });
+        }
+
+        bool has_edge(std::uint32_t a, std::uint32_t b) const
+        {
+            bool found = false;
+            for_each_corner(a, [&](std::uint32_t next, std::uint32_t){ found |= (next == b); });
+            return found;
+        }
+
+        bool has_position_edge(std::uint32_t a, std::uint32_t b) const
+        {
+            auto const target = position_remap[b];
+            std::uint32_t v = a;
+            do
+            {
+                bool found = false;
+                for_each_corner(v, [&](std::uint32_t next, std::uint32_t){ found |= (position_remap[next] == target); });
+                if (found)
+                    return true;
+                v = wedge[v];
+            }
+            while (v != a);
+            return false;
+        }
+
+        static void record(std::uint32_t & slot, std::uint32_t v)
+        {
+            if (slot == no_vertex || slot == v)
+                slot = v;
+            else
+                slot = many_vertices;
+        }
+
+        // Unique neighbours across open edges, or no_vertex / many_vertices
+        std::pair<std::uint32_t, std::uint32_t> open_edges(std::uint32_t v) const
+        {
+            std::uint32_t next_open = no_vertex;
+            std::uint32_t prev_open = no_vertex;
+            for_each_corner(v, [&](std::uint32_t next, std::uint32_t prev){
+                if (!has_edge(next, v))
+                    record(next_open, next);
+                if (!has_edge(v, prev))
+                    record(prev_open, prev);
+            });
+            return {next_open, prev_open};
+        }
+
+        std::pair<std::uint32_t, std::uint32_t> open_position_edges(std::uint32_t first) const
+        {
+            std::uint32_t next_open = no_vertex;
+            std::uint32_t prev_open = no_vertex;
+            std::uint32_t v = first;
+            do
+            {
+                for_each_corner(v, [&](std::uint32_t next, std::uint32_t prev){
+                    if (!has_position_edge(next, v))
+                        record(next_open, next);
+                    if (!has_position_edge(v, prev))
+                        record(prev_open, prev);
+                });
+                v = wedge[v];
+            }
+            while (v != first);
+            return {next_open, prev_open};
+        }
+
+        void classify()
+        {
+            kind.assign(vertex_count, vertex_kind::locked);
+            open_next.assign(vertex_count, no_vertex);
+            open_prev.assign(vertex_count, no_vertex);
+
+            auto unique = [](std::uint32_t v){ return v != no_vertex && v != many_vertices; };
+
+            for (std::uint32_t v = 0; v < vertex_count; ++v)
+            {
+                if (position_remap[v] != v)
+                    continue;
+
+                auto const [next, prev] = open_position_edges(v);
+
+                if (wedge[v] == v)
+                {
+                    if (next == no_vertex && prev == no_vertex)
+                        kind[v] = vertex_kind::manifold;
+                    else if (unique(next) && unique(prev))
+                    {
+                        kind[v] = vertex_kind::border;
+                        open_next[v] = next;
+                        open_prev[v] = prev;
+                    }
+                }
+                else if (wedge[wedge[v]] == v && next == no_vertex && prev == no_vertex)
+                {
+                    // Two vertices at one position, closed in position space: a seam if each
+                    // side has one open edge pair and the two sides run along the same edges
+                    auto const w = wedge[v];
+                    auto const [v_next, v_prev] = open_edges(v);
+                    auto const [w_next, w_prev] = open_edges(w);
+
+                    if (unique(v_next) && unique(v_prev) && unique(w_next) && unique(w_prev)
+                        && position_remap[v_next] == position_remap[w_prev] && position_remap[v_prev] == position_remap[w_next])
+                    {
+                        kind[v] = kind[w] = vertex_kind::seam;
+                        open_next[v] = v_next;
+                        open_prev[v] = v_prev;
+                        open_next[w] = w_next;
+                        open_prev[w] = w_prev;
+                    }
+                }
+            }
+        }
+
+        void build_quadrics()
+        {
+            quadrics.assign(vertex_count, {});
+
+            for (std::size_t t = 0; t < indices.size() / 3; ++t)
+            {
+                std::uint32_t const tri[3] = {indices[3 * t], indices[3 * t + 1], indices[3 * t + 2]};
+
+                auto const & p0 = positions[tri[0]];
+                auto n = cross(sub(positions[tri[1]], p0), sub(positions[tri[2]], p0));
+                float const length = std::sqrt(dot(n, n));
+                if (length == 0.f)
+                    continue;
+                for (auto & x : n)
+                    x /= length;
+
+                float const area = 0.5f * length;
+                for (auto v : tri)
+                    quadrics[position_remap[v]].add_plane(n, -dot(n, p0), area);
+
+                for (int k = 0; k < 3; ++k)
+                {
+                    auto const a = tri[k];
+                    auto const b = tri[(k + 1) % 3];
+                    if (has_edge(b, a))
+                        continue;
+
+                    // Open in index space: a border or a seam
+                    auto const edge = sub(positions[b], positions[a]);
+                    auto e = cross(edge, n);
+                    float const e_length = std::sqrt(dot(e, e));
+                    if (e_length == 0.f)
+                        continue;
+                    for (auto & x : e)
+                        x /= e_length;
+
+                    float const d = -dot(e, positions[a]);
+                    float const w = edge_weight * dot(edge, edge);
+                    quadrics[position_remap[a]].add_plane(e, d, w);
+                    quadrics[position_remap[b]].add_plane(e, d, w);
+                }
+            }
+        }
+
+        std::uint32_t resolve(std::uint32_t v) const
+        {
+            return (v == no_vertex || v == many_vertices) ? v : current[v];
+        }
+
+        // Target for the seam partner of v0 when v0 collapses onto v1, or no_vertex
+        std::uint32_t seam_partner_target(std::uint32_t v0, std::uint32_t v1) const
+        {
+            auto const w0 = wedge[v0];
+            auto const next = resolve(open_next[w0]);
+            auto const prev = resolve(open_prev[w0]);
+            if (next != no_vertex && position_remap[next] == position_remap[v1])
+                return next;
+            if (prev != no_vertex && position_remap[prev] == position_remap[v1])
+                return prev;
+            return no_vertex;
+        }
+
+        bool can_collapse(std::uint32_t v0, std::uint32_t v1) const
+        {
+            switch (kind[v0])
+            {
+            case vertex_kind::manifold:
+                return true;
+            case vertex_kind::border:
+            {
+                auto const p1 = position_remap[v1];
+                auto const next = resolve(open_next[v0]);
+                auto const prev = resolve(open_prev[v0]);
+                return (next != no_vertex && position_remap[next] == p1) || (prev != no_vertex && position_remap[prev] == p1);
+            }
+            case vertex_kind::seam:
+                return (v1 == resolve(open_next[v0]) || v1 == resolve(open_prev[v0])) && seam_partner_target(v0, v1) != no_vertex;
+            default:
+                return false;
+            }
+        }
+
+        // Moving v0 onto v1 must not turn any remaining triangle around v0 upside down
+        bool flips(std::uint32_t v0, std::uint32_t v1) const
+        {
+            auto const & target = positions[v1];
+            bool result = false;
+
+            for_each_corner(v0, [&](std::uint32_t next, std::uint32_t prev){
+                if (result || next == v1 || prev == v1)
+                    return;
+
+                auto const & pn = positions[next];
+                auto const & pp = positions[prev];
+                auto const before = cross(sub(pn, positions[v0]), sub(pp, positions[v0]));
+                auto const after = cross(sub(pn, target), sub(pp, target));
+                if (dot(before, after) <= 0.f)
+                    result = true;
+            });
+
+            return result;
+        }
+
+        std::vector<collapse> collect_collapses() const
+        {
+            std::vector<collapse> result;
+
+            for (std::size_t i = 0; i < indices.size(); ++i)
+            {
+                std::uint32_t const a = indices[i];
+                std::uint32_t const b = indices[i - i % 3 + (i + 1) % 3];
+
+                // Interior edges are seen from both sides; keep one of them
+                if (a > b && has_edge(b, a))
+                    continue;
+
+                collapse best{no_vertex, no_vertex, std::numeric_limits<float>::infinity()};
+
+                auto consider = [&](std::uint32_t v0, std::uint32_t v1){
+                    if (!can_collapse(v0, v1))
+                        return;
+                    float const error = quadrics[position_remap[v0]].error(positions[v1]);
+                    if (error < best.error)
+                        best = {v0, v1, error};
+                };
+
+                consider(a, b);
+                consider(b, a);
+
+                if (best.v0 != no_vertex)
+                    result.push_back(best);
+            }
+
+            std::sort(result.begin(), result.end(), [](collapse const & x, collapse const & y){
+                if (x.error != y.error)
+                    return x.error < y.error;
+                if (x.v0 != y.v0)
+                    return x.v0 < y.v0;
+                return x.v1 < y.v1;
+            });
+
+            return result;
+        }
+
+        float run(std::size_t target_index_count, float target_error)
+        {
+            float const error_limit = target_error * target_error;
+            float result_error = 0.f;
+
+            std::vector<std::uint32_t> collapse_remap(vertex_count);
+            std::vector<bool> collapse_locked(vertex_count);
+
+            while (indices.size() > target_index_count)
+            {
+                auto const collapses = collect_collapses();
+                if (collapses.empty())
+                    break;
+
+                for (std::size_t v = 0; v < vertex_count; ++v)
+                    collapse_remap[v] = v;
+                std::fill(collapse_locked.begin(), collapse_locked.end(), false);
+
+                std::size_t const triangle_goal = (indices.size() - target_index_count) / 3;
+                std::size_t triangles_removed = 0;
+                std::size_t applied = 0;
+
+                for (auto const & c : collapses)
+                {
+                    if (c.error > error_limit || triangles_removed >= triangle_goal)
+                        break;
+
+                    auto const p0 = position_remap[c.v0];
+                    auto const p1 = position_remap[c.v1];
+                    if (collapse_locked[p0] || collapse_locked[p1])
+                        continue;
+
+                    if (flips(c.v0, c.v1))
+                        continue;
+
+                    if (kind[c.v0] == vertex_kind::seam)
+                    {
+                        auto const w0 = wedge[c.v0];
+                        auto const w1 = seam_partner_target(c.v0, c.v1);
+                        if (flips(w0, w1))
+                            continue;
+                        collapse_remap[w0] = w1;
+                    }
+
+                    collapse_remap[c.v0] = c.v1;
+                    collapse_locked[p0] = collapse_locked[p1] = true;
+                    quadrics[p1] += quadrics[p0];
+
+                    triangles_removed += (kind[c.v0] == vertex_kind::manifold || kind[c.v0] == vertex_kind::seam) ? 2 : 1;
+                    result_error = std::max(result_error, c.error);
+                    ++applied;
+                }
+
+                if (applied == 0)
+                    break;
+
+                for (auto & v : current)
+                    v = collapse_remap[v];
+
+                // Apply the collapses and drop the triangles that became degenerate
+                std::size_t write = 0;
+                for (std::size_t i = 0; i + 2 < indices.size(); i += 3)
+                {
+                    Index const a = collapse_remap[indices[i]];
+                    Index const b = collapse_remap[indices[i + 1]];
+                    Index const c = collapse_remap[indices[i + 2]];
+                    if (a == b || b == c || c == a)
+                        continue;
+                    indices[write++] = a;
+                    indices[write++] = b;
+                    indices[write++] = c;
+                }
+                indices.resize(write);
+
+                build_adjacency();
+            }
+
+            return std::sqrt(result_error);
+        }
+    };
+
+}
+
+template <typename Index>
+float simplify_mesh(std::vector<Index> & indices, float const * positions, std::size_t vertex_count, std::size_t stride,
+    std::size_t target_index_count, float target_error)
+{
+    if (indices.size() <= target_index_count)
+        return 0.f;
+
+    simplifier<Index> state(indices, positions, vertex_count, stride);
+    return state.run(target_index_count, target_error);
+}
+
+template <typename Index>
+std::vector<mesh_lod<Index>> build_lod_chain(std::span<Index const> indices, float const * positions, std::size_t vertex_count, std::size_t stride,
+    std::span<float const> ratios, unsigned int thread_count)
+{
+    std::vector<mesh_lod<Index>> result(ratios.size());
+
+    std::size_t const worker_count = parallel_chunk_count(ratios.size(), 1, thread_count);
+
+    auto build = [&](std::size_t level){
+        auto & lod = result[level];
+        lod.ratio = ratios[level];
+        lod.indices.assign(indices.begin(), indices.end());
+
+        std::size_t const target = std::size_t(indices.size() / 3 * double(ratios[level])) * 3;
+        lod.error = simplify_mesh(lod.indices, positions, vertex_count, stride, target);
+    };
+
+    // The most expensive levels are the coarsest ones, so deal levels round-robin
+    run_parallel(worker_count, [&](std::size_t worker){
+        for (std::size_t level = worker; level < ratios.size(); level += worker_count)
+            build(level);
+    });
+
+    return result;
+}
+
+template float simplify_mesh<std::uint8_t>(std::vector<std::uint8_t> &, float const *, std::size_t, std::size_t, std::size_t, float);
+template float simplify_mesh<std::uint16_t>(std::vector<std::uint16_t> &, float const *, std::size_t, std::size_t, std::size_t, float);
+template float simplify_mesh<std::uint32_t>(std::vector<std::uint32_t> &, float const *, std::size_t, std::size_t, std::size_t, float);
+template std::vector<mesh_lod<std::uint8_t>> build_lod_chain<std::uint8_t>(std::span<std::uint8_t const>, float const *, std::size_t, std::size_t, std::span<float const>, unsigned int);
+template std::vector<mesh_lod<std::uint16_t>> build_lod_chain<std::uint16_t>(std::span<std::uint16_t const>, float const *, std::size_t, std::size_t, std::span<float const>, unsigned int);
+template std::vector<mesh_lod<std::uint32_t>> build_lod_chain<std::uint32_t>(std::span<std::uint32_t const>, float const *, std::size_t, std::size_t, std::span<float const>, unsigned int);
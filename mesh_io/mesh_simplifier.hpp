@@ -0,0 +1,40 @@
+#pragma once
+
+#include <span>
+#include <array>
+#include <vector>
+#include <cstdint>
+
+// Edge-collapse simplification driven by quadric error metrics.
+//
+// Vertices are only ever collapsed onto other existing vertices, so the
+// simplified index buffers keep referencing the original vertex buffer and a
+// whole LOD chain can share it. Vertices are classified by their topology:
+// open borders only collapse along the border, attribute seams (several
+// vertices at one position with different normals or texcoords) only collapse
+// along the seam and together with their partner, and anything more complex
+// is locked. Errors are relative to the largest extent of the mesh.
+
+// Simplifies indices in place towards target_index_count, stopping early if the
+// next collapse would exceed target_error; returns the error of the result
+template <typename Index>
+float simplify_mesh(std::vector<Index> & indices, float const * positions, std::size_t vertex_count, std::size_t stride,
+    std::size_t target_index_count, float target_error = 1.f);
+
+template <typename Index>
+struct mesh_lod
+{
+    std::vector<Index> indices;
+    // Requested fraction of the source triangles, and the error actually reached
+    float ratio;
+    float error;
+};
+
+constexpr std::array<float, 3> default_lod_ratios = {0.5f, 0.25f, 0.125f};
+
+// Simplifies the source independently for every ratio; levels are spread across
+// thread_count threads (0 meaning all hardware threads). The result does not
+// depend on the thread count
+template <typename Index>
+std::vector<mesh_lod<Index>> build_lod_chain(std::span<Index const> indices, float const * positions, std::size_t vertex_count, std::size_t stride,
+    std::span<float const> ratios, unsigned int thread_count = 1);
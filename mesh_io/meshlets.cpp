@@ -0,0 +1,248 @@
+#include "meshlets.hpp"
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+namespace
+{
+
+    using vec3 = std::array<float, 3>;
+
+    vec3 sub(vec3 const & a, vec3 const & b)
+    {
+        return {a[0] - b[0], a[1] - b[1], a[2] - b[2]};
+    }
+
+    float dot(vec3 const & a, vec3 const & b)
+    {
+        return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+    }
+
+    vec3 cross(vec3 const & a, vec3 const & b)
+    {
+        return {a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0]};
+    }
+
+    vec3 load_position(float const * positions, std::size_t stride, std::size_t index)
+    {
+        auto p = reinterpret_cast<float const *>(reinterpret_cast<char const *>(positions) + index * stride);
+        return {p[0], p[1], p[2]};
+    }
+
+    constexpr std::uint32_t no_triangle = -1;
+
+    template <typename Index>
+    void compute_bounds(meshlet_table & meshlets, std::span<Index const> indices, float const * positions, std::size_t stride)
+    {
+        constexpr float inf = std::numeric_limits<float>::infinity();
+
+        vec3 min{inf, inf, inf};
+        vec3 max{-inf, -inf, -inf};
+
+        for (auto index : indices)
+        {
+            auto const p = load_position(positions, stride, index);
+            for (int i = 0; i < 3; ++i)
+            {
+                min[i] = std::min(min[i], p[i]);
+                max[i] = std::max(max[i], p[i]);
+            }
+        }
+
+        vec3 const center{(min[0] + max[0]) * 0.5f, (min[1] + max[1]) * 0.5f, (min[2] + max[2]) * 0.5f};
+
+        float radius = 0.f;
+        for (auto index : indices)
+        {
+            auto const d = sub(load_position(positions, stride, index), center);
+            radius = std::max(radius, dot(d, d));
+        }
+        radius = std::sqrt(radius);
+
+        // The cone axis is the average triangle normal, and its spread the largest deviation from it
+        std::vector<vec3> normals;
+        normals.reserve(indices.size() / 3);
+
+        vec3 axis{0.f, 0.f, 0.f};
+        for (std::size_t i = 0; i + 2 < indices.size(); i += 3)
+        {
+            auto const p0 = load_position(positions, stride, indices[i]);
+            auto n = cross(sub(load_position(positions, stride, indices[i + 1]), p0), sub(load_position(positions, stride, indices[i + 2]), p0));
+
+            float const length = std::sqrt(dot(n, n));
+            if (length == 0.f)
+                continue;
+
+            for (int k = 0; k < 3; ++k)
+            {
+                n[k] /= length;
+                axis[k] += n[k];
+            }
+            normals.push_back(n);
+        }
+
+        std::array<float, 4> cone{0.f, 0.f, 0.f, 1.f};
+
+        float const axis_length = std::sqrt(dot(axis, axis));
+        if (axis_length > 0.f)
+        {
+            for (int k = 0; k < 3; ++k)
+                axis[k] /= axis_length;
+
+            float min_dot = 1.f;
+            for (auto const & n : normals)
+                min_dot = std::min(min_dot, dot(n, axis));
+
+            cone = {axis[0], axis[1], axis[2], 1.f};
+            if (min_dot > 0.f)
+                cone[3] = std::sqrt(1.f - min_dot * min_dot);
+        }
+
+        meshlets.sphere.push_back({center[0], center[1], center[2], radius});
+        meshlets.aabb_min.push_back(min);
+        meshlets.aabb_max.push_back(max);
+        meshlets.cone.push_back(cone);
+    }
+
+}
+
+template <typename Index>
+meshlet_table build_meshlets(std::span<Index> indices, float const * positions, std::size_t vertex_count, std::size_t stride)
+{
+    meshlet_table result;
+
+    std::size_t const triangle_count = indices.size() / 3;
+    if (triangle_count == 0)
+        return result;
+
+    // Vertex -> remaining triangles adjacency; emitted triangles are swapped to the
+    // end of each list so that only live ones are scanned
+    std::vector<std::uint32_t> remaining(vertex_count, 0);
+    for (std::size_t i = 0; i < triangle_count * 3; ++i)
+        ++remaining[indices[i]];
+
+    std::vector<std::uint32_t> adjacency_offset(vertex_count + 1, 0);
+    for (std::size_t v = 0; v < vertex_count; ++v)
+        adjacency_offset[v + 1] = adjacency_offset[v] + remaining[v];
+
+    std::vector<std::uint32_t> adjacency(triangle_count * 3);
+    {
+        std::vector<std::uint32_t> fill(adjacency_offset.begin(), adjacency_offset.end() - 1);
+        for (std::size_t t = 0; t < triangle_count; ++t)
+            for (std::size_t k = 0; k < 3; ++k)
+                adjacency[fill[indices[3 * t + k]]++] = t;
+    }
+
+    std::vector<bool> emitted(triangle_count, false);
+
+    // Vertices of the current meshlet are tagged with its number plus one
+    std::vector<std::uint32_t> vertex_tag(vertex_count, 0);
+    std::vector<std::uint32_t> meshlet_vertices;
+    meshlet_vertices.reserve(meshlet_max_vertices);
+
+    std::vector<Index> output;
+    output.reserve(triangle_count * 3);
+
+    std::size_t scan_cursor = 0;
+    std::size_t emitted_count = 0;
+
+    while (emitted_count < triangle_count)
+    {
+        std::uint32_t const tag = result.size() + 1;
+        std::size_t const meshlet_begin = output.size();
+        std::size_t meshlet_triangles = 0;
+        meshlet_vertices.clear();
+
+        auto cost = [&](std::uint32_t t){
+            return (vertex_tag[indices[3 * t]] != tag) + (vertex_tag[indices[3 * t + 1]] != tag) + (vertex_tag[indices[3 * t + 2]] != tag);
+        };
+
+        while (meshlet_triangles < meshlet_max_triangles && emitted_count < triangle_count)
+        {
+            // Cheapest live triangle adjacent to the meshlet; among equally cheap ones prefer
+            // those whose vertices have few triangles left, which closes off vertices and
+            // keeps meshlets compact, then input order
+            std::uint32_t best = no_triangle;
+            int best_cost = 4;
+            std::uint32_t best_valence = -1;
+
+            for (auto v : meshlet_vertices)
+            {
+                for (std::uint32_t i = 0; i < remaining[v]; ++i)
+                {
+                    auto const t = adjacency[adjacency_offset[v] + i];
+                    int const c = cost(t);
+                    if (c > best_cost)
+                        continue;
+
+                    std::uint32_t const valence = remaining[indices[3 * t]] + remaining[indices[3 * t + 1]] + remaining[indices[3 * t + 2]];
+                    if (c < best_cost || valence < best_valence || (valence == best_valence && t < best))
+                    {
+                        best = t;
+                        best_cost = c;
+                        best_valence = valence;
+                    }
+                }
+            }
+
+            // Disconnected from everything left: continue with the next triangle in input order
+            if (best == no_triangle)
+            {
+                while (emitted[scan_cursor])
+                    ++scan_cursor;
+                best = scan_cursor;
+                best_cost = cost(best);
+            }
+
+            if (meshlet_vertices.size() + best_cost > meshlet_max_vertices)
+                break;
+
+            emitted[best] = true;
+            ++emitted_count;
+            ++meshlet_triangles;
+
+            for (std::size_t k = 0; k < 3; ++k)
+            {
+                auto const v = std::uint32_t(indices[3 * best + k]);
+                output.push_back(Index(v));
+
+                if (vertex_tag[v] != tag)
+                {
+                    vertex_tag[v] = tag;
+                    meshlet_vertices.push_back(v);
+                }
+
+                auto begin = adjacency.begin() + adjacency_offset[v];
+                auto end = begin + remaining[v];
+                std::iter_swap(std::find(begin, end, best), end - 1);
+                --remaining[v];
+            }
+        }
+
+        result.index_offset.push_back(meshlet_begin);
+        result.triangle_count.push_back(meshlet_triangles);
+        result.vertex_count.push_back(meshlet_vertices.size());
+        compute_bounds(result, std::span<Index const>(output).subspan(meshlet_begin), positions, stride);
+    }
+
+    std::copy(output.begin(), output.end(), indices.begin());
+
+    return result;
+}
+
+bool meshlet_backfacing(meshlet_table const & meshlets, std::size_t meshlet, std::array<float, 3> const & camera_position)
+{
+    auto const & cone = meshlets.cone[meshlet];
+    if (cone[3] >= 1.f)
+        return false;
+
+    auto const & sphere = meshlets.sphere[meshlet];
+    vec3 const direction = sub({sphere[0], sphere[1], sphere[2]}, camera_position);
+
+    return dot(direction, {cone[0], cone[1], cone[2]}) >= cone[3] * std::sqrt(dot(direction, direction)) + sphere[3];
+}
+
+template meshlet_table build_meshlets<std::uint8_t>(std::span<std::uint8_t>, float const *, std::size_t, std::size_t);
+template meshlet_table build_meshlets<std::uint16_t>(std::span<std::uint16_t>, float const *, std::size_t, std::size_t);
+template meshlet_table build_meshlets<std::uint32_t>(std::span<std::uint32_t>, float const *, std::size_t, std::size_t);
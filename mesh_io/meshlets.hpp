@@ -0,0 +1,52 @@
+#pragma once
+
+#include "mesh_optimizer.hpp"
+
+#include <span>
+#include <array>
+#include <vector>
+#include <cstdint>
+#include <utility>
+
+constexpr std::size_t meshlet_max_vertices = 64;
+constexpr std::size_t meshlet_max_triangles = 124;
+
+// Clusters of at most meshlet_max_vertices vertices and meshlet_max_triangles
+// triangles, stored as one array per field. Each meshlet is a contiguous range of
+// the index buffer it was built from, so visible meshlets can be drawn straight
+// from the original vertex and index buffers
+struct meshlet_table
+{
+    // Range of the meshlet in the reordered index buffer, in indices
+    std::vector<std::uint32_t> index_offset;
+    std::vector<std::uint8_t> triangle_count;
+    std::vector<std::uint8_t> vertex_count;
+
+    // Bounding sphere: center and radius
+    std::vector<std::array<float, 4>> sphere;
+    std::vector<std::array<float, 3>> aabb_min;
+    std::vector<std::array<float, 3>> aabb_max;
+
+    // Normal cone: axis and the sine of its half-angle; the last component is 1
+    // for meshlets whose triangles face too many directions to ever be rejected
+    std::vector<std::array<float, 4>> cone;
+
+    std::size_t size() const { return index_offset.size(); }
+};
+
+// Greedily grows meshlets over triangle adjacency, preferring triangles that add the
+// fewest new vertices, and reorders indices so that every meshlet is contiguous.
+// Works best on a vertex cache optimized index buffer; the set of triangles and their
+// winding are preserved. positions and stride are as in analyze_overdraw
+template <typename Index>
+meshlet_table build_meshlets(std::span<Index> indices, float const * positions, std::size_t vertex_count, std::size_t stride);
+
+// True if every triangle of the meshlet faces away from the camera, given in the mesh's
+// coordinate system: the view direction to the bounding sphere stays outside the normal cone
+bool meshlet_backfacing(meshlet_table const & meshlets, std::size_t meshlet, std::array<float, 3> const & camera_position);
+
+template <typename Mesh>
+meshlet_table build_meshlets(Mesh & mesh)
+{
+    return build_meshlets(std::span(mesh.indices), mesh_positions(mesh), mesh.vertices.size(), sizeof(mesh.vertices[0]));
+}
@@ -0,0 +1,398 @@
+#include "normal_generation.hpp"
+#include "vertex_dedup_table.hpp"
+#include "parallel.hpp"
+
+#include <cmath>
+#include <cstring>
+#include <numbers>
+#include <algorithm>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+
+    using vec3 = std::array<float, 3>;
+
+    // Face normals and corner weights; the SSE and scalar versions perform the same
+    // operations in the same order, so it does not matter which one handled a triangle
+    struct face_data
+    {
+        // Unit face normals, one array per component
+        std::vector<float> nx, ny, nz;
+        // Weight of the face normal at each corner, three per triangle
+        std::vector<float> weight;
+    };
+
+    // acos with an absolute error below 7e-5 radians (Abramowitz and Stegun 4.4.45)
+    float approximate_acos(float x)
+    {
+        float const t = std::min(std::abs(x), 1.f);
+        float p = 0.0742610f + t * -0.0187293f;
+        p = -0.2121144f + t * p;
+        p = 1.5707288f + t * p;
+        float const r = std::sqrt(1.f - t) * p;
+        return (x < 0.f) ? std::numbers::pi_v<float> - r : r;
+    }
+
+    float corner_angle(float dot, float length_product)
+    {
+        float const denominator = std::sqrt(length_product);
+        return (denominator > 0.f) ? approximate_acos(dot / denominator) : 0.f;
+    }
+
+    void compute_face(face_data & faces, std::size_t t, obj_data const & data, normal_weighting weighting)
+    {
+        auto const & p0 = data.vertices[data.indices[3 * t + 0]].position;
+        auto const & p1 = data.vertices[data.indices[3 * t + 1]].position;
+        auto const & p2 = data.vertices[data.indices[3 * t + 2]].position;
+
+        float const e01[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+        float const e02[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+        float const e12[3] = {p2[0] - p1[0], p2[1] - p1[1], p2[2] - p1[2]};
+
+        float const cx = e01[1] * e02[2] - e01[2] * e02[1];
+        float const cy = e01[2] * e02[0] - e01[0] * e02[2];
+        float const cz = e01[0] * e02[1] - e01[1] * e02[0];
+
+        float const length = std::sqrt(cx * cx + cy * cy + cz * cz);
+        float const inverse = (length > 0.f) ? 1.f / length : 0.f;
+
+        faces.nx[t] = cx * inverse;
+        faces.ny[t] = cy * inverse;
+        faces.nz[t] = cz * inverse;
+
+        auto weight = faces.weight.data() + 3 * t;
+
+        if (weighting == normal_weighting::area || length == 0.f)
+        {
+            weight[0] = weight[1] = weight[2] = length;
+            return;
+        }
+
+        auto dot = [](float const * a, float const * b){ return a[0] * b[0] + a[1] * b[1] + a[2] * b[2]; };
+
+        float const l01 = dot(e01, e01);
+        float const l02 = dot(e02, e02);
+        float const l12 = dot(e12, e12);
+
+        weight[0] = corner_angle(dot(e01, e02), l01 * l02);
+        weight[1] = corner_angle(-dot(e01, e12), l01 * l12);
+        weight[2] = corner_angle(dot(e02, e12), l02 * l12);
+    }
+
+#if defined(__SSE2__)
+
+    __m128 approximate_acos(__m128 x)
+    {
+        __m128 const t = _mm_min_ps(_mm_andnot_ps(_mm_set1_ps(-0.f), x), _mm_set1_ps(1.f));
+        __m128 p = _mm_add_ps(_mm_set1_ps(0.0742610f), _mm_mul_ps(t, _mm_set1_ps(-0.0187293f)));
+        p = _mm_add_ps(_mm_set1_ps(-0.2121144f), _mm_mul_ps(t, p));
+        p = _mm_add_ps(_mm_set1_ps(1.5707288f), _mm_mul_ps(t, p));
+        __m128 const r = _mm_mul_ps(_mm_sqrt_ps(_mm_sub_ps(_mm_set1_ps(1.f), t)), p);
+
+        __m128 const negative = _mm_cmplt_ps(x, _mm_setzero_ps());
+        __m128 const flipped = _mm_sub_ps(_mm_set1_ps(std::numbers::pi_v<float>), r);
+        return _mm_or_ps(_mm_and_ps(negative, flipped), _mm_andnot_ps(negative, r));
+    }
+
+    __m128 corner_angle(__m128 dot, __m128 length_product)
+    {
+        __m128 const denominator = _mm_sqrt_ps(length_product);
+        __m128 const valid = _mm_cmpgt_ps(denominator, _mm_setzero_ps());
+        // Invalid lanes divide by one instead of zero and are masked out
+        __m128 const angle = approximate_acos(_mm_div_ps(dot, _mm_or_ps(_mm_and_ps(valid, denominator), _mm_andnot_ps(valid, _mm_set1_ps(1.f)))));
+        return _mm_and_ps(valid, angle);
+    }
+
+    struct vec3x4
+    {
+        __m128 x, y, z;
+    };
+
+    vec3x4 operator - (vec3x4 const & a, vec3x4 const & b)
+    {
+        return {_mm_sub_ps(a.x, b.x), _mm_sub_ps(a.y, b.y), _mm_sub_ps(a.z, b.z)};
+    }
+
+    __m128 dot(vec3x4 const & a, vec3x4 const & b)
+    {
+        return _mm_add_ps(_mm_add_ps(_mm_mul_ps(a.x, b.x), _mm_mul_ps(a.y, b.y)), _mm_mul_ps(a.z, b.z));
+    }
+
+    // Four triangles starting at t, with their corner positions transposed into lanes
+    void compute_faces4(face_data & faces, std::size_t t, obj_data const & data, normal_weighting weighting)
+    {
+        vec3x4 p[3];
+        for (int k = 0; k < 3; ++k)
+        {
+            auto const & a = data.vertices[data.indices[3 * t + k]].position;
+            auto const & b = data.vertices[data.indices[3 * t + 3 + k]].position;
+            auto const & c = data.vertices[data.indices[3 * t + 6 + k]].position;
+            auto const & d = data.vertices[data.indices[3 * t + 9 + k]].position;
+            p[k] = {_mm_setr_ps(a[0], b[0], c[0], d[0]), _mm_setr_ps(a[1], b[1], c[1], d[1]), _mm_setr_ps(a[2], b[2], c[2], d[2])};
+        }
+
+        vec3x4 const e01 = p[1] - p[0];
+        vec3x4 const e02 = p[2] - p[0];
+        vec3x4 const e12 = p[2] - p[1];
+
+        __m128 const cx = _mm_sub_ps(_mm_mul_ps(e01.y, e02.z), _mm_mul_ps(e01.z, e02.y));
+        __m128 const cy = _mm_sub_ps(_mm_mul_ps(e01.z, e02.x), _mm_mul_ps(e01.x, e02.z));
+        __m128 const cz = _mm_sub_ps(_mm_mul_ps(e01.x, e02.y), _mm_mul_ps(e01.y, e02.x));
+
+        __m128 const length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, cx), _mm_mul_ps(cy, cy)), _mm_mul_ps(cz, cz)));
+        __m128 const nonzero = _mm_cmpgt_ps(length, _mm_setzero_ps());
+        __m128 const inverse = _mm_and_ps(nonzero, _mm_div_ps(_mm_set1_ps(1.f), _mm_or_ps(_mm_and_ps(nonzero, length), _mm_andnot_ps(nonzero, _mm_set1_ps(1.f)))));
+
+        _mm_storeu_ps(faces.nx.data() + t, _mm_mul_ps(cx, inverse));
+        _mm_storeu_ps(faces.ny.data() + t, _mm_mul_ps(cy, inverse));
+        _mm_storeu_ps(faces.nz.data() + t, _mm_mul_ps(cz, inverse));
+
+        alignas(16) float w[3][4];
+
+        if (weighting == normal_weighting::area)
+        {
+            _mm_store_ps(w[0], length);
+            _mm_store_ps(w[1], length);
+            _mm_store_ps(w[2], length);
+        }
+        else
+        {
+            __m128 const l01 = dot(e01, e01);
+            __m128 const l02 = dot(e02, e02);
+            __m128 const l12 = dot(e12, e12);
+
+            // Degenerate triangles get their (zero) length as weight, as in the scalar version
+            auto select = [&](__m128 angle){ return _mm_or_ps(_mm_and_ps(nonzero, angle), _mm_andnot_ps(nonzero, length)); };
+
+            _mm_store_ps(w[0], select(corner_angle(dot(e01, e02), _mm_mul_ps(l01, l02))));
+            _mm_store_ps(w[1], select(corner_angle(_mm_xor_ps(dot(e01, e12), _mm_set1_ps(-0.f)), _mm_mul_ps(l01, l12))));
+            _mm_store_ps(w[2], select(corner_angle(dot(e02, e12), _mm_mul_ps(l02, l12))));
+        }
+
+        auto weight = faces.weight.data() + 3 * t;
+        for (int i = 0; i < 4; ++i)
+            for (int k = 0; k < 3; ++k)
+                weight[3 * i + k] = w[k][i];
+    }
+
+#endif
+
+    // Equal positions must share a group also when one of them is -0
+    vertex_dedup_table::key position_key(vec3 const & position)
+    {
+        vertex_dedup_table::key key;
+        for (int i = 0; i < 3; ++i)
+        {
+            float const value = position[i] + 0.f;
+            std::memcpy(&key[i], &value, sizeof(value));
+        }
+        return key;
+    }
+
+    struct new_vertex
+    {
+        std::uint32_t source;
+        vec3 normal;
+    };
+
+}
+
+normal_generation_stats generate_normals(obj_data & data, normal_generation_options const & options)
+{
+    normal_generation_stats stats;
+
+    std::size_t const vertex_count = data.vertices.size();
+    std::size_t const triangle_count = data.indices.size() / 3;
+
+    std::vector<std::uint8_t> missing(vertex_count);
+    for (std::size_t v = 0; v < vertex_count; ++v)
+    {
+        auto const & n = data.vertices[v].normal;
+        missing[v] = (n[0] == 0.f && n[1] == 0.f && n[2] == 0.f);
+        stats.generated += missing[v];
+    }
+
+    if (stats.generated == 0 || triangle_count == 0)
+        return stats;
+
+    std::size_t const chunk_count = parallel_chunk_count(triangle_count, min_triangles_per_thread, options.thread_count);
+
+    face_data faces;
+    faces.nx.resize(triangle_count);
+    faces.ny.resize(triangle_count);
+    faces.nz.resize(triangle_count);
+    faces.weight.resize(3 * triangle_count);
+
+    run_parallel(chunk_count, [&](std::size_t chunk){
+        // Chunks start at multiples of four, so the scalar tail is always the same triangles
+        std::size_t t = triangle_count * chunk / chunk_count / 4 * 4;
+        std::size_t const end = (chunk + 1 == chunk_count) ? triangle_count : triangle_count * (chunk + 1) / chunk_count / 4 * 4;
+
+#if defined(__SSE2__)
+        for (; t + 4 <= end; t += 4)
+            compute_faces4(faces, t, data, options.weighting);
+#endif
+        for (; t < end; ++t)
+            compute_face(faces, t, data, options.weighting);
+    });
+
+    // Group the corners of vertices without normals by position, in corner order
+    std::vector<std::uint32_t> vertex_group(vertex_count);
+    std::size_t group_count = 0;
+    {
+        vertex_dedup_table groups(stats.generated);
+        for (std::size_t v = 0; v < vertex_count; ++v)
+        {
+            if (!missing[v])
+                continue;
+            auto const [group, inserted] = groups.insert(position_key(data.vertices[v].position), group_count);
+            group_count += inserted;
+            vertex_group[v] = group;
+        }
+    }
+
+    std::vector<std::uint32_t> group_offset(group_count + 1, 0);
+    for (std::size_t c = 0; c < 3 * triangle_count; ++c)
+        if (auto const v = data.indices[c]; missing[v])
+            ++group_offset[vertex_group[v] + 1];
+    for (std::size_t g = 0; g < group_count; ++g)
+        group_offset[g + 1] += group_offset[g];
+
+    std::vector<std::uint32_t> corners(group_offset.back());
+    {
+        std::vector<std::uint32_t> fill(group_offset.begin(), group_offset.end() - 1);
+        for (std::size_t c = 0; c < 3 * triangle_count; ++c)
+            if (auto const v = data.indices[c]; missing[v])
+                corners[fill[vertex_group[v]]++] = c;
+    }
+
+    float const crease_cosine = std::cos(options.crease_angle * std::numbers::pi_v<float> / 180.f);
+    bool const smooth_all = options.crease_angle >= 180.f;
+
+    // Groups are dealt to threads in contiguous ranges of about equal corner counts. Each
+    // vertex belongs to exactly one group, so threads never touch the same vertex; split
+    // vertices are numbered per range and offset afterwards, in range order
+    std::vector<std::size_t> range_begin(chunk_count + 1);
+    for (std::size_t i = 0; i <= chunk_count; ++i)
+    {
+        auto const target = corners.size() * i / chunk_count;
+        range_begin[i] = std::lower_bound(group_offset.begin(), group_offset.end(), target) - group_offset.begin();
+    }
+    range_begin[chunk_count] = group_count;
+
+    std::vector<std::uint8_t> assigned(vertex_count, 0);
+    // Per corner slot: 0 to keep the vertex, otherwise one plus the range's new vertex number
+    std::vector<std::uint32_t> variant(corners.size(), 0);
+    std::vector<std::vector<new_vertex>> range_new_vertices(chunk_count);
+
+    run_parallel(chunk_count, [&](std::size_t range){
+        auto & new_vertices = range_new_vertices[range];
+        std::vector<std::uint32_t> group_new_vertices;
+
+        for (std::size_t g = range_begin[range]; g < range_begin[range + 1]; ++g)
+        {
+            auto const begin = group_offset[g];
+            auto const end = group_offset[g + 1];
+
+            vec3 group_sum{0.f, 0.f, 0.f};
+            for (auto s = begin; s < end; ++s)
+            {
+                auto const c = corners[s];
+                auto const t = c / 3;
+                group_sum[0] += faces.weight[c] * faces.nx[t];
+                group_sum[1] += faces.weight[c] * faces.ny[t];
+                group_sum[2] += faces.weight[c] * faces.nz[t];
+            }
+
+            group_new_vertices.clear();
+
+            for (auto s = begin; s < end; ++s)
+            {
+                auto const c = corners[s];
+                auto const t = c / 3;
+                vec3 const face_normal{faces.nx[t], faces.ny[t], faces.nz[t]};
+
+                vec3 sum = group_sum;
+                bool const degenerate = (face_normal[0] == 0.f && face_normal[1] == 0.f && face_normal[2] == 0.f);
+                if (!smooth_all && !degenerate)
+                {
+                    sum = {0.f, 0.f, 0.f};
+                    for (auto s2 = begin; s2 < end; ++s2)
+                    {
+                        auto const c2 = corners[s2];
+                        auto const t2 = c2 / 3;
+                        if (face_normal[0] * faces.nx[t2] + face_normal[1] * faces.ny[t2] + face_normal[2] * faces.nz[t2] < crease_cosine)
+                            continue;
+                        sum[0] += faces.weight[c2] * faces.nx[t2];
+                        sum[1] += faces.weight[c2] * faces.ny[t2];
+                        sum[2] += faces.weight[c2] * faces.nz[t2];
+                    }
+                }
+
+                float const length = std::sqrt(sum[0] * sum[0] + sum[1] * sum[1] + sum[2] * sum[2]);
+                vec3 normal{0.f, 0.f, 0.f};
+                if (length > 0.f)
+                    normal = {sum[0] / length, sum[1] / length, sum[2] / length};
+
+                auto const v = data.indices[c];
+                auto & vertex = data.vertices[v];
+
+                if (!assigned[v])
+                {
+                    assigned[v] = 1;
+                    vertex.normal = normal;
+                    continue;
+                }
+
+                if (vertex.normal == normal)
+                    continue;
+
+                // Another corner of this vertex already got a different normal
+                auto existing = std::find_if(group_new_vertices.begin(), group_new_vertices.end(), [&](std::uint32_t i){
+                    return new_vertices[i].source == v && new_vertices[i].normal == normal;
+                });
+
+                if (existing != group_new_vertices.end())
+                    variant[s] = *existing + 1;
+                else
+                {
+                    group_new_vertices.push_back(new_vertices.size());
+                    new_vertices.push_back({v, normal});
+                    variant[s] = new_vertices.size();
+                }
+            }
+        }
+    });
+
+    std::vector<std::size_t> range_first_vertex(chunk_count);
+    std::size_t split_count = vertex_count;
+    for (std::size_t range = 0; range < chunk_count; ++range)
+    {
+        range_first_vertex[range] = split_count;
+        split_count += range_new_vertices[range].size();
+    }
+
+    stats.split = split_count - vertex_count;
+    data.vertices.resize(split_count);
+
+    run_parallel(chunk_count, [&](std::size_t range){
+        auto const first = range_first_vertex[range];
+        auto const & new_vertices = range_new_vertices[range];
+
+        for (std::size_t i = 0; i < new_vertices.size(); ++i)
+        {
+            data.vertices[first + i] = data.vertices[new_vertices[i].source];
+            data.vertices[first + i].normal = new_vertices[i].normal;
+        }
+
+        for (auto s = group_offset[range_begin[range]]; s < group_offset[range_begin[range + 1]]; ++s)
+            if (variant[s] != 0)
+                data.indices[corners[s]] = first + variant[s] - 1;
+    });
+
+    return stats;
+}
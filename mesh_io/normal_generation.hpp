@@ -0,0 +1,37 @@
+#pragma once
+
+#include "obj_parser.hpp"
+
+#include <cstddef>
+
+enum class normal_weighting
+{
+    // Face normals weighted by triangle area: large faces dominate
+    area,
+    // Face normals weighted by the corner angle: independent of how faces are tessellated
+    angle,
+};
+
+struct normal_generation_options
+{
+    normal_weighting weighting = normal_weighting::angle;
+    // Faces meeting at a sharper angle than this, in degrees, do not smooth each other;
+    // 180 smooths everything sharing a position
+    float crease_angle = 60.f;
+    // 0 means all hardware threads
+    unsigned int thread_count = 1;
+};
+
+struct normal_generation_stats
+{
+    // Vertices that had no normal, and vertices added to split them along creases
+    std::size_t generated = 0;
+    std::size_t split = 0;
+};
+
+// Fills in the normals of vertices that have none, which parse_obj leaves as zero for faces
+// without vn references. Each corner gets the weighted sum of the normals of the faces around
+// its position that are within the crease angle of its own face, so texture seams do not show
+// in the shading. Vertices whose corners end up with different normals are split; indices are
+// updated and the new vertices appended. The result does not depend on the thread count
+normal_generation_stats generate_normals(obj_data & data, normal_generation_options const & options = {});
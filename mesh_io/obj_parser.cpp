@@ -0,0 +1,1294 @@
+#include "obj_parser.hpp"
+#include "mapped_file.hpp"
+#include "vertex_dedup_table.hpp"
+#include "parallel.hpp"
+
+#include <string>
+#include <sstream>
+#include <stdexcept>
+#include <charconv>
+#include <cstring>
+#include <algorithm>
+#include <thread>
+#include <map>
+#include <optional>
+
+namespace
+{
+
+    template <typename ... Args>
+    std::string to_string(Args const & ... args)
+    {
+        std::ostringstream os;
+        (os << ... << args);
+        return os.str();
+    }
+
+    using obj_index = std::array<std::int32_t, 3>;
+
+    // Marks an attribute that a face vertex does not reference; resolved indices of the
+    // attributes it does reference are never negative
+    constexpr std::int32_t missing_index = -1;
+
+    // Converts a 1-based or negative (relative) OBJ index into a 0-based one, checking the
+    // raw value against the count of attributes defined so far
+    template <typename Fail>
+    std::int32_t resolve_attribute_index(std::int32_t index, std::size_t count, char const * name, Fail const & fail)
+    {
+        std::uint64_t const magnitude = (index < 0) ? std::uint64_t(-std::int64_t(index)) : std::uint64_t(index);
+        if (index == 0 || magnitude > count)
+            fail("bad ", name, " index (", index, ")");
+
+        return (index > 0) ? index - 1 : std::int32_t(count - magnitude);
+    }
+
+    template <typename Fail>
+    obj_index resolve_index(obj_index index, bool has_texcoord, bool has_normal,
+        std::size_t position_count, std::size_t texcoord_count, std::size_t normal_count, Fail const & fail)
+    {
+        index[0] = resolve_attribute_index(index[0], position_count, "position", fail);
+        index[1] = has_texcoord ? resolve_attribute_index(index[1], texcoord_count, "texcoord", fail) : missing_index;
+        index[2] = has_normal ? resolve_attribute_index(index[2], normal_count, "normal", fail) : missing_index;
+        return index;
+    }
+
+    obj_data::vertex make_vertex(obj_index const & index,
+        std::vector<std::array<float, 3>> const & positions,
+        std::vector<std::array<float, 2>> const & texcoords,
+        std::vector<std::array<float, 3>> const & normals)
+    {
+        obj_data::vertex v;
+
+        v.position = positions[index[0]];
+
+        if (index[1] != missing_index)
+            v.texcoord = texcoords[index[1]];
+        else
+            v.texcoord = {0.f, 0.f};
+
+        if (index[2] != missing_index)
+            v.normal = normals[index[2]];
+        else
+            v.normal = {0.f, 0.f, 0.f};
+
+        return v;
+    }
+
+    void triangulate_face(std::vector<std::uint32_t> const & face, std::vector<std::uint32_t> & indices)
+    {
+        for (std::size_t i = 1; i + 1 < face.size(); ++i)
+        {
+            indices.push_back(face[0]);
+            indices.push_back(face[i]);
+            indices.push_back(face[i + 1]);
+        }
+    }
+
+    // A usemtl, o or g record, applying to the faces from index_offset on
+    struct obj_state_change
+    {
+        std::size_t index_offset;
+        bool material;
+        std::string name;
+    };
+
+    // mtllib takes a list of file names
+    void add_material_libraries(std::string_view names, std::vector<std::string> & libraries)
+    {
+        std::size_t begin = 0;
+        while (true)
+        {
+            begin = names.find_first_not_of(" \t", begin);
+            if (begin == std::string_view::npos)
+                break;
+            std::size_t const end = std::min(names.find_first_of(" \t", begin), names.size());
+            libraries.emplace_back(names.substr(begin, end - begin));
+            begin = end;
+        }
+    }
+
+    // Buffers of build_submeshes, kept in the parse context
+    struct submesh_scratch
+    {
+        struct run
+        {
+            std::size_t begin;
+            std::size_t end;
+            std::uint32_t submesh;
+        };
+
+        std::vector<run> runs;
+        std::vector<std::uint32_t> order;
+        std::vector<std::uint32_t> slot;
+        std::vector<std::uint32_t> position;
+        std::vector<std::uint32_t> indices;
+    };
+
+    void compute_bounds(obj_data & data)
+    {
+        for (auto & submesh : data.submeshes)
+        {
+            if (submesh.index_count == 0)
+                continue;
+
+            submesh.min = submesh.max = data.vertices[data.indices[submesh.index_offset]].position;
+            for (std::size_t i = submesh.index_offset; i < submesh.index_offset + submesh.index_count; ++i)
+            {
+                auto const & p = data.vertices[data.indices[i]].position;
+                for (int k = 0; k < 3; ++k)
+                {
+                    submesh.min[k] = std::min(submesh.min[k], p[k]);
+                    submesh.max[k] = std::max(submesh.max[k], p[k]);
+                }
+            }
+        }
+    }
+
+    // Splits the file-ordered indices into runs of equal material and name, merges runs
+    // with the same key into submeshes and lays those out sorted by material
+    void build_submeshes(obj_data & data, std::vector<obj_state_change> const & changes, submesh_scratch & scratch)
+    {
+        data.materials.clear();
+
+        // Without any usemtl, o or g record everything is one unnamed submesh
+        if (changes.empty())
+        {
+            data.submeshes.clear();
+            if (!data.indices.empty())
+            {
+                data.submeshes.emplace_back().index_count = data.indices.size();
+                compute_bounds(data);
+            }
+            return;
+        }
+
+        // Materials in order of first use by faces; faces without one use an empty key
+        std::map<std::optional<std::string>, std::uint32_t> material_rank;
+        std::vector<std::optional<std::string>> materials;
+        std::map<std::pair<std::uint32_t, std::string>, std::uint32_t> submesh_ids;
+        std::vector<std::pair<std::uint32_t, std::string>> submesh_keys;
+
+        auto & runs = scratch.runs;
+        runs.clear();
+
+        std::optional<std::string> material;
+        std::string name;
+
+        auto add_run = [&](std::size_t begin, std::size_t end){
+            if (begin == end)
+                return;
+
+            auto [rank, new_material] = material_rank.try_emplace(material, materials.size());
+            if (new_material)
+                materials.push_back(material);
+
+            std::pair<std::uint32_t, std::string> key{rank->second, name};
+            auto [id, new_submesh] = submesh_ids.try_emplace(key, submesh_keys.size());
+            if (new_submesh)
+                submesh_keys.push_back(std::move(key));
+
+            runs.push_back({begin, end, id->second});
+        };
+
+        std::size_t begin = 0;
+        for (auto const & change : changes)
+        {
+            add_run(begin, change.index_offset);
+            begin = change.index_offset;
+
+            if (change.material)
+                material = change.name;
+            else
+                name = change.name;
+        }
+        add_run(begin, data.indices.size());
+
+        // Submeshes are numbered in order of first use, so a stable sort by material
+        // keeps that order within a material
+        auto & order = scratch.order;
+        order.resize(submesh_keys.size());
+        for (std::uint32_t i = 0; i < order.size(); ++i)
+            order[i] = i;
+        std::stable_sort(order.begin(), order.end(), [&](std::uint32_t a, std::uint32_t b){
+            return submesh_keys[a].first < submesh_keys[b].first;
+        });
+
+        // Output position of every submesh id
+        auto & slot = scratch.slot;
+        slot.resize(order.size());
+        for (std::uint32_t i = 0; i < order.size(); ++i)
+            slot[order[i]] = i;
+
+        // Named materials, in rank order, which is also the submesh order
+        std::vector<std::uint32_t> material_index(materials.size(), obj_no_material);
+        for (std::uint32_t rank = 0; rank < materials.size(); ++rank)
+        {
+            if (!materials[rank])
+                continue;
+            material_index[rank] = data.materials.size();
+            obj_material material;
+            material.name = *materials[rank];
+            data.materials.push_back(std::move(material));
+        }
+
+        data.submeshes.resize(submesh_keys.size());
+        for (auto & submesh : data.submeshes)
+            submesh = {};
+        for (auto const & run : runs)
+            data.submeshes[slot[run.submesh]].index_count += run.end - run.begin;
+
+        auto & position = scratch.position;
+        position.resize(order.size());
+
+        std::uint32_t offset = 0;
+        for (std::uint32_t i = 0; i < order.size(); ++i)
+        {
+            auto & submesh = data.submeshes[i];
+            submesh.name = std::move(submesh_keys[order[i]].second);
+            submesh.material = material_index[submesh_keys[order[i]].first];
+            submesh.index_offset = offset;
+            position[i] = offset;
+            offset += submesh.index_count;
+        }
+
+        // A single submesh needs no reordering
+        if (order.size() > 1)
+        {
+            auto & indices = scratch.indices;
+            indices.resize(data.indices.size());
+            for (auto const & run : runs)
+            {
+                auto & target = position[slot[run.submesh]];
+                std::copy(data.indices.begin() + run.begin, data.indices.begin() + run.end, indices.begin() + target);
+                target += run.end - run.begin;
+            }
+            std::copy(indices.begin(), indices.end(), data.indices.begin());
+        }
+
+        compute_bounds(data);
+    }
+
+    // Raw attribute arrays, vertex deduplication and the output of a serial parse,
+    // all owned by the caller
+    struct obj_builder
+    {
+        std::vector<std::array<float, 3>> & positions;
+        std::vector<std::array<float, 3>> & normals;
+        std::vector<std::array<float, 2>> & texcoords;
+
+        vertex_dedup_table & index_table;
+
+        std::vector<std::uint32_t> & face;
+
+        obj_data & result;
+        std::vector<obj_state_change> & changes;
+
+        std::array<float, 3> & add_position() { return positions.emplace_back(); }
+        std::array<float, 3> & add_normal() { return normals.emplace_back(); }
+        std::array<float, 2> & add_texcoord() { return texcoords.emplace_back(); }
+
+        void use_material(std::string_view name) { changes.push_back({result.indices.size(), true, std::string(name)}); }
+        void set_name(std::string_view name) { changes.push_back({result.indices.size(), false, std::string(name)}); }
+        void add_libraries(std::string_view names) { add_material_libraries(names, result.material_libraries); }
+
+        template <typename Fail>
+        void add_face_vertex(obj_index index, bool has_texcoord, bool has_normal, Fail const & fail)
+        {
+            index = resolve_index(index, has_texcoord, has_normal, positions.size(), texcoords.size(), normals.size(), fail);
+
+            auto [vertex_index, inserted] = index_table.insert(index, result.vertices.size());
+            if (inserted)
+                result.vertices.push_back(make_vertex(index, positions, texcoords, normals));
+
+            face.push_back(vertex_index);
+        }
+
+        void end_face()
+        {
+            triangulate_face(face, result.indices);
+            face.clear();
+        }
+    };
+
+    // Same set as std::isspace in the "C" locale, minus the line terminator
+    bool is_blank(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+    }
+
+    struct obj_record_counts
+    {
+        std::size_t positions = 0;
+        std::size_t normals = 0;
+        std::size_t texcoords = 0;
+        std::size_t faces = 0;
+        std::size_t lines = 0;
+    };
+
+    // Cheap first pass that only reads the record tags; it recognizes records
+    // exactly like tokenize_obj, so the counts can be used as chunk offsets
+    obj_record_counts count_records(std::string_view source)
+    {
+        obj_record_counts counts;
+
+        char const * current = source.data();
+        char const * const end = current + source.size();
+
+        while (true)
+        {
+            while (current != end && (is_blank(*current) || *current == '\n'))
+                ++current;
+
+            if (current == end)
+                break;
+
+            ++counts.lines;
+
+            char const * tag_begin = current;
+            while (current != end && *current != '\n' && !is_blank(*current))
+                ++current;
+            std::string_view tag(tag_begin, current - tag_begin);
+
+            if (tag == "v")
+                ++counts.positions;
+            else if (tag == "vn")
+                ++counts.normals;
+            else if (tag == "vt")
+                ++counts.texcoords;
+            else if (tag == "f")
+                ++counts.faces;
+
+            auto line_end = static_cast<char const *>(std::memchr(current, '\n', end - current));
+            current = line_end ? line_end : end;
+        }
+
+        return counts;
+    }
+
+    // Walks OBJ text and reports records to the handler; first_line is the number
+    // of non-empty lines preceding the source, used in error messages
+    template <typename Handler>
+    void tokenize_obj(std::string_view source, std::size_t first_line, Handler & handler)
+    {
+        char const * current = source.data();
+        char const * const end = current + source.size();
+
+        std::size_t line_count = first_line;
+
+        auto fail = [&](auto const & ... args){
+            throw std::runtime_error(to_string("Error parsing OBJ data, line ", line_count, ": ", args...));
+        };
+
+        auto at_token_end = [&]{
+            return current == end || *current == '\n' || is_blank(*current);
+        };
+
+        auto skip_blanks = [&]{
+            while (current != end && is_blank(*current))
+                ++current;
+        };
+
+        // Like operator >>, skips leading blanks and accepts an explicit '+' sign
+        auto parse_number = [&](auto & value){
+            skip_blanks();
+            if (current != end && *current == '+' && current + 1 != end && *(current + 1) != '-')
+                ++current;
+            auto [ptr, ec] = std::from_chars(current, end, value);
+            if (ec != std::errc{})
+                return false;
+            current = ptr;
+            return true;
+        };
+
+        while (true)
+        {
+            while (current != end && (is_blank(*current) || *current == '\n'))
+                ++current;
+
+            if (current == end)
+                break;
+
+            ++line_count;
+
+            char const * tag_begin = current;
+            while (!at_token_end())
+                ++current;
+            std::string_view tag(tag_begin, current - tag_begin);
+
+            if (tag == "v")
+            {
+                auto & p = handler.add_position();
+                p = {0.f, 0.f, 0.f};
+                parse_number(p[0]) && parse_number(p[1]) && parse_number(p[2]);
+            }
+            else if (tag == "vn")
+            {
+                auto & n = handler.add_normal();
+                n = {0.f, 0.f, 0.f};
+                parse_number(n[0]) && parse_number(n[1]) && parse_number(n[2]);
+            }
+            else if (tag == "vt")
+            {
+                auto & t = handler.add_texcoord();
+                t = {0.f, 0.f};
+                parse_number(t[0]) && parse_number(t[1]);
+            }
+            else if (tag == "f")
+            {
+                while (true)
+                {
+                    obj_index index{0, 0, 0};
+                    bool has_texcoord = false;
+                    bool has_normal = false;
+
+                    skip_blanks();
+                    if (current == end || *current == '\n')
+                        break;
+
+                    if (!parse_number(index[0]))
+                        fail("expected position index");
+
+                    if (!at_token_end())
+                    {
+                        if (*current++ != '/')
+                            fail("expected '/'");
+
+                        if (current == end || *current != '/')
+                        {
+                            if (!parse_number(index[1]))
+                                fail("expected texcoord index");
+                            has_texcoord = true;
+
+                            if (!at_token_end())
+                            {
+                                if (*current++ != '/')
+                                    fail("expected '/'");
+
+                                if (!parse_number(index[2]))
+                                    fail("expected normal index");
+                                has_normal = true;
+                            }
+                        }
+                        else
+                        {
+                            ++current;
+
+                            if (!parse_number(index[2]))
+                                fail("expected normal index");
+                            has_normal = true;
+                        }
+                    }
+
+                    handler.add_face_vertex(index, has_texcoord, has_normal, fail);
+                }
+
+                handler.end_face();
+            }
+            else if (tag == "usemtl" || tag == "o" || tag == "g" || tag == "mtllib")
+            {
+                // The rest of the line, without surrounding blanks
+                skip_blanks();
+                char const * value_begin = current;
+                while (current != end && *current != '\n')
+                    ++current;
+                char const * value_end = current;
+                while (value_end != value_begin && is_blank(*(value_end - 1)))
+                    --value_end;
+                std::string_view value(value_begin, value_end - value_begin);
+
+                if (tag == "usemtl")
+                    handler.use_material(value);
+                else if (tag == "mtllib")
+                    handler.add_libraries(value);
+                else
+                    handler.set_name(value);
+            }
+
+            while (current != end && *current != '\n')
+                ++current;
+        }
+    }
+
+    // Parses one chunk of a parallel load. Attributes are written straight into the
+    // shared arrays at offsets known from count_records; face corners are resolved
+    // against the global attribute counts and deduplicated locally, in order of
+    // first appearance
+    struct obj_chunk_parser
+    {
+        std::string_view source;
+
+        obj_record_counts counts;
+        obj_record_counts base;
+
+        std::vector<std::array<float, 3>> * positions;
+        std::vector<std::array<float, 3>> * normals;
+        std::vector<std::array<float, 2>> * texcoords;
+
+        std::size_t position_count = 0;
+        std::size_t normal_count = 0;
+        std::size_t texcoord_count = 0;
+
+        vertex_dedup_table index_table;
+        std::vector<obj_index> unique_vertices;
+        std::vector<std::uint32_t> face;
+        std::vector<std::uint32_t> indices;
+
+        // Index offsets relative to the chunk
+        std::vector<obj_state_change> changes;
+        std::vector<std::string> material_libraries;
+
+        // Filled by the merge: global vertex index of each unique vertex of the chunk,
+        // and the first global vertex and index introduced by the chunk
+        std::vector<std::uint32_t> remap;
+        std::size_t first_vertex = 0;
+        std::size_t first_index = 0;
+
+        // Prepares a parser kept from an earlier parse, keeping its buffers
+        void reset(std::string_view chunk_source)
+        {
+            source = chunk_source;
+            counts = {};
+            base = {};
+            position_count = normal_count = texcoord_count = 0;
+            index_table.clear();
+            unique_vertices.clear();
+            face.clear();
+            indices.clear();
+            changes.clear();
+            material_libraries.clear();
+            remap.clear();
+            first_vertex = first_index = 0;
+        }
+
+        std::array<float, 3> & add_position() { return (*positions)[base.positions + position_count++]; }
+        std::array<float, 3> & add_normal() { return (*normals)[base.normals + normal_count++]; }
+        std::array<float, 2> & add_texcoord() { return (*texcoords)[base.texcoords + texcoord_count++]; }
+
+        void use_material(std::string_view name) { changes.push_back({indices.size(), true, std::string(name)}); }
+        void set_name(std::string_view name) { changes.push_back({indices.size(), false, std::string(name)}); }
+        void add_libraries(std::string_view names) { add_material_libraries(names, material_libraries); }
+
+        template <typename Fail>
+        void add_face_vertex(obj_index index, bool has_texcoord, bool has_normal, Fail const & fail)
+        {
+            index = resolve_index(index, has_texcoord, has_normal,
+                base.positions + position_count, base.texcoords + texcoord_count, base.normals + normal_count, fail);
+
+            auto [vertex_index, inserted] = index_table.insert(index, unique_vertices.size());
+            if (inserted)
+                unique_vertices.push_back(index);
+
+            face.push_back(vertex_index);
+        }
+
+        void end_face()
+        {
+            triangulate_face(face, indices);
+            face.clear();
+        }
+    };
+
+    // Handler for the batched parse: keeps the raw attributes and the dedup table,
+    // but hands vertices and triangles to the callbacks instead of accumulating them
+    struct obj_batch_builder
+    {
+        std::vector<std::array<float, 3>> positions;
+        std::vector<std::array<float, 3>> normals;
+        std::vector<std::array<float, 2>> texcoords;
+
+        vertex_dedup_table index_table;
+
+        std::vector<std::uint32_t> face;
+
+        obj_batch_callbacks const & callbacks;
+        std::size_t batch_size;
+
+        std::vector<obj_data::vertex> vertex_batch;
+        std::vector<std::uint32_t> index_batch;
+
+        obj_batch_stats stats;
+
+        obj_batch_builder(obj_batch_callbacks const & callbacks, std::size_t batch_size)
+            : callbacks(callbacks)
+            , batch_size(batch_size)
+        {
+            vertex_batch.reserve(batch_size);
+            index_batch.reserve(batch_size * 3 + 3);
+        }
+
+        std::array<float, 3> & add_position() { return positions.emplace_back(); }
+        std::array<float, 3> & add_normal() { return normals.emplace_back(); }
+        std::array<float, 2> & add_texcoord() { return texcoords.emplace_back(); }
+
+        // Batches are delivered in file order, without submeshes
+        void use_material(std::string_view) {}
+        void set_name(std::string_view) {}
+        void add_libraries(std::string_view) {}
+
+        template <typename Fail>
+        void add_face_vertex(obj_index index, bool has_texcoord, bool has_normal, Fail const & fail)
+        {
+            index = resolve_index(index, has_texcoord, has_normal, positions.size(), texcoords.size(), normals.size(), fail);
+
+            auto [vertex_index, inserted] = index_table.insert(index, stats.vertex_count);
+            if (inserted)
+            {
+                vertex_batch.push_back(make_vertex(index, positions, texcoords, normals));
+                ++stats.vertex_count;
+
+                if (vertex_batch.size() == batch_size)
+                    flush_vertices();
+            }
+
+            face.push_back(vertex_index);
+        }
+
+        void end_face()
+        {
+            triangulate_face(face, index_batch);
+            face.clear();
+
+            if (index_batch.size() >= batch_size * 3)
+                flush_indices();
+        }
+
+        void flush_vertices()
+        {
+            if (vertex_batch.empty())
+                return;
+
+            if (callbacks.vertices)
+                callbacks.vertices(vertex_batch);
+            vertex_batch.clear();
+        }
+
+        // Every vertex referenced by the indices is delivered before them
+        void flush_indices()
+        {
+            flush_vertices();
+
+            if (index_batch.empty())
+                return;
+
+            stats.index_count += index_batch.size();
+            if (callbacks.indices)
+                callbacks.indices(index_batch);
+            index_batch.clear();
+        }
+
+        std::size_t memory_usage() const
+        {
+            return positions.capacity() * sizeof(positions[0])
+                + normals.capacity() * sizeof(normals[0])
+                + texcoords.capacity() * sizeof(texcoords[0])
+                + index_table.memory_usage()
+                + vertex_batch.capacity() * sizeof(vertex_batch[0])
+                + index_batch.capacity() * sizeof(index_batch[0]);
+        }
+    };
+
+    // Bytes of text per chunk of the parallel parse
+    constexpr std::size_t min_parallel_chunk_size = 1 << 20;
+
+}
+
+struct obj_parse_context::scratch
+{
+    std::vector<std::array<float, 3>> positions;
+    std::vector<std::array<float, 3>> normals;
+    std::vector<std::array<float, 2>> texcoords;
+
+    vertex_dedup_table index_table;
+    std::vector<std::uint32_t> face;
+    std::vector<obj_state_change> changes;
+
+    std::vector<obj_chunk_parser> chunks;
+    submesh_scratch submeshes;
+
+    // Buffer sizes before the current parse, for obj_parse_stats
+    std::vector<std::size_t> capacities;
+};
+
+namespace
+{
+
+    template <typename T>
+    std::size_t buffer_bytes(std::vector<T> const & buffer)
+    {
+        return buffer.capacity() * sizeof(T);
+    }
+
+    std::size_t buffer_bytes(vertex_dedup_table const & table)
+    {
+        return table.memory_usage();
+    }
+
+    // Calls function on every buffer sized by the mesh, in an order that only
+    // appends new chunks at the end
+    template <typename Function>
+    void for_each_buffer(obj_parse_context::scratch const & scratch, obj_data const & result, Function const & function)
+    {
+        function(buffer_bytes(result.vertices));
+        function(buffer_bytes(result.indices));
+        function(buffer_bytes(result.submeshes));
+        function(buffer_bytes(result.materials));
+        function(buffer_bytes(result.material_libraries));
+
+        function(buffer_bytes(scratch.positions));
+        function(buffer_bytes(scratch.normals));
+        function(buffer_bytes(scratch.texcoords));
+        function(buffer_bytes(scratch.index_table));
+        function(buffer_bytes(scratch.face));
+        function(buffer_bytes(scratch.changes));
+        function(buffer_bytes(scratch.chunks));
+        function(buffer_bytes(scratch.submeshes.runs));
+        function(buffer_bytes(scratch.submeshes.order));
+        function(buffer_bytes(scratch.submeshes.slot));
+        function(buffer_bytes(scratch.submeshes.position));
+        function(buffer_bytes(scratch.submeshes.indices));
+
+        for (auto const & chunk : scratch.chunks)
+        {
+            function(buffer_bytes(chunk.index_table));
+            function(buffer_bytes(chunk.unique_vertices));
+            function(buffer_bytes(chunk.face));
+            function(buffer_bytes(chunk.indices));
+            function(buffer_bytes(chunk.changes));
+            function(buffer_bytes(chunk.material_libraries));
+            function(buffer_bytes(chunk.remap));
+        }
+    }
+
+    void clear_result(obj_data & result)
+    {
+        result.vertices.clear();
+        result.indices.clear();
+        result.tangents.clear();
+        result.submeshes.clear();
+        result.materials.clear();
+        result.material_libraries.clear();
+    }
+
+    void parse_obj_serial(std::string_view source, obj_data & result, obj_parse_context::scratch & scratch)
+    {
+        scratch.positions.clear();
+        scratch.normals.clear();
+        scratch.texcoords.clear();
+        scratch.index_table.clear();
+        scratch.face.clear();
+        scratch.changes.clear();
+
+        obj_builder builder{scratch.positions, scratch.normals, scratch.texcoords, scratch.index_table, scratch.face, result, scratch.changes};
+
+        auto const counts = count_records(source);
+        builder.positions.reserve(counts.positions);
+        builder.normals.reserve(counts.normals);
+        builder.texcoords.reserve(counts.texcoords);
+
+        // Closed triangle meshes have about half as many unique vertices as faces,
+        // and every referenced attribute needs at least one vertex of its own
+        auto const vertex_estimate = std::max({counts.faces / 2, counts.positions, counts.normals, counts.texcoords});
+        builder.index_table.reserve(vertex_estimate);
+        builder.result.vertices.reserve(vertex_estimate);
+        builder.result.indices.reserve(counts.faces * 3);
+
+        tokenize_obj(source, 0, builder);
+
+        build_submeshes(result, scratch.changes, scratch.submeshes);
+    }
+
+    void parse_obj_parallel(std::string_view source, std::size_t chunk_count, obj_data & result, obj_parse_context::scratch & scratch)
+    {
+        auto & chunks = scratch.chunks;
+        if (chunks.size() < chunk_count)
+            chunks.resize(chunk_count);
+
+        // Split at line boundaries
+        {
+            std::size_t begin = 0;
+            for (std::size_t i = 0; i < chunk_count; ++i)
+            {
+                std::size_t end = (i + 1 == chunk_count) ? source.size() : std::max(begin, source.size() * (i + 1) / chunk_count);
+                while (end < source.size() && end > 0 && source[end - 1] != '\n')
+                    ++end;
+                chunks[i].reset(source.substr(begin, end - begin));
+                begin = end;
+            }
+        }
+
+        run_parallel(chunk_count, [&](std::size_t i){
+            chunks[i].counts = count_records(chunks[i].source);
+        });
+
+        obj_record_counts total;
+        for (std::size_t i = 0; i < chunk_count; ++i)
+        {
+            auto & chunk = chunks[i];
+            chunk.base = total;
+            total.positions += chunk.counts.positions;
+            total.normals += chunk.counts.normals;
+            total.texcoords += chunk.counts.texcoords;
+            total.faces += chunk.counts.faces;
+            total.lines += chunk.counts.lines;
+        }
+
+        auto & positions = scratch.positions;
+        auto & normals = scratch.normals;
+        auto & texcoords = scratch.texcoords;
+        positions.resize(total.positions);
+        normals.resize(total.normals);
+        texcoords.resize(total.texcoords);
+
+        run_parallel(chunk_count, [&](std::size_t i){
+            auto & chunk = chunks[i];
+            chunk.positions = &positions;
+            chunk.normals = &normals;
+            chunk.texcoords = &texcoords;
+
+            auto const vertex_estimate = std::max({chunk.counts.faces / 2, chunk.counts.positions, chunk.counts.normals, chunk.counts.texcoords});
+            chunk.index_table.reserve(vertex_estimate);
+            chunk.unique_vertices.reserve(vertex_estimate);
+            chunk.indices.reserve(chunk.counts.faces * 3);
+
+            tokenize_obj(chunk.source, chunk.base.lines, chunk);
+        });
+
+        // Deterministic merge: inserting every chunk's unique vertices in chunk order
+        // assigns global indices in order of first appearance in the file, exactly as
+        // the serial parse does. Only unique vertices go through this serial step,
+        // face corners are remapped in parallel afterwards
+        std::size_t vertex_count = 0;
+        std::size_t index_count = 0;
+        {
+            auto const vertex_estimate = std::max({total.faces / 2, total.positions, total.normals, total.texcoords});
+            auto & index_table = scratch.index_table;
+            index_table.clear();
+            index_table.reserve(vertex_estimate);
+
+            for (std::size_t c = 0; c < chunk_count; ++c)
+            {
+                auto & chunk = chunks[c];
+                chunk.first_vertex = vertex_count;
+                chunk.first_index = index_count;
+                chunk.remap.resize(chunk.unique_vertices.size());
+
+                for (std::size_t i = 0; i < chunk.unique_vertices.size(); ++i)
+                {
+                    auto [vertex_index, inserted] = index_table.insert(chunk.unique_vertices[i], vertex_count);
+                    if (inserted)
+                        ++vertex_count;
+                    chunk.remap[i] = vertex_index;
+                }
+
+                index_count += chunk.indices.size();
+            }
+        }
+
+        result.vertices.resize(vertex_count);
+        result.indices.resize(index_count);
+
+        run_parallel(chunk_count, [&](std::size_t i){
+            auto & chunk = chunks[i];
+
+            // Vertices first seen in this chunk got global indices starting at first_vertex
+            for (std::size_t j = 0; j < chunk.unique_vertices.size(); ++j)
+                if (chunk.remap[j] >= chunk.first_vertex)
+                    result.vertices[chunk.remap[j]] = make_vertex(chunk.unique_vertices[j], positions, texcoords, normals);
+
+            for (std::size_t j = 0; j < chunk.indices.size(); ++j)
+                result.indices[chunk.first_index + j] = chunk.remap[chunk.indices[j]];
+        });
+
+        auto & changes = scratch.changes;
+        changes.clear();
+        for (std::size_t c = 0; c < chunk_count; ++c)
+        {
+            auto & chunk = chunks[c];
+            for (auto & change : chunk.changes)
+            {
+                change.index_offset += chunk.first_index;
+                changes.push_back(std::move(change));
+            }
+            for (auto & library : chunk.material_libraries)
+                result.material_libraries.push_back(std::move(library));
+        }
+
+        build_submeshes(result, changes, scratch.submeshes);
+    }
+
+}
+
+obj_parse_context::obj_parse_context()
+    : scratch_(std::make_unique<scratch>())
+{}
+
+obj_parse_context::~obj_parse_context() = default;
+
+obj_parse_context::obj_parse_context(obj_parse_context && other) noexcept = default;
+
+obj_parse_context & obj_parse_context::operator = (obj_parse_context && other) noexcept = default;
+
+std::size_t obj_parse_context::memory_usage() const
+{
+    obj_data const empty;
+    std::size_t result = 0;
+    for_each_buffer(*scratch_, empty, [&](std::size_t bytes){ result += bytes; });
+    return result;
+}
+
+obj_data parse_obj(std::filesystem::path const & path, unsigned int thread_count)
+{
+    mapped_file file(path);
+    auto result = parse_obj_source(file.view(), thread_count);
+    load_materials(result, path.parent_path());
+    return result;
+}
+
+obj_parse_stats parse_obj(std::filesystem::path const & path, obj_data & result, obj_parse_context & context, unsigned int thread_count)
+{
+    mapped_file file(path);
+    auto const stats = parse_obj_source(file.view(), result, context, thread_count);
+    load_materials(result, path.parent_path());
+    return stats;
+}
+
+obj_parse_stats parse_obj_source(std::string_view source, obj_data & result, obj_parse_context & context, unsigned int thread_count)
+{
+    auto & scratch = *context.scratch_;
+
+    scratch.capacities.clear();
+    for_each_buffer(scratch, result, [&](std::size_t bytes){ scratch.capacities.push_back(bytes); });
+
+    clear_result(result);
+
+    std::size_t const chunk_count = parallel_chunk_count(source.size(), min_parallel_chunk_size, thread_count);
+
+    if (chunk_count <= 1)
+        parse_obj_serial(source, result, scratch);
+    else
+        parse_obj_parallel(source, chunk_count, result, scratch);
+
+    obj_parse_stats stats;
+    std::size_t i = 0;
+    for_each_buffer(scratch, result, [&](std::size_t bytes){
+        std::size_t const before = i < scratch.capacities.size() ? scratch.capacities[i] : 0;
+        if (bytes > before)
+        {
+            ++stats.allocations;
+            stats.allocated_bytes += bytes;
+        }
+        ++i;
+    });
+    return stats;
+}
+
+obj_data parse_obj_source(std::string_view source, unsigned int thread_count)
+{
+    obj_parse_context context;
+    obj_data result;
+    parse_obj_source(source, result, context, thread_count);
+    return result;
+}
+
+obj_batch_stats parse_obj_batches(std::filesystem::path const & path, obj_batch_callbacks const & callbacks, std::size_t batch_size)
+{
+    mapped_file file(path);
+    return parse_obj_batches(file.view(), callbacks, batch_size);
+}
+
+obj_batch_stats parse_obj_batches(std::string_view source, obj_batch_callbacks const & callbacks, std::size_t batch_size)
+{
+    batch_size = std::max<std::size_t>(batch_size, 1);
+
+    obj_batch_builder builder(callbacks, batch_size);
+
+    // Exact attribute counts keep the raw arrays from overshooting their size
+    auto const counts = count_records(source);
+    builder.positions.reserve(counts.positions);
+    builder.normals.reserve(counts.normals);
+    builder.texcoords.reserve(counts.texcoords);
+    builder.index_table.reserve(std::max({counts.faces / 2, counts.positions, counts.normals, counts.texcoords}));
+
+    tokenize_obj(source, 0, builder);
+
+    builder.flush_indices();
+
+    builder.stats.peak_memory = builder.memory_usage();
+    return builder.stats;
+}
+
+obj_data parse_obj_stream(std::istream & is)
+{
+    obj_parse_context::scratch scratch;
+    obj_data result;
+    obj_builder builder{scratch.positions, scratch.normals, scratch.texcoords, scratch.index_table, scratch.face, result, scratch.changes};
+
+    std::string line;
+    std::size_t line_count = 0;
+
+    auto fail = [&](auto const & ... args){
+        throw std::runtime_error(to_string("Error parsing OBJ data, line ", line_count, ": ", args...));
+    };
+
+    while (std::getline(is >> std::ws, line))
+    {
+        ++line_count;
+
+        if (line.empty()) continue;
+
+        if (line[0] == '#') continue;
+
+        std::istringstream ls(std::move(line));
+
+        std::string tag;
+        ls >> tag;
+
+        if (tag == "v")
+        {
+            auto & p = builder.add_position();
+            p = {0.f, 0.f, 0.f};
+            ls >> p[0] >> p[1] >> p[2];
+        }
+        else if (tag == "vn")
+        {
+            auto & n = builder.add_normal();
+            n = {0.f, 0.f, 0.f};
+            ls >> n[0] >> n[1] >> n[2];
+        }
+        else if (tag == "vt")
+        {
+            auto & t = builder.add_texcoord();
+            t = {0.f, 0.f};
+            ls >> t[0] >> t[1];
+        }
+        else if (tag == "f")
+        {
+            while (ls)
+            {
+                obj_index index{0, 0, 0};
+                bool has_texcoord = false;
+                bool has_normal = false;
+
+                // Checking for the end of line before extraction keeps the last
+                // corner of position-only faces like "f 1 2 3"
+                if ((ls >> std::ws).eof()) break;
+
+                ls >> index[0];
+                if (!ls)
+                    fail("expected position index");
+
+                if (!std::isspace(ls.peek()) && !ls.eof())
+                {
+                    if (ls.get() != '/')
+                        fail("expected '/'");
+
+                    if (ls.peek() != '/')
+                    {
+                        ls >> index[1];
+                        if (!ls)
+                            fail("expected texcoord index");
+                        has_texcoord = true;
+
+                        if (!std::isspace(ls.peek()) && !ls.eof())
+                        {
+                            if (ls.get() != '/')
+                                fail("expected '/'");
+
+                            ls >> index[2];
+                            if (!ls)
+                                fail("expected normal index");
+                            has_normal = true;
+                        }
+                    }
+                    else
+                    {
+                        ls.get();
+
+                        ls >> index[2];
+                        if (!ls)
+                            fail("expected normal index");
+                        has_normal = true;
+                    }
+                }
+
+                builder.add_face_vertex(index, has_texcoord, has_normal, fail);
+            }
+
+            builder.end_face();
+        }
+        else if (tag == "usemtl" || tag == "o" || tag == "g" || tag == "mtllib")
+        {
+            std::string value;
+            std::getline(ls >> std::ws, value);
+            while (!value.empty() && std::isspace(static_cast<unsigned char>(value.back())))
+                value.pop_back();
+
+            if (tag == "usemtl")
+                builder.use_material(value);
+            else if (tag == "mtllib")
+                builder.add_libraries(value);
+            else
+                builder.set_name(value);
+        }
+    }
+
+    build_submeshes(result, scratch.changes, scratch.submeshes);
+    return result;
+}
+
+std::vector<obj_material_range> material_ranges(std::span<obj_submesh const> submeshes)
+{
+    std::vector<obj_material_range> result;
+    for (auto const & submesh : submeshes)
+    {
+        if (!result.empty() && result.back().material == submesh.material)
+            result.back().index_count += submesh.index_count;
+        else
+            result.push_back({submesh.material, submesh.index_offset, submesh.index_count});
+    }
+    return result;
+}
+
+std::vector<obj_material> parse_mtl(std::filesystem::path const & path)
+{
+    mapped_file file(path);
+    return parse_mtl_source(file.view());
+}
+
+std::vector<obj_material> parse_mtl_source(std::string_view source)
+{
+    std::vector<obj_material> result;
+    obj_material unnamed;
+
+    char const * current = source.data();
+    char const * const end = current + source.size();
+
+    auto skip_blanks = [&]{
+        while (current != end && is_blank(*current))
+            ++current;
+    };
+
+    auto parse_number = [&](auto & value){
+        skip_blanks();
+        auto [ptr, ec] = std::from_chars(current, end, value);
+        if (ec == std::errc{})
+            current = ptr;
+    };
+
+    auto parse_color = [&](std::array<float, 3> & color){
+        parse_number(color[0]);
+        // A single value means grey
+        color[1] = color[2] = color[0];
+        parse_number(color[1]);
+        parse_number(color[2]);
+    };
+
+    // Map records may start with options such as "-bm 0.5"; the file name comes last
+    auto parse_map = [&](std::string & path){
+        char const * line_end = current;
+        while (line_end != end && *line_end != '\n')
+            ++line_end;
+        char const * name_end = line_end;
+        while (name_end != current && is_blank(*(name_end - 1)))
+            --name_end;
+        char const * name_begin = name_end;
+        while (name_begin != current && !is_blank(*(name_begin - 1)))
+            --name_begin;
+        path.assign(name_begin, name_end);
+        current = line_end;
+    };
+
+    while (true)
+    {
+        while (current != end && (is_blank(*current) || *current == '\n'))
+            ++current;
+
+        if (current == end)
+            break;
+
+        char const * tag_begin = current;
+        while (current != end && *current != '\n' && !is_blank(*current))
+            ++current;
+        std::string_view tag(tag_begin, current - tag_begin);
+
+        // Records before the first newmtl have nowhere to go
+        auto & material = result.empty() ? unnamed : result.back();
+
+        if (tag == "newmtl")
+        {
+            skip_blanks();
+            char const * name_begin = current;
+            while (current != end && *current != '\n')
+                ++current;
+            char const * name_end = current;
+            while (name_end != name_begin && is_blank(*(name_end - 1)))
+                --name_end;
+            result.emplace_back().name.assign(name_begin, name_end);
+        }
+        else if (tag == "Ka")
+            parse_color(material.ambient);
+        else if (tag == "Kd")
+            parse_color(material.diffuse);
+        else if (tag == "Ks")
+            parse_color(material.specular);
+        else if (tag == "Ke")
+            parse_color(material.emission);
+        else if (tag == "Ns")
+            parse_number(material.shininess);
+        else if (tag == "d")
+            parse_number(material.opacity);
+        else if (tag == "Tr")
+        {
+            float transparency = 0.f;
+            parse_number(transparency);
+            material.opacity = 1.f - transparency;
+        }
+        else if (tag == "Ni")
+            parse_number(material.refraction_index);
+        else if (tag == "illum")
+            parse_number(material.illumination);
+        else if (tag == "map_Ka")
+            parse_map(material.ambient_map);
+        else if (tag == "map_Kd")
+            parse_map(material.diffuse_map);
+        else if (tag == "map_Ks")
+            parse_map(material.specular_map);
+        else if (tag == "map_Bump" || tag == "map_bump" || tag == "bump" || tag == "norm")
+            parse_map(material.normal_map);
+        else if (tag == "map_d")
+            parse_map(material.opacity_map);
+
+        while (current != end && *current != '\n')
+            ++current;
+    }
+
+    return result;
+}
+
+void load_materials(std::span<obj_material> materials, std::span<std::string const> libraries, std::filesystem::path const & directory)
+{
+    if (materials.empty())
+        return;
+
+    std::map<std::string, obj_material, std::less<>> library;
+    for (auto const & name : libraries)
+    {
+        std::error_code error;
+        auto const path = directory / name;
+        if (!std::filesystem::is_regular_file(path, error))
+            continue;
+
+        // The first definition of a name wins, as in most OBJ readers
+        for (auto & material : parse_mtl(path))
+            library.try_emplace(material.name, std::move(material));
+    }
+
+    for (auto & material : materials)
+        if (auto it = library.find(material.name); it != library.end())
+            material = it->second;
+}
+
+void load_materials(obj_data & data, std::filesystem::path const & directory)
+{
+    load_materials(data.materials, data.material_libraries, directory);
+}
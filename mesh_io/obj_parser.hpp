@@ -0,0 +1,171 @@
+#pragma once
+
+#include <array>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <istream>
+#include <filesystem>
+#include <string_view>
+#include <functional>
+#include <memory>
+#include <span>
+
+// Material from an MTL library; the defaults are used for materials that usemtl
+// names but no library defines
+struct obj_material
+{
+    std::string name;
+
+    std::array<float, 3> ambient{0.f, 0.f, 0.f};
+    std::array<float, 3> diffuse{0.8f, 0.8f, 0.8f};
+    std::array<float, 3> specular{0.f, 0.f, 0.f};
+    std::array<float, 3> emission{0.f, 0.f, 0.f};
+    float shininess = 0.f;
+    float opacity = 1.f;
+    float refraction_index = 1.f;
+    int illumination = 2;
+
+    // Texture paths as written in the library, usually relative to it
+    std::string ambient_map;
+    std::string diffuse_map;
+    std::string specular_map;
+    std::string normal_map;
+    std::string opacity_map;
+};
+
+constexpr std::uint32_t obj_no_material = -1;
+
+// Faces sharing a material and an object or group name. Submeshes are sorted by material
+// (in order of first use, faces before any usemtl counting as one more material), so all
+// the faces of a material form one contiguous index range
+struct obj_submesh
+{
+    // Name from the last o or g record before the faces, empty if there was none
+    std::string name;
+    // Index into obj_data::materials, or obj_no_material
+    std::uint32_t material = obj_no_material;
+    std::uint32_t index_offset = 0;
+    std::uint32_t index_count = 0;
+    // Bounds of the vertices referenced by the submesh
+    std::array<float, 3> min{0.f, 0.f, 0.f};
+    std::array<float, 3> max{0.f, 0.f, 0.f};
+};
+
+struct obj_data
+{
+    struct vertex
+    {
+        std::array<float, 3> position;
+        std::array<float, 3> normal;
+        std::array<float, 2> texcoord;
+    };
+
+    std::vector<vertex> vertices;
+    std::vector<std::uint32_t> indices;
+
+    // Tangent and bitangent sign per vertex, see generate_tangents; empty unless generated
+    std::vector<std::array<float, 4>> tangents;
+
+    std::vector<obj_submesh> submeshes;
+    // Materials used by the faces, in submesh order; filled from the libraries by
+    // load_materials, only named otherwise
+    std::vector<obj_material> materials;
+    // mtllib file names, relative to the OBJ file
+    std::vector<std::string> material_libraries;
+};
+
+// Consecutive submeshes sharing a material, drawn with one call
+struct obj_material_range
+{
+    std::uint32_t material;
+    std::uint32_t index_offset;
+    std::uint32_t index_count;
+};
+
+std::vector<obj_material_range> material_ranges(std::span<obj_submesh const> submeshes);
+
+// Memory-maps the file, parses it with parse_obj_source and loads its materials
+obj_data parse_obj(std::filesystem::path const & path, unsigned int thread_count = 1);
+
+// Parses OBJ text in place, without copying lines or going through iostreams.
+// With thread_count > 1 (0 meaning all hardware threads) large sources are split
+// into chunks at line boundaries and parsed concurrently; the result is identical
+// to the single-threaded one. Faces are grouped into submeshes by usemtl, o and g
+// records; materials are only named, see load_materials
+obj_data parse_obj_source(std::string_view source, unsigned int thread_count = 1);
+
+struct obj_parse_stats
+{
+    // Buffers of the context and of the output that had to grow during the parse,
+    // and their new size in bytes. Both are zero once the context and the output
+    // have been through a mesh at least as large; what remains are a few small
+    // allocations per submesh and per thread
+    std::size_t allocations = 0;
+    std::size_t allocated_bytes = 0;
+};
+
+// Scratch storage of the parser (raw attributes, the dedup table, per-chunk state),
+// kept between parses so that loading many meshes in a row does not go back to
+// the heap for every one of them. Holds on to the memory of the largest mesh seen
+struct obj_parse_context
+{
+    obj_parse_context();
+    ~obj_parse_context();
+
+    obj_parse_context(obj_parse_context && other) noexcept;
+    obj_parse_context & operator = (obj_parse_context && other) noexcept;
+
+    // Bytes held by the scratch buffers
+    std::size_t memory_usage() const;
+
+    struct scratch;
+
+private:
+    std::unique_ptr<scratch> scratch_;
+
+    friend obj_parse_stats parse_obj_source(std::string_view, obj_data &, obj_parse_context &, unsigned int);
+};
+
+// Same as the overloads above, but parsing into result, whose buffers are cleared
+// and reused along with those of the context
+obj_parse_stats parse_obj(std::filesystem::path const & path, obj_data & result, obj_parse_context & context, unsigned int thread_count = 1);
+obj_parse_stats parse_obj_source(std::string_view source, obj_data & result, obj_parse_context & context, unsigned int thread_count = 1);
+
+// Receivers for parse_obj_batches. Vertices arrive in output order, so the first
+// vertex of a batch has index equal to the number of vertices delivered before it;
+// an index batch is only delivered after all the vertices it references
+struct obj_batch_callbacks
+{
+    std::function<void(std::span<obj_data::vertex const> vertices)> vertices;
+    std::function<void(std::span<std::uint32_t const> indices)> indices;
+};
+
+struct obj_batch_stats
+{
+    std::size_t vertex_count = 0;
+    std::size_t index_count = 0;
+
+    // Bytes held by the parser itself: raw attributes, the dedup table and
+    // the two batch buffers. The output is never accumulated
+    std::size_t peak_memory = 0;
+};
+
+// Parses an MTL library
+std::vector<obj_material> parse_mtl(std::filesystem::path const & path);
+std::vector<obj_material> parse_mtl_source(std::string_view source);
+
+// Replaces the materials of data with their definitions from its material libraries,
+// looked up relative to directory. Missing libraries and materials keep the defaults,
+// as the geometry is still usable without them
+void load_materials(obj_data & data, std::filesystem::path const & directory);
+void load_materials(std::span<obj_material> materials, std::span<std::string const> libraries, std::filesystem::path const & directory);
+
+// Streaming parse producing the same vertices and indices as parse_obj, delivered
+// in batches of at most batch_size vertices and batch_size triangles (plus the rest
+// of the last face). Triangles stay in file order, they are not grouped by material
+obj_batch_stats parse_obj_batches(std::filesystem::path const & path, obj_batch_callbacks const & callbacks, std::size_t batch_size = 65536);
+obj_batch_stats parse_obj_batches(std::string_view source, obj_batch_callbacks const & callbacks, std::size_t batch_size = 65536);
+
+// Line-by-line iostream parser, kept as a reference for parse_obj_source
+obj_data parse_obj_stream(std::istream & input);
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <cstddef>
+#include <exception>
+#include <algorithm>
+
+// Thread helpers of the mesh_io sources, also used by the practices
+
+// Number of chunks to split count items into, one thread each: at most thread_count (0 meaning
+// all hardware threads), at least one, and none smaller than min_chunk_size items, below which
+// starting a thread costs more than it saves
+inline std::size_t parallel_chunk_count(std::size_t count, std::size_t min_chunk_size, unsigned int thread_count)
+{
+    if (thread_count == 0)
+        thread_count = std::max(1u, std::thread::hardware_concurrency());
+    return std::clamp<std::size_t>(count / std::max<std::size_t>(min_chunk_size, 1), 1, thread_count);
+}
+
+// Chunk size of the per-triangle passes of normal and tangent generation
+constexpr std::size_t min_triangles_per_thread = 1 << 16;
+
+// Runs task(i) for i in [0, count) on count threads, the calling thread taking i = 0.
+// If several tasks throw, the exception of the lowest i is rethrown, which for
+// file-ordered chunks is the error a serial run would have reported
+template <typename Task>
+void run_parallel(std::size_t count, Task const & task)
+{
+    std::vector<std::exception_ptr> errors(count);
+    std::vector<std::thread> threads;
+    threads.reserve(count);
+
+    auto run = [&](std::size_t i){
+        try
+        {
+            task(i);
+        }
+        catch (...)
+        {
+            errors[i] = std::current_exception();
+        }
+    };
+
+    for (std::size_t i = 1; i < count; ++i)
+        threads.emplace_back(run, i);
+
+    run(0);
+
+    for (auto & thread : threads)
+        thread.join();
+
+    for (auto const & error : errors)
+        if (error)
+            std::rethrow_exception(error);
+}
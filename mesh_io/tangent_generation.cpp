@@ -0,0 +1,242 @@
+#include "tangent_generation.hpp"
+#include "parallel.hpp"
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <stdexcept>
+
+namespace
+{
+
+    using vec3 = std::array<float, 3>;
+
+    vec3 load3(float const * p)
+    {
+        return {p[0], p[1], p[2]};
+    }
+
+    vec3 operator - (vec3 const & a, vec3 const & b)
+    {
+        return {a[0] - b[0], a[1] - b[1], a[2] - b[2]};
+    }
+
+    vec3 operator * (vec3 const & a, float s)
+    {
+        return {a[0] * s, a[1] * s, a[2] * s};
+    }
+
+    float dot(vec3 const & a, vec3 const & b)
+    {
+        return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+    }
+
+    // Zero vectors stay zero
+    vec3 normalized(vec3 const & v)
+    {
+        float const length = std::sqrt(dot(v, v));
+        return (length > 0.f) ? v * (1.f / length) : vec3{0.f, 0.f, 0.f};
+    }
+
+    // v with its component along the unit vector n removed
+    vec3 project(vec3 const & v, vec3 const & n)
+    {
+        return v - n * dot(n, v);
+    }
+
+    // Any unit vector perpendicular to n, for vertices whose triangles have no texture area
+    vec3 any_tangent(vec3 const & n)
+    {
+        vec3 const axis = (std::abs(n[0]) < 0.9f) ? vec3{1.f, 0.f, 0.f} : vec3{0.f, 1.f, 0.f};
+        vec3 const t = normalized(project(axis, n));
+        return (t == vec3{0.f, 0.f, 0.f}) ? axis : t;
+    }
+
+    // Triangles with no texture area get no orientation and join whichever
+    // group their vertices end up in
+    constexpr std::int8_t no_orientation = -1;
+
+    struct new_vertex
+    {
+        std::uint32_t source;
+        std::array<float, 4> tangent;
+    };
+
+}
+
+template <typename Index>
+generated_tangents generate_tangents(std::span<Index> indices, vertex_stream positions, vertex_stream normals, vertex_stream texcoords,
+    std::size_t vertex_count, unsigned int thread_count)
+{
+    generated_tangents result;
+
+    std::size_t const triangle_count = indices.size() / 3;
+
+    std::size_t const chunk_count = parallel_chunk_count(triangle_count, min_triangles_per_thread, thread_count);
+
+    // Unit tangent of each triangle along increasing u. The position derivative below is
+    // scaled by the signed texture area, so mirrored triangles get it flipped back
+    std::vector<vec3> triangle_tangent(triangle_count);
+    std::vector<std::int8_t> triangle_orientation(triangle_count);
+
+    run_parallel(chunk_count, [&](std::size_t chunk){
+        std::size_t const end = triangle_count * (chunk + 1) / chunk_count;
+        for (std::size_t t = triangle_count * chunk / chunk_count; t < end; ++t)
+        {
+            auto const i0 = indices[3 * t + 0];
+            auto const i1 = indices[3 * t + 1];
+            auto const i2 = indices[3 * t + 2];
+
+            vec3 const d1 = load3(positions[i1]) - load3(positions[i0]);
+            vec3 const d2 = load3(positions[i2]) - load3(positions[i0]);
+
+            float const * uv0 = texcoords[i0];
+            float const * uv1 = texcoords[i1];
+            float const * uv2 = texcoords[i2];
+
+            float const t21x = uv1[0] - uv0[0], t21y = uv1[1] - uv0[1];
+            float const t31x = uv2[0] - uv0[0], t31y = uv2[1] - uv0[1];
+            float const signed_area = t21x * t31y - t21y * t31x;
+
+            vec3 const tangent = normalized(d1 * t31y - d2 * t21y);
+
+            if (signed_area == 0.f || tangent == vec3{0.f, 0.f, 0.f})
+            {
+                triangle_tangent[t] = {0.f, 0.f, 0.f};
+                triangle_orientation[t] = no_orientation;
+                continue;
+            }
+
+            bool const preserving = signed_area > 0.f;
+            triangle_tangent[t] = preserving ? tangent : tangent * -1.f;
+            triangle_orientation[t] = preserving;
+        }
+    });
+
+    // Corners of each vertex, in corner order
+    std::vector<std::uint32_t> vertex_offset(vertex_count + 1, 0);
+    for (std::size_t c = 0; c < 3 * triangle_count; ++c)
+        ++vertex_offset[indices[c] + 1];
+    for (std::size_t v = 0; v < vertex_count; ++v)
+        vertex_offset[v + 1] += vertex_offset[v];
+
+    std::vector<std::uint32_t> corners(vertex_offset.back());
+    {
+        std::vector<std::uint32_t> fill(vertex_offset.begin(), vertex_offset.end() - 1);
+        for (std::size_t c = 0; c < 3 * triangle_count; ++c)
+            corners[fill[indices[c]]++] = c;
+    }
+
+    // Vertices are dealt to threads in contiguous ranges of about equal corner counts;
+    // split vertices are numbered per range and offset afterwards, in range order
+    std::vector<std::size_t> range_begin(chunk_count + 1);
+    for (std::size_t i = 0; i <= chunk_count; ++i)
+    {
+        auto const target = corners.size() * i / chunk_count;
+        range_begin[i] = std::lower_bound(vertex_offset.begin(), vertex_offset.end(), target) - vertex_offset.begin();
+    }
+    range_begin[chunk_count] = vertex_count;
+
+    result.tangents.resize(vertex_count);
+    // Per corner slot: whether the corner moves to the split vertex of its vertex
+    std::vector<std::uint8_t> moved(corners.size(), 0);
+    std::vector<std::vector<new_vertex>> range_new_vertices(chunk_count);
+
+    run_parallel(chunk_count, [&](std::size_t range){
+        auto & new_vertices = range_new_vertices[range];
+
+        for (std::size_t v = range_begin[range]; v < range_begin[range + 1]; ++v)
+        {
+            auto const begin = vertex_offset[v];
+            auto const end = vertex_offset[v + 1];
+
+            vec3 const normal = normalized(load3(normals[v]));
+            vec3 const position = load3(positions[v]);
+
+            // Angle-weighted sums of the projected triangle tangents, per orientation
+            vec3 sum[2] = {{0.f, 0.f, 0.f}, {0.f, 0.f, 0.f}};
+            bool used[2] = {false, false};
+            int primary = -1;
+
+            for (auto s = begin; s < end; ++s)
+            {
+                auto const c = corners[s];
+                auto const t = c / 3;
+                auto const orientation = triangle_orientation[t];
+                if (orientation == no_orientation)
+                    continue;
+
+                if (primary < 0)
+                    primary = orientation;
+                used[orientation] = true;
+
+                auto const corner = c - 3 * t;
+                vec3 const next = load3(positions[indices[3 * t + (corner + 1) % 3]]);
+                vec3 const previous = load3(positions[indices[3 * t + (corner + 2) % 3]]);
+
+                vec3 const e1 = normalized(project(next - position, normal));
+                vec3 const e2 = normalized(project(previous - position, normal));
+                float const angle = std::acos(std::clamp(dot(e1, e2), -1.f, 1.f));
+
+                vec3 const tangent = normalized(project(triangle_tangent[t], normal));
+                for (int i = 0; i < 3; ++i)
+                    sum[orientation][i] += angle * tangent[i];
+            }
+
+            if (primary < 0)
+                primary = 1;
+
+            auto frame = [&](int orientation){
+                vec3 tangent = normalized(sum[orientation]);
+                if (tangent == vec3{0.f, 0.f, 0.f})
+                    tangent = any_tangent(normal);
+                return std::array<float, 4>{tangent[0], tangent[1], tangent[2], orientation ? 1.f : -1.f};
+            };
+
+            result.tangents[v] = frame(primary);
+
+            int const secondary = 1 - primary;
+            if (!used[secondary])
+                continue;
+
+            new_vertices.push_back({std::uint32_t(v), frame(secondary)});
+            for (auto s = begin; s < end; ++s)
+                moved[s] = (triangle_orientation[corners[s] / 3] == secondary);
+        }
+    });
+
+    std::vector<std::size_t> range_first_vertex(chunk_count);
+    std::size_t split_count = vertex_count;
+    for (std::size_t range = 0; range < chunk_count; ++range)
+    {
+        range_first_vertex[range] = split_count;
+        split_count += range_new_vertices[range].size();
+    }
+
+    if (split_count > std::size_t(std::numeric_limits<Index>::max()) + 1)
+        throw std::runtime_error("Splitting vertices for tangents overflows the index type");
+
+    result.tangents.resize(split_count);
+    result.split_vertices.resize(split_count - vertex_count);
+
+    run_parallel(chunk_count, [&](std::size_t range){
+        auto first = range_first_vertex[range];
+
+        for (auto const & vertex : range_new_vertices[range])
+        {
+            result.tangents[first] = vertex.tangent;
+            result.split_vertices[first - vertex_count] = vertex.source;
+
+            for (auto s = vertex_offset[vertex.source]; s < vertex_offset[vertex.source + 1]; ++s)
+                if (moved[s])
+                    indices[corners[s]] = Index(first);
+            ++first;
+        }
+    });
+
+    return result;
+}
+
+template generated_tangents generate_tangents<std::uint8_t>(std::span<std::uint8_t>, vertex_stream, vertex_stream, vertex_stream, std::size_t, unsigned int);
+template generated_tangents generate_tangents<std::uint16_t>(std::span<std::uint16_t>, vertex_stream, vertex_stream, vertex_stream, std::size_t, unsigned int);
+template generated_tangents generate_tangents<std::uint32_t>(std::span<std::uint32_t>, vertex_stream, vertex_stream, vertex_stream, std::size_t, unsigned int);
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <span>
+#include <array>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Per-vertex tangent frames for normal mapping, following MikkTSpace: every triangle
+// gets a tangent from its texture coordinate derivatives, which each corner projects
+// onto the plane of its vertex normal and weights by the corner angle. The corners of
+// a vertex are averaged separately for the two texture orientations (mirrored UVs),
+// and a vertex used with both gets split. The tangent's w is the bitangent sign, so
+// a shader reconstructs bitangent = w * cross(normal, tangent.xyz).
+
+// Strided view of a float attribute, stride in bytes
+struct vertex_stream
+{
+    float const * data;
+    std::size_t stride;
+
+    float const * operator[](std::size_t vertex) const
+    {
+        return reinterpret_cast<float const *>(reinterpret_cast<char const *>(data) + vertex * stride);
+    }
+};
+
+struct generated_tangents
+{
+    // Tangent and bitangent sign of every vertex, including the split ones
+    std::vector<std::array<float, 4>> tangents;
+    // Source vertex of each vertex added by splitting; they are numbered from the source
+    // vertex count on, and the indices of the corners using them are already updated
+    std::vector<std::uint32_t> split_vertices;
+};
+
+// Throws if split vertices would not fit the index type. The result does not depend on
+// thread_count (0 meaning all hardware threads)
+template <typename Index>
+generated_tangents generate_tangents(std::span<Index> indices, vertex_stream positions, vertex_stream normals, vertex_stream texcoords,
+    std::size_t vertex_count, unsigned int thread_count = 1);
+
+// Convenience overload for meshes like obj_data: appends the split vertices and fills
+// mesh.tangents; returns the number of split vertices. Normals must be final already
+template <typename Mesh>
+std::size_t generate_tangents(Mesh & mesh, unsigned int thread_count = 1)
+{
+    if (mesh.vertices.empty())
+    {
+        mesh.tangents.clear();
+        return 0;
+    }
+
+    std::size_t const stride = sizeof(mesh.vertices[0]);
+    auto const & first = mesh.vertices[0];
+
+    auto result = generate_tangents(std::span(mesh.indices), {first.position.data(), stride}, {first.normal.data(), stride},
+        {first.texcoord.data(), stride}, mesh.vertices.size(), thread_count);
+
+    mesh.vertices.reserve(mesh.vertices.size() + result.split_vertices.size());
+    for (auto v : result.split_vertices)
+        mesh.vertices.push_back(mesh.vertices[v]);
+
+    mesh.tangents = std::move(result.tangents);
+    return result.split_vertices.size();
+}
@@ -0,0 +1,296 @@
+#include "texture_cache.hpp"
+
+#include <bit>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+namespace
+{
+
+    constexpr char texture_cache_magic[8] = {'T', 'E', 'X', 'C', 'A', 'C', 'H', 'E'};
+    constexpr std::uint32_t texture_cache_endian_tag = 0x01020304;
+
+    std::size_t align_up(std::size_t offset)
+    {
+        return (offset + mesh_cache_alignment - 1) / mesh_cache_alignment * mesh_cache_alignment;
+    }
+
+    std::size_t level_size(std::uint32_t width, std::uint32_t height)
+    {
+        return std::size_t(width) * height * 4;
+    }
+
+    std::size_t mip_level_count(std::uint32_t width, std::uint32_t height)
+    {
+        return std::bit_width(std::max(width, height));
+    }
+
+    // Halves one level into the next. Source texels are split into target_size runs
+    // of 2, or 3 for the last run of an odd size
+    void downsample(unsigned char const * source, std::uint32_t width, std::uint32_t height,
+        unsigned char * target, std::uint32_t target_width, std::uint32_t target_height)
+    {
+        auto run_end = [](std::uint32_t i, std::uint32_t size, std::uint32_t target_size){
+            return (i + 1 == target_size) ? size : 2 * i + 2;
+        };
+
+        auto average = [](unsigned char const * row, std::size_t stride, std::uint32_t columns, std::uint32_t rows, unsigned char * texel){
+            std::uint32_t const count = columns * rows;
+            for (int c = 0; c < 4; ++c)
+            {
+                std::uint32_t sum = 0;
+                for (std::uint32_t y = 0; y < rows; ++y)
+                    for (std::uint32_t x = 0; x < columns; ++x)
+                        sum += row[y * stride + 4 * x + c];
+                texel[c] = (sum + count / 2) / count;
+            }
+        };
+
+        std::size_t const stride = std::size_t(width) * 4;
+
+        // Every column but the last of an odd width covers exactly 2 source columns
+        std::uint32_t const regular_columns = (width % 2 == 0 || width == 1) ? target_width : target_width - 1;
+
+        for (std::uint32_t y = 0; y < target_height; ++y)
+        {
+            std::uint32_t const rows = run_end(y, height, target_height) - 2 * y;
+            auto row = source + std::size_t(2 * y) * stride;
+            auto texel = target + std::size_t(y) * target_width * 4;
+
+            if (rows == 2 && width > 1)
+            {
+                for (std::uint32_t x = 0; x < regular_columns; ++x, row += 8, texel += 4)
+                    for (int c = 0; c < 4; ++c)
+                        texel[c] = (row[c] + row[c + 4] + row[stride + c] + row[stride + c + 4] + 2) / 4;
+            }
+            else
+            {
+                std::uint32_t const columns = std::min(width, 2u);
+                for (std::uint32_t x = 0; x < regular_columns; ++x, row += 8, texel += 4)
+                    average(row, stride, columns, rows, texel);
+            }
+
+            if (regular_columns < target_width)
+                average(row, stride, width - 2 * regular_columns, rows, texel);
+        }
+    }
+
+}
+
+std::vector<std::array<std::uint32_t, 2>> build_mip_chain(std::vector<unsigned char> & pixels, std::uint32_t width, std::uint32_t height)
+{
+    if (pixels.size() != level_size(width, height))
+        throw std::runtime_error("Image size does not match its pixels");
+
+    std::vector<std::array<std::uint32_t, 2>> result{{width, height}};
+    std::size_t total = pixels.size();
+    while (width > 1 || height > 1)
+    {
+        width = std::max(1u, width / 2);
+        height = std::max(1u, height / 2);
+        result.push_back({width, height});
+        total += level_size(width, height);
+    }
+
+    pixels.resize(total);
+
+    std::size_t offset = 0;
+    for (std::size_t i = 1; i < result.size(); ++i)
+    {
+        auto const [source_width, source_height] = result[i - 1];
+        std::size_t const next = offset + level_size(source_width, source_height);
+        downsample(pixels.data() + offset, source_width, source_height, pixels.data() + next, result[i][0], result[i][1]);
+        offset = next;
+    }
+
+    return result;
+}
+
+std::filesystem::path texture_cache_path(std::filesystem::path const & source_path, std::filesystem::path const & cache_directory)
+{
+    return mesh_cache_path(source_path, cache_directory).replace_extension(".texture");
+}
+
+void write_texture_cache(std::filesystem::path const & cache_path, cached_texture const & texture)
+{
+    static_assert(std::endian::native == std::endian::little, "texture cache is stored little-endian");
+
+    std::vector<texture_cache_level> levels;
+
+    std::size_t offset = sizeof(texture_cache_header) + texture.levels.size() * sizeof(texture_cache_level) + texture.source_path.size();
+    for (auto const & level : texture.levels)
+    {
+        offset = align_up(offset);
+        levels.push_back({level.width, level.height, offset, level.pixels.size()});
+        offset += level.pixels.size();
+    }
+
+    texture_cache_header header{};
+    std::memcpy(header.magic, texture_cache_magic, sizeof(header.magic));
+    header.version = texture_cache_version;
+    header.endian_tag = texture_cache_endian_tag;
+    header.level_count = levels.size();
+    header.source_path_size = texture.source_path.size();
+    header.source = texture.source;
+
+    std::vector<char> image(offset, 0);
+    char * tables = image.data() + sizeof(texture_cache_header);
+    std::memcpy(tables, levels.data(), levels.size() * sizeof(texture_cache_level));
+    std::memcpy(tables + levels.size() * sizeof(texture_cache_level), texture.source_path.data(), texture.source_path.size());
+    for (std::size_t i = 0; i < levels.size(); ++i)
+        std::memcpy(image.data() + levels[i].offset, texture.levels[i].pixels.data(), levels[i].size);
+
+    header.checksum = mesh_cache_hash(image.data() + sizeof(header), image.size() - sizeof(header));
+    std::memcpy(image.data(), &header, sizeof(header));
+
+    std::filesystem::create_directories(cache_path.parent_path());
+
+    auto temporary_path = cache_path;
+    temporary_path += ".tmp";
+
+    {
+        std::ofstream output(temporary_path, std::ios::binary | std::ios::trunc);
+        output.write(image.data(), image.size());
+        if (!output)
+            throw std::runtime_error("Failed to write texture cache " + temporary_path.string());
+    }
+
+    std::filesystem::rename(temporary_path, cache_path);
+}
+
+std::optional<cached_texture> read_texture_cache(std::filesystem::path const & cache_path)
+{
+    std::error_code error;
+    if (!std::filesystem::is_regular_file(cache_path, error))
+        return std::nullopt;
+
+    cached_texture result;
+
+    try
+    {
+        result.file = mapped_file(cache_path);
+    }
+    catch (std::runtime_error const &)
+    {
+        return std::nullopt;
+    }
+
+    auto const & file = result.file;
+
+    if (file.size() < sizeof(texture_cache_header))
+        return std::nullopt;
+
+    texture_cache_header header;
+    std::memcpy(&header, file.data(), sizeof(header));
+
+    if (std::memcmp(header.magic, texture_cache_magic, sizeof(header.magic)) != 0
+        || header.version != texture_cache_version
+        || header.endian_tag != texture_cache_endian_tag
+        || header.level_count == 0)
+        return std::nullopt;
+
+    std::size_t const tables_size = std::size_t(header.level_count) * sizeof(texture_cache_level) + header.source_path_size;
+    if (tables_size > file.size() - sizeof(header))
+        return std::nullopt;
+
+    if (header.checksum != mesh_cache_hash(file.data() + sizeof(header), file.size() - sizeof(header)))
+        return std::nullopt;
+
+    std::vector<texture_cache_level> levels(header.level_count);
+    std::memcpy(levels.data(), file.data() + sizeof(header), levels.size() * sizeof(texture_cache_level));
+    result.source_path.assign(file.data() + sizeof(header) + levels.size() * sizeof(texture_cache_level), header.source_path_size);
+
+    for (auto const & level : levels)
+    {
+        if (level.offset % mesh_cache_alignment != 0 || level.offset > file.size() || level.size > file.size() - level.offset
+            || level.size != level_size(level.width, level.height))
+            return std::nullopt;
+
+        auto const pixels = reinterpret_cast<unsigned char const *>(file.data() + level.offset);
+        result.levels.push_back({level.width, level.height, {pixels, level.size}});
+    }
+
+    result.source = header.source;
+    result.from_cache = true;
+    return result;
+}
+
+cached_texture load_texture_cached(std::filesystem::path const & path, texture_decode_function const & decode, texture_cache_options const & options)
+{
+    auto const source_path = std::filesystem::absolute(path).lexically_normal().string();
+    auto const cache_path = texture_cache_path(path, options.cache_directory);
+
+    auto key = mesh_cache_stat(path);
+
+    mapped_file source;
+
+    auto hash_source = [&]{
+        source = mapped_file(path);
+        key.content_hash = mesh_cache_hash(source.data(), source.size());
+    };
+
+    // The cache is only an optimization, failing to update it is not an error
+    auto try_write = [&](cached_texture const & texture){
+        try
+        {
+            write_texture_cache(cache_path, texture);
+        }
+        catch (std::exception const &)
+        {}
+    };
+
+    if (auto cached = read_texture_cache(cache_path); cached && cached->source_path == source_path
+        && cached->source.size == key.size
+        && (!options.generate_mipmaps || cached->levels.size() == mip_level_count(cached->levels[0].width, cached->levels[0].height)))
+    {
+        bool hit = cached->source.mtime == key.mtime;
+        if (!hit)
+        {
+            // The file was touched, but may still have the same contents
+            hash_source();
+            hit = cached->source.content_hash == key.content_hash;
+            if (hit)
+            {
+                cached->source = key;
+                try_write(*cached);
+            }
+        }
+
+        // An entry with a mip chain also serves requests without one
+        if (hit)
+        {
+            if (!options.generate_mipmaps)
+                cached->levels.resize(1);
+            return std::move(*cached);
+        }
+    }
+
+    if (!source.data())
+        hash_source();
+
+    auto image = decode({reinterpret_cast<unsigned char const *>(source.data()), source.size()});
+
+    cached_texture result;
+    std::vector<std::array<std::uint32_t, 2>> sizes{{image.width, image.height}};
+    if (options.generate_mipmaps)
+        sizes = build_mip_chain(image.pixels, image.width, image.height);
+    else if (image.pixels.size() != level_size(image.width, image.height))
+        throw std::runtime_error("Image size does not match its pixels");
+
+    result.storage = std::move(image.pixels);
+
+    std::size_t offset = 0;
+    for (auto const [width, height] : sizes)
+    {
+        result.levels.push_back({width, height, {result.storage.data() + offset, level_size(width, height)}});
+        offset += level_size(width, height);
+    }
+
+    result.source_path = source_path;
+    result.source = key;
+
+    try_write(result);
+
+    return result;
+}
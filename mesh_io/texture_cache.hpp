@@ -0,0 +1,115 @@
+#pragma once
+
+#include "mapped_file.hpp"
+#include "mesh_cache.hpp"
+
+#include <span>
+#include <array>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <optional>
+#include <functional>
+#include <filesystem>
+
+// Binary container for a decoded RGBA8 image with its mip chain, so that a warm
+// start maps the levels and uploads them without decoding anything.
+//
+// Layout (little-endian):
+//   texture_cache_header
+//   texture_cache_level[level_count]
+//   source path
+//   level pixels, each aligned to mesh_cache_alignment bytes
+//
+// The checksum covers everything after the header, and the source key validates
+// the entry against the image file exactly as for meshes.
+
+constexpr std::uint32_t texture_cache_version = 1;
+
+struct texture_cache_header
+{
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t endian_tag;
+    std::uint32_t level_count;
+    std::uint32_t source_path_size;
+    mesh_cache_source_key source;
+    std::uint64_t checksum;
+};
+
+struct texture_cache_level
+{
+    std::uint32_t width;
+    std::uint32_t height;
+    std::uint64_t offset;
+    std::uint64_t size;
+};
+
+// RGBA8 pixels, rows in the order they were decoded
+struct texture_image
+{
+    std::uint32_t width = 0;
+    std::uint32_t height = 0;
+    std::vector<unsigned char> pixels;
+};
+
+// Turns the contents of an image file into RGBA8 pixels; supplied by the caller,
+// which owns the image decoder (stb_image in the practices)
+using texture_decode_function = std::function<texture_image(std::span<unsigned char const> encoded)>;
+
+// Texture loaded through the cache. The level pixels point either into the mapped
+// cache file or into freshly built storage, and can be handed to glTexImage2D
+struct cached_texture
+{
+    struct level
+    {
+        std::uint32_t width;
+        std::uint32_t height;
+        std::span<unsigned char const> pixels;
+    };
+
+    // Level 0 is the image itself, the others halve it down to 1x1
+    std::vector<level> levels;
+
+    std::string source_path;
+    mesh_cache_source_key source;
+    bool from_cache = false;
+
+    // Storage backing the levels
+    mapped_file file;
+    std::vector<unsigned char> storage;
+
+    cached_texture() = default;
+    cached_texture(cached_texture &&) = default;
+    cached_texture & operator = (cached_texture &&) = default;
+
+    cached_texture(cached_texture const &) = delete;
+    cached_texture & operator = (cached_texture const &) = delete;
+};
+
+struct texture_cache_options
+{
+    std::filesystem::path cache_directory = default_mesh_cache_directory();
+    // Store the full mip chain rather than the image alone
+    bool generate_mipmaps = true;
+};
+
+// Appends the mip levels of an RGBA8 image to pixels, which holds level 0, and returns
+// the size of every level including the first. Sizes are halved and rounded down like
+// glGenerateMipmap does; every texel is the box-filtered average of the 2 or 3 texels
+// it covers in each direction, in the stored (not linearized) space, also like it
+std::vector<std::array<std::uint32_t, 2>> build_mip_chain(std::vector<unsigned char> & pixels, std::uint32_t width, std::uint32_t height);
+
+// Cache file used for the given image, next to the mesh entries
+std::filesystem::path texture_cache_path(std::filesystem::path const & source_path, std::filesystem::path const & cache_directory);
+
+// Writes the cache atomically (through a temporary file and a rename)
+void write_texture_cache(std::filesystem::path const & cache_path, cached_texture const & texture);
+
+// Maps a cache file; returns nothing if it is missing, truncated, corrupted or of another version
+std::optional<cached_texture> read_texture_cache(std::filesystem::path const & cache_path);
+
+// Loads an image through the cache: a valid entry is memory-mapped, otherwise the file
+// is decoded with decode, its mip chain is built and the entry is (re)written. Entries
+// are validated like those of load_obj_cached
+cached_texture load_texture_cached(std::filesystem::path const & path, texture_decode_function const & decode, texture_cache_options const & options = {});
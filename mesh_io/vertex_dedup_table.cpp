@@ -0,0 +1,78 @@
+#include "vertex_dedup_table.hpp"
+
+#include <bit>
+#include <algorithm>
+
+namespace
+{
+
+    // The table is kept at most 3/4 full
+    std::size_t capacity_for(std::size_t size)
+    {
+        return std::bit_ceil(std::max<std::size_t>(16, size + size / 3 + 1));
+    }
+
+}
+
+vertex_dedup_table::vertex_dedup_table(std::size_t expected_size)
+{
+    rehash(capacity_for(expected_size));
+}
+
+void vertex_dedup_table::reserve(std::size_t expected_size)
+{
+    if (capacity_for(expected_size) > slots_.size())
+        rehash(capacity_for(expected_size));
+}
+
+std::pair<std::uint32_t, bool> vertex_dedup_table::insert(key const & k, std::uint32_t value)
+{
+    if ((size_ + 1) * 4 > slots_.size() * 3)
+        rehash(slots_.size() * 2);
+
+    std::size_t const mask = slots_.size() - 1;
+
+    for (std::size_t i = bucket(k);; i = (i + 1) & mask)
+    {
+        auto & s = slots_[i];
+
+        if (s.value == empty)
+        {
+            s.k = k;
+            s.value = value;
+            ++size_;
+            return {value, true};
+        }
+
+        if (s.k == k)
+            return {s.value, false};
+    }
+}
+
+void vertex_dedup_table::clear()
+{
+    std::fill(slots_.begin(), slots_.end(), slot{});
+    size_ = 0;
+}
+
+std::size_t vertex_dedup_table::bucket(key const & k) const
+{
+    // Fibonacci hashing: the high bits of the product are well mixed
+    std::uint64_t h = std::uint32_t(k[0]);
+    h = h * 0x9E3779B97F4A7C15ull + std::uint32_t(k[1]);
+    h = h * 0x9E3779B97F4A7C15ull + std::uint32_t(k[2]);
+    h *= 0x9E3779B97F4A7C15ull;
+    return h >> shift_;
+}
+
+void vertex_dedup_table::rehash(std::size_t capacity)
+{
+    std::vector<slot> old_slots(capacity);
+    std::swap(old_slots, slots_);
+    shift_ = 64 - std::countr_zero(capacity);
+    size_ = 0;
+
+    for (auto const & s : old_slots)
+        if (s.value != empty)
+            insert(s.k, s.value);
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <array>
+#include <vector>
+#include <cstdint>
+#include <utility>
+
+// Flat open-addressing hash table mapping OBJ (position, texcoord, normal)
+// index triples to output vertex indices. Linear probing over a single
+// power-of-two array of 16-byte slots: no per-entry allocation, and a
+// lookup usually touches one cache line.
+struct vertex_dedup_table
+{
+    using key = std::array<std::int32_t, 3>;
+
+    explicit vertex_dedup_table(std::size_t expected_size = 0);
+
+    // Makes room for expected_size entries without rehashing
+    void reserve(std::size_t expected_size);
+
+    // Returns the value stored for k, or stores value if k is not present yet;
+    // the flag tells whether an insertion happened
+    std::pair<std::uint32_t, bool> insert(key const & k, std::uint32_t value);
+
+    std::size_t size() const { return size_; }
+    std::size_t capacity() const { return slots_.size(); }
+    std::size_t memory_usage() const { return slots_.capacity() * sizeof(slot); }
+
+    // Removes all entries, keeping the allocated slots
+    void clear();
+
+private:
+    static constexpr std::uint32_t empty = -1;
+
+    struct slot
+    {
+        key k;
+        std::uint32_t value = empty;
+    };
+
+    std::vector<slot> slots_;
+    std::size_t size_ = 0;
+    int shift_ = 64;
+
+    std::size_t bucket(key const & k) const;
+    void rehash(std::size_t capacity);
+};
@@ -0,0 +1,255 @@
+#include "vertex_quantization.hpp"
+
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <numbers>
+#include <algorithm>
+
+namespace
+{
+
+    // GL enum values, to avoid depending on GL headers here
+    constexpr unsigned int gl_float = 0x1406;
+    constexpr unsigned int gl_short = 0x1402;
+    constexpr unsigned int gl_unsigned_short = 0x1403;
+
+    constexpr float unorm16_max = 65535.f;
+    constexpr float snorm16_max = 32767.f;
+
+    std::uint16_t quantize_unorm16(float value, float offset, float scale)
+    {
+        if (scale <= 0.f)
+            return 0;
+        return std::uint16_t(std::clamp(std::round((value - offset) / scale * unorm16_max), 0.f, unorm16_max));
+    }
+
+    float dequantize_unorm16(std::uint16_t value, float offset, float scale)
+    {
+        return offset + value / unorm16_max * scale;
+    }
+
+    float dequantize_snorm16(std::int16_t value)
+    {
+        return std::max(value / snorm16_max, -1.f);
+    }
+
+    float length(std::array<float, 3> const & v)
+    {
+        return std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+    }
+
+    float distance(std::array<float, 3> const & a, std::array<float, 3> const & b)
+    {
+        return length({a[0] - b[0], a[1] - b[1], a[2] - b[2]});
+    }
+
+    float angle_degrees(std::array<float, 3> const & a, std::array<float, 3> const & b)
+    {
+        float const cosine = (a[0] * b[0] + a[1] * b[1] + a[2] * b[2]) / (length(a) * length(b));
+        return std::acos(std::clamp(cosine, -1.f, 1.f)) * 180.f / std::numbers::pi_v<float>;
+    }
+
+}
+
+std::array<std::int16_t, 2> encode_octahedral_normal(std::array<float, 3> const & normal)
+{
+    float const sum = std::abs(normal[0]) + std::abs(normal[1]) + std::abs(normal[2]);
+    if (sum == 0.f)
+        return {0, 0};
+
+    float x = normal[0] / sum;
+    float y = normal[1] / sum;
+
+    // Fold the lower hemisphere over the diagonals
+    if (normal[2] < 0.f)
+    {
+        float const fx = (1.f - std::abs(y)) * (x >= 0.f ? 1.f : -1.f);
+        float const fy = (1.f - std::abs(x)) * (y >= 0.f ? 1.f : -1.f);
+        x = fx;
+        y = fy;
+    }
+
+    // Rounding each component to nearest is not always the closest direction,
+    // so try the four neighbouring grid points
+    std::array<std::int16_t, 2> best{};
+    float best_error = std::numeric_limits<float>::infinity();
+
+    for (int i = 0; i < 4; ++i)
+    {
+        float const qx = (i & 1) ? std::ceil(x * snorm16_max) : std::floor(x * snorm16_max);
+        float const qy = (i & 2) ? std::ceil(y * snorm16_max) : std::floor(y * snorm16_max);
+
+        std::array<std::int16_t, 2> const candidate{
+            std::int16_t(std::clamp(qx, -snorm16_max, snorm16_max)),
+            std::int16_t(std::clamp(qy, -snorm16_max, snorm16_max)),
+        };
+
+        auto const decoded = decode_octahedral_normal(candidate);
+        float const error = 1.f - (decoded[0] * normal[0] + decoded[1] * normal[1] + decoded[2] * normal[2]) / length(normal);
+
+        if (error < best_error)
+        {
+            best_error = error;
+            best = candidate;
+        }
+    }
+
+    return best;
+}
+
+std::array<float, 3> decode_octahedral_normal(std::array<std::int16_t, 2> const & encoded)
+{
+    std::array<float, 3> n{dequantize_snorm16(encoded[0]), dequantize_snorm16(encoded[1]), 0.f};
+    n[2] = 1.f - std::abs(n[0]) - std::abs(n[1]);
+
+    float const t = std::max(-n[2], 0.f);
+    n[0] += (n[0] >= 0.f) ? -t : t;
+    n[1] += (n[1] >= 0.f) ? -t : t;
+
+    float const l = length(n);
+    return {n[0] / l, n[1] / l, n[2] / l};
+}
+
+obj_data::vertex unpack_vertex(packed_vertex const & vertex, vertex_dequantization const & dequantization)
+{
+    obj_data::vertex result;
+
+    for (int i = 0; i < 3; ++i)
+        result.position[i] = dequantize_unorm16(vertex.position[i], dequantization.position_offset[i], dequantization.position_scale[i]);
+
+    result.normal = decode_octahedral_normal(vertex.normal);
+
+    for (int i = 0; i < 2; ++i)
+        result.texcoord[i] = dequantize_unorm16(vertex.texcoord[i], dequantization.texcoord_offset[i], dequantization.texcoord_scale[i]);
+
+    return result;
+}
+
+packed_vertices pack_vertices(std::span<obj_data::vertex const> vertices)
+{
+    packed_vertices result;
+
+    if (vertices.empty())
+        return result;
+
+    auto & dequantization = result.dequantization;
+
+    std::array<float, 3> position_min = vertices[0].position;
+    std::array<float, 3> position_max = position_min;
+    std::array<float, 2> texcoord_min = vertices[0].texcoord;
+    std::array<float, 2> texcoord_max = texcoord_min;
+
+    for (auto const & vertex : vertices)
+    {
+        for (int i = 0; i < 3; ++i)
+        {
+            position_min[i] = std::min(position_min[i], vertex.position[i]);
+            position_max[i] = std::max(position_max[i], vertex.position[i]);
+        }
+
+        for (int i = 0; i < 2; ++i)
+        {
+            texcoord_min[i] = std::min(texcoord_min[i], vertex.texcoord[i]);
+            texcoord_max[i] = std::max(texcoord_max[i], vertex.texcoord[i]);
+        }
+    }
+
+    for (int i = 0; i < 3; ++i)
+    {
+        dequantization.position_offset[i] = position_min[i];
+        dequantization.position_scale[i] = position_max[i] - position_min[i];
+    }
+
+    for (int i = 0; i < 2; ++i)
+    {
+        dequantization.texcoord_offset[i] = texcoord_min[i];
+        dequantization.texcoord_scale[i] = texcoord_max[i] - texcoord_min[i];
+    }
+
+    result.vertices.resize(vertices.size());
+
+    auto & error = result.error;
+    double position_error_sum = 0.0;
+    double normal_error_sum = 0.0;
+    std::size_t normal_count = 0;
+
+    for (std::size_t v = 0; v < vertices.size(); ++v)
+    {
+        auto const & source = vertices[v];
+        auto & packed = result.vertices[v];
+
+        for (int i = 0; i < 3; ++i)
+            packed.position[i] = quantize_unorm16(source.position[i], dequantization.position_offset[i], dequantization.position_scale[i]);
+        packed.position[3] = 0;
+
+        packed.normal = encode_octahedral_normal(source.normal);
+
+        for (int i = 0; i < 2; ++i)
+            packed.texcoord[i] = quantize_unorm16(source.texcoord[i], dequantization.texcoord_offset[i], dequantization.texcoord_scale[i]);
+
+        auto const decoded = unpack_vertex(packed, dequantization);
+
+        float const position_error = distance(decoded.position, source.position);
+        error.position_max = std::max(error.position_max, position_error);
+        position_error_sum += position_error;
+
+        if (length(source.normal) > 0.f)
+        {
+            float const normal_error = angle_degrees(decoded.normal, source.normal);
+            error.normal_max = std::max(error.normal_max, normal_error);
+            normal_error_sum += normal_error;
+            ++normal_count;
+        }
+
+        for (int i = 0; i < 2; ++i)
+            error.texcoord_max = std::max(error.texcoord_max, std::abs(decoded.texcoord[i] - source.texcoord[i]));
+    }
+
+    error.position_mean = position_error_sum / vertices.size();
+    if (normal_count > 0)
+        error.normal_mean = normal_error_sum / normal_count;
+
+    return result;
+}
+
+std::array<vertex_attribute, 3> const obj_vertex_attributes =
+{{
+    {0, 3, gl_float, false, offsetof(obj_data::vertex, position)},
+    {1, 3, gl_float, false, offsetof(obj_data::vertex, normal)},
+    {2, 2, gl_float, false, offsetof(obj_data::vertex, texcoord)},
+}};
+
+std::array<vertex_attribute, 3> const packed_vertex_attributes =
+{{
+    {0, 3, gl_unsigned_short, true, offsetof(packed_vertex, position)},
+    {1, 2, gl_short, true, offsetof(packed_vertex, normal)},
+    {2, 2, gl_unsigned_short, true, offsetof(packed_vertex, texcoord)},
+}};
+
+char const packed_vertex_glsl[] =
+R"(
+uniform vec3 position_offset;
+uniform vec3 position_scale;
+uniform vec2 texcoord_offset;
+uniform vec2 texcoord_scale;
+
+vec3 decode_position(vec3 packed_position)
+{
+    return position_offset + packed_position * position_scale;
+}
+
+vec3 decode_normal(vec2 packed_normal)
+{
+    vec3 n = vec3(packed_normal, 1.0 - abs(packed_normal.x) - abs(packed_normal.y));
+    float t = max(-n.z, 0.0);
+    n.x += (n.x >= 0.0) ? -t : t;
+    n.y += (n.y >= 0.0) ? -t : t;
+    return normalize(n);
+}
+
+vec2 decode_texcoord(vec2 packed_texcoord)
+{
+    return texcoord_offset + packed_texcoord * texcoord_scale;
+}
+)";
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "obj_parser.hpp"
+
+#include <span>
+#include <array>
+#include <vector>
+#include <cstdint>
+
+// Compact 16-byte alternative to obj_data::vertex:
+//   position: unorm16 x3 relative to the mesh bounds (the fourth component is padding)
+//   normal:   snorm16 x2 octahedral encoding
+//   texcoord: unorm16 x2 relative to the texcoord bounds
+struct packed_vertex
+{
+    std::array<std::uint16_t, 4> position;
+    std::array<std::int16_t, 2> normal;
+    std::array<std::uint16_t, 2> texcoord;
+};
+
+static_assert(sizeof(packed_vertex) == 16);
+
+// Decoding parameters: value = offset + normalized * scale
+struct vertex_dequantization
+{
+    std::array<float, 3> position_offset{};
+    std::array<float, 3> position_scale{};
+    std::array<float, 2> texcoord_offset{};
+    std::array<float, 2> texcoord_scale{};
+};
+
+// Maximum and mean errors of the decoded vertices against the originals
+struct quantization_error
+{
+    // In model units
+    float position_max = 0.f;
+    float position_mean = 0.f;
+    // In degrees, vertices without a normal are ignored
+    float normal_max = 0.f;
+    float normal_mean = 0.f;
+    float texcoord_max = 0.f;
+};
+
+struct packed_vertices
+{
+    std::vector<packed_vertex> vertices;
+    vertex_dequantization dequantization;
+    quantization_error error;
+};
+
+packed_vertices pack_vertices(std::span<obj_data::vertex const> vertices);
+
+obj_data::vertex unpack_vertex(packed_vertex const & vertex, vertex_dequantization const & dequantization);
+
+std::array<std::int16_t, 2> encode_octahedral_normal(std::array<float, 3> const & normal);
+std::array<float, 3> decode_octahedral_normal(std::array<std::int16_t, 2> const & encoded);
+
+// Vertex attribute layout, in glVertexAttribPointer terms
+struct vertex_attribute
+{
+    unsigned int location;
+    int size;
+    unsigned int type;
+    bool normalized;
+    std::size_t offset;
+};
+
+// Locations 0, 1 and 2 hold position, normal and texcoord in both layouts, so the
+// same VAO setup loop works for either vertex type with the matching stride
+extern std::array<vertex_attribute, 3> const obj_vertex_attributes;
+extern std::array<vertex_attribute, 3> const packed_vertex_attributes;
+
+// GLSL helpers for vertex shaders reading packed_vertex: the dequantization uniforms
+// and decode_position / decode_normal / decode_texcoord. Must be inserted after the
+// #version line; the uniforms are set from vertex_dequantization
+extern char const packed_vertex_glsl[];
@@ -25,7 +25,8 @@
 #include <glm/gtx/string_cast.hpp>
 
 #include "obj_parser.hpp"
-#include "stb_image.h"
+#include "index_compaction.hpp"
+#include "texture_upload.hpp"
 
 std::string to_string(std::string_view str)
 {
@@ -183,22 +184,10 @@ std::pair<std::vector<vertex>, std::vector<std::uint32_t>> generate_sphere(float
     return {std::move(vertices), std::move(indices)};
 }
 
+// Goes through the decoded texture cache and uploads every level of its mip chain
 GLuint load_texture(std::string const & path)
 {
-    int width, height, channels;
-    auto pixels = stbi_load(path.data(), &width, &height, &channels, 4);
-
-    GLuint result;
-    glGenTextures(1, &result);
-    glBindTexture(GL_TEXTURE_2D, result);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glGenerateMipmap(GL_TEXTURE_2D);
-
-    stbi_image_free(pixels);
-
-    return result;
+    return upload_texture(load_texture_cached(path, decode_image));
 }
 
 int main() try
@@ -257,17 +246,19 @@ int main() try
     glBindVertexArray(sphere_vao);
     glGenBuffers(1, &sphere_vbo);
     glGenBuffers(1, &sphere_ebo);
-    GLuint sphere_index_count;
+    compact_index_buffer sphere_index_buffer;
     {
         auto [vertices, indices] = generate_sphere(1.f, 16);
 
+        append_indices(sphere_index_buffer, indices, vertices.size());
+        if (!sphere_index_buffer.vertex_remap.empty())
+            vertices = split_vertices<vertex>(vertices, sphere_index_buffer);
+
         glBindBuffer(GL_ARRAY_BUFFER, sphere_vbo);
         glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(vertices[0]), vertices.data(), GL_STATIC_DRAW);
 
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphere_ebo);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(indices[0]), indices.data(), GL_STATIC_DRAW);
-
-        sphere_index_count = indices.size();
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sphere_index_buffer.indices.size() * sizeof(std::uint16_t), sphere_index_buffer.indices.data(), GL_STATIC_DRAW);
     }
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vertex), (void *)offsetof(vertex, position));
@@ -370,7 +361,8 @@ int main() try
         glBindTexture(GL_TEXTURE_2D, albedo_texture);
 
         glBindVertexArray(sphere_vao);
-        glDrawElements(GL_TRIANGLES, sphere_index_count, GL_UNSIGNED_INT, nullptr);
+        for (auto const & part : sphere_index_buffer.parts)
+            glDrawElementsBaseVertex(GL_TRIANGLES, part.index_count, GL_UNSIGNED_SHORT, (void *)(part.index_offset * sizeof(std::uint16_t)), part.base_vertex);
 
         SDL_GL_SwapWindow(window);
     }
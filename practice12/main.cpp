@@ -168,7 +168,7 @@ static glm::vec3 cube_vertices[]
     {1.f, 1.f, 1.f},
 };
 
-static std::uint32_t cube_indices[]
+static std::uint16_t cube_indices[]
 {
 	// -Z
 	0, 2, 1,
@@ -359,7 +359,7 @@ int main() try
         glUniform3fv(light_direction_location, 1, reinterpret_cast<float *>(&light_direction));
 
         glBindVertexArray(vao);
-        glDrawElements(GL_TRIANGLES, std::size(cube_indices), GL_UNSIGNED_INT, nullptr);
+        glDrawElements(GL_TRIANGLES, std::size(cube_indices), GL_UNSIGNED_SHORT, nullptr);
 
         SDL_GL_SwapWindow(window);
     }
@@ -0,0 +1,120 @@
+#include "animation.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+void skeleton_pose::resize(std::size_t bone_count)
+{
+    translations.resize(bone_count, glm::vec3(0.f));
+    rotations.resize(bone_count, glm::quat(1.f, 0.f, 0.f, 0.f));
+    scales.resize(bone_count, glm::vec3(1.f));
+}
+
+void pose_batch::resize(std::size_t bone_count, std::size_t instance_count)
+{
+    this->bone_count = bone_count;
+    this->instance_count = instance_count;
+    values.assign(block_count() * bone_count * component_count * width, 0.f);
+
+    for (std::size_t block = 0; block < block_count(); ++block)
+        for (std::size_t bone = 0; bone < bone_count; ++bone)
+            for (auto c : {rotation_w, scale_x, scale_y, scale_z})
+                std::fill_n(lanes(block, bone, c), width, 1.f);
+}
+
+void pose_batch::set(std::size_t instance, std::size_t bone, glm::vec3 const & translation, glm::quat const & rotation, glm::vec3 const & scale)
+{
+    std::size_t const block = instance / width;
+    std::size_t const lane = instance % width;
+
+    float * const base = lanes(block, bone, translation_x) + lane;
+    float const components[component_count] = {
+        translation.x, translation.y, translation.z,
+        rotation.x, rotation.y, rotation.z, rotation.w,
+        scale.x, scale.y, scale.z,
+    };
+    for (std::size_t c = 0; c < component_count; ++c)
+        base[c * width] = components[c];
+}
+
+void pose_batch::set(std::size_t instance, skeleton_pose const & pose)
+{
+    for (std::size_t bone = 0; bone < bone_count; ++bone)
+        set(instance, bone, pose.translations[bone], pose.rotations[bone], pose.scales[bone]);
+}
+
+float rotation_difference(glm::quat const & a, glm::quat const & b)
+{
+    // atan2 of the relative rotation stays accurate for small angles, unlike acos of the dot product
+    auto const difference = a * glm::conjugate(b);
+    return 2.f * std::atan2(glm::length(glm::vec3(difference.x, difference.y, difference.z)), std::abs(difference.w));
+}
+
+float animation_error::max() const
+{
+    return std::max({translation, rotation, scale});
+}
+
+namespace
+{
+
+    // Frame to the left of the time, and the position between it and the next one
+    std::pair<std::size_t, float> locate_frame(resampled_animation const & animation, float time)
+    {
+        if (animation.frame_count < 2 || !(time > 0.f))
+            return {0, 0.f};
+
+        float const position = std::min(time, animation.max_time) / animation.frame_duration;
+        std::size_t const frame = std::min<std::size_t>(position, animation.frame_count - 2);
+        return {frame, std::min(1.f, position - frame)};
+    }
+
+}
+
+void resampled_animation::sample(float time, skeleton_pose & pose) const
+{
+    pose.resize(bone_count);
+
+    auto const [frame, t] = locate_frame(*this, time);
+    std::size_t const next = std::min(frame + 1, frame_count - 1);
+
+    auto const t0 = translations.data() + frame * bone_count, t1 = translations.data() + next * bone_count;
+    auto const r0 = rotations.data() + frame * bone_count, r1 = rotations.data() + next * bone_count;
+    auto const s0 = scales.data() + frame * bone_count, s1 = scales.data() + next * bone_count;
+
+    for (std::size_t i = 0; i < bone_count; ++i)
+    {
+        pose.translations[i] = glm::lerp(t0[i], t1[i], t);
+        pose.rotations[i] = glm::slerp(r0[i], r1[i], t);
+        pose.scales[i] = glm::lerp(s0[i], s1[i], t);
+    }
+}
+
+void resampled_animation::sample(float time, pose_batch & batch, std::size_t instance) const
+{
+    auto const [frame, t] = locate_frame(*this, time);
+    std::size_t const next = std::min(frame + 1, frame_count - 1);
+
+    for (std::size_t i = 0; i < bone_count; ++i)
+    {
+        std::size_t const a = frame * bone_count + i;
+        std::size_t const b = next * bone_count + i;
+        batch.set(instance, i, glm::lerp(translations[a], translations[b], t), glm::slerp(rotations[a], rotations[b], t), glm::lerp(scales[a], scales[b], t));
+    }
+}
+
+void resampled_animation::sample_bone(float time, std::size_t bone, glm::vec3 & translation, glm::quat & rotation, glm::vec3 & scale) const
+{
+    auto const [frame, t] = locate_frame(*this, time);
+    std::size_t const i = frame * bone_count + bone;
+    std::size_t const j = std::min(frame + 1, frame_count - 1) * bone_count + bone;
+
+    translation = glm::lerp(translations[i], translations[j], t);
+    rotation = glm::slerp(rotations[i], rotations[j], t);
+    scale = glm::lerp(scales[i], scales[j], t);
+}
+
+std::size_t resampled_animation::memory_usage() const
+{
+    return translations.size() * sizeof(glm::vec3) + rotations.size() * sizeof(glm::quat) + scales.size() * sizeof(glm::vec3);
+}
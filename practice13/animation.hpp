@@ -0,0 +1,106 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+#define GLM_FORCE_SWIZZLE
+#define GLM_ENABLE_EXPERIMENTAL
+#include <glm/vec3.hpp>
+#include <glm/gtx/quaternion.hpp>
+#include <glm/gtx/compatibility.hpp>
+
+// Local transforms of the bones of a skeleton, one array per component
+struct skeleton_pose
+{
+    std::vector<glm::vec3> translations;
+    std::vector<glm::quat> rotations;
+    std::vector<glm::vec3> scales;
+
+    std::size_t size() const { return translations.size(); }
+    void resize(std::size_t bone_count);
+};
+
+// Local transforms of many instances of one skeleton, for batched pose evaluation. Instances
+// are grouped in blocks of `width`, and every component of every bone of a block holds the
+// values of its instances side by side, so that one SIMD register loads a component for the
+// whole block. A block is bone-major: all components of its first bone, then of the second
+struct pose_batch
+{
+    static constexpr std::size_t width = 4;
+
+    enum component : std::size_t
+    {
+        translation_x, translation_y, translation_z,
+        rotation_x, rotation_y, rotation_z, rotation_w,
+        scale_x, scale_y, scale_z,
+        component_count,
+    };
+
+    std::size_t bone_count = 0;
+    std::size_t instance_count = 0;
+    std::vector<float> values;
+
+    std::size_t block_count() const { return (instance_count + width - 1) / width; }
+
+    // Padding instances of the last block get the identity transform
+    void resize(std::size_t bone_count, std::size_t instance_count);
+
+    // The `width` values of a component of a bone in a block
+    float * lanes(std::size_t block, std::size_t bone, component c) { return values.data() + ((block * bone_count + bone) * component_count + c) * width; }
+    float const * lanes(std::size_t block, std::size_t bone, component c) const { return values.data() + ((block * bone_count + bone) * component_count + c) * width; }
+
+    void set(std::size_t instance, std::size_t bone, glm::vec3 const & translation, glm::quat const & rotation, glm::vec3 const & scale);
+    void set(std::size_t instance, skeleton_pose const & pose);
+};
+
+struct resample_options
+{
+    // Frames per second to start from; the rate is doubled until the error is within
+    // tolerance or max_rate is reached
+    float rate = 30.f;
+    float max_rate = 240.f;
+
+    // Largest translation and scale error in model units, and rotation error in radians
+    float tolerance = 1e-3f;
+};
+
+// Angle of the rotation between two rotations, in radians
+float rotation_difference(glm::quat const & a, glm::quat const & b);
+
+// Largest difference to the keyframes, measured at every keyframe and halfway between them
+struct animation_error
+{
+    float translation = 0.f;
+    float rotation = 0.f;
+    float scale = 0.f;
+
+    float max() const;
+};
+
+// An animation resampled at a fixed rate, so that sampling is an index computation and one
+// lerp or slerp per channel instead of a binary search over every channel's timestamps.
+// Frames are stored time-major: frame f holds the bones of the time f * frame_duration
+// next to each other. Bones without keyframes for a channel keep the identity transform
+struct resampled_animation
+{
+    std::size_t bone_count = 0;
+    std::size_t frame_count = 0;
+    // max_time split into frame_count - 1 equal steps
+    float frame_duration = 0.f;
+    float max_time = 0.f;
+
+    // frame_count * bone_count values each
+    std::vector<glm::vec3> translations;
+    std::vector<glm::quat> rotations;
+    std::vector<glm::vec3> scales;
+
+    animation_error error;
+
+    // Samples every bone at the given time, clamped to [0, max_time], into a pose of bone_count bones
+    void sample(float time, skeleton_pose & pose) const;
+    void sample(float time, pose_batch & batch, std::size_t instance) const;
+
+    void sample_bone(float time, std::size_t bone, glm::vec3 & translation, glm::quat & rotation, glm::vec3 & scale) const;
+
+    std::size_t memory_usage() const;
+};
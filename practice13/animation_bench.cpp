@@ -0,0 +1,424 @@
+#include "gltf_loader.hpp"
+#include "animation.hpp"
+#include "pose_evaluation.hpp"
+#include "pose_graph.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtx/string_cast.hpp>
+
+// Compares sampling the animations of a glTF model (the wolf by default) through the
+// keyframe splines, the resampled tracks and the compressed keys, for a crowd of instances
+// each at its own time, then times the evaluation of their skinning palettes per skeleton with
+// glm against the batched evaluation, and finally runs a pose graph blending several clips for a
+// crowd on one thread against the crowd_animator workers, copying out the previous palettes
+// while each update runs as the render loop does, and skins the meshes on the CPU,
+// checked against the math of the skinning vertex shader:
+//
+//   animation_bench [--repeat N] [--instances N] [--skeletons N] [--threads N]
+//                   [--rate HZ] [--tolerance E] [file.gltf]
+//
+// Every stage reports the best of --repeat runs.
+
+namespace
+{
+
+    struct bench_options
+    {
+        int repeat = 5;
+        std::size_t instances = 1000;
+        std::size_t skeletons = 10000;
+        // 0 means all hardware threads
+        unsigned int thread_count = 0;
+        resample_options resample;
+        std::filesystem::path file = std::filesystem::path(PROJECT_ROOT) / "wolf" / "Wolf-Blender-2.82a.gltf";
+    };
+
+    bench_options parse_options(int argc, char ** argv)
+    {
+        bench_options options;
+
+        for (int i = 1; i < argc; ++i)
+        {
+            std::string const arg = argv[i];
+
+            auto value = [&]{
+                if (i + 1 == argc)
+                    throw std::runtime_error("Missing value for " + arg);
+                return std::string(argv[++i]);
+            };
+
+            if (arg == "--repeat")
+                options.repeat = std::max(1, std::stoi(value()));
+            else if (arg == "--instances")
+                options.instances = std::max(1ul, std::stoul(value()));
+            else if (arg == "--skeletons")
+                options.skeletons = std::max(1ul, std::stoul(value()));
+            else if (arg == "--threads")
+                options.thread_count = std::stoul(value());
+            else if (arg == "--rate")
+                options.resample.rate = std::stof(value());
+            else if (arg == "--tolerance")
+                options.resample.tolerance = std::stof(value());
+            else if (arg.starts_with("--"))
+                throw std::runtime_error("Unknown option " + arg);
+            else
+                options.file = arg;
+        }
+
+        options.resample.max_rate = std::max(options.resample.max_rate, options.resample.rate);
+
+        if (options.thread_count == 0)
+            options.thread_count = std::max(1u, std::thread::hardware_concurrency());
+
+        return options;
+    }
+
+    template <typename Function>
+    double best_time(int repeat, Function const & function)
+    {
+        double best = 0.0;
+        for (int i = 0; i < repeat; ++i)
+        {
+            auto const start = std::chrono::steady_clock::now();
+            function();
+            double const ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            if (i == 0 || ms < best)
+                best = ms;
+        }
+        return best;
+    }
+
+    std::size_t keyframe_memory(gltf_model::animation const & animation)
+    {
+        std::size_t result = 0;
+        for (auto const & bone : animation.bones)
+        {
+            result += (bone.translation.timestamps.size() + bone.rotation.timestamps.size() + bone.scale.timestamps.size()) * sizeof(float);
+            result += (bone.translation.values.size() + bone.scale.values.size()) * sizeof(glm::vec3) + bone.rotation.values.size() * sizeof(glm::quat);
+        }
+        return result;
+    }
+
+    // Spreads the instances over the animation so that they do not all hit the same keyframes
+    float instance_time(std::size_t instance, float max_time)
+    {
+        return std::fmod(instance * 0.0173f, std::max(max_time, 1e-3f));
+    }
+
+    // Sums the pose so that the compiler cannot drop the sampling
+    float checksum(skeleton_pose const & pose)
+    {
+        float result = 0.f;
+        for (std::size_t i = 0; i < pose.size(); ++i)
+            result += pose.translations[i].x + pose.rotations[i].w + pose.scales[i].y;
+        return result;
+    }
+
+    // The palette of one skeleton the straightforward way, as the reference for evaluate_poses
+    void evaluate_pose(skeleton const & skeleton, skeleton_pose const & pose, std::vector<glm::mat4> & globals, glm::mat4 * palette)
+    {
+        for (std::size_t i = 0; i < skeleton.size(); ++i)
+        {
+            glm::mat4 const local = glm::translate(glm::mat4(1.f), pose.translations[i]) * glm::toMat4(pose.rotations[i]) * glm::scale(glm::mat4(1.f), pose.scales[i]);
+            globals[i] = (skeleton.parents[i] == skeleton::no_parent) ? local : globals[skeleton.parents[i]] * local;
+            palette[i] = globals[i] * skeleton.inverse_bind_matrices[i];
+        }
+    }
+
+    void print_rate(char const * stage, double ms, std::size_t samples)
+    {
+        std::cout << "  " << stage << ": " << ms << " ms, " << samples / ms / 1e3 << " M channel samples/s" << std::endl;
+    }
+
+}
+
+int main(int argc, char ** argv) try
+{
+    auto const options = parse_options(argc, argv);
+
+    gltf_model model;
+    double const load_ms = best_time(1, [&]{ model = load_gltf(options.file, {.resample = options.resample, .compress = compression_options{}}); });
+    std::cout << options.file.string() << ": loaded with resampling and compression in " << load_ms << " ms" << std::endl;
+
+    std::size_t total_keyframe_memory = 0, total_compressed_memory = 0;
+
+    for (auto const & [name, animation] : model.animations)
+    {
+        auto const & resampled = model.resampled_animations.at(name);
+        auto const & compressed = model.compressed_animations.at(name);
+        std::size_t const bone_count = animation.bones.size();
+        std::size_t const samples = options.instances * bone_count * 3;
+
+        std::cout << "Animation " << name << ": " << bone_count << " bones, " << animation.max_time << " s, "
+            << resampled.frame_count << " frames at " << (resampled.frame_count - 1) / std::max(resampled.max_time, 1e-6f) << " Hz; "
+            << "error " << resampled.error.translation << " / " << resampled.error.rotation << " rad / " << resampled.error.scale << "; "
+            << keyframe_memory(animation) / 1024 << " KB of keyframes, " << resampled.memory_usage() / 1024 << " KB resampled" << std::endl;
+
+        std::size_t key_count = 0;
+        for (auto const & bone : animation.bones)
+            key_count += bone.translation.timestamps.size() + bone.rotation.timestamps.size() + bone.scale.timestamps.size();
+
+        std::cout << "  compressed: " << key_count << " -> " << compressed.key_count() << " keys, "
+            << compressed.memory_usage() / 1024 << " KB (" << float(keyframe_memory(animation)) / compressed.memory_usage() << "x smaller); "
+            << "error " << compressed.error.translation << " / " << compressed.error.rotation << " rad / " << compressed.error.scale << std::endl;
+
+        total_keyframe_memory += keyframe_memory(animation);
+        total_compressed_memory += compressed.memory_usage();
+
+        skeleton_pose pose;
+        pose.resize(bone_count);
+        float sum = 0.f;
+
+        double const spline_ms = best_time(options.repeat, [&]{
+            for (std::size_t instance = 0; instance < options.instances; ++instance)
+            {
+                float const time = instance_time(instance, animation.max_time);
+                for (std::size_t i = 0; i < bone_count; ++i)
+                {
+                    auto const & bone = animation.bones[i];
+                    if (!bone.translation.values.empty())
+                        pose.translations[i] = bone.translation(time);
+                    if (!bone.rotation.values.empty())
+                        pose.rotations[i] = bone.rotation(time);
+                    if (!bone.scale.values.empty())
+                        pose.scales[i] = bone.scale(time);
+                }
+                sum += checksum(pose);
+            }
+        });
+
+        double const resampled_ms = best_time(options.repeat, [&]{
+            for (std::size_t instance = 0; instance < options.instances; ++instance)
+            {
+                resampled.sample(instance_time(instance, animation.max_time), pose);
+                sum += checksum(pose);
+            }
+        });
+
+        double const compressed_ms = best_time(options.repeat, [&]{
+            for (std::size_t instance = 0; instance < options.instances; ++instance)
+            {
+                compressed.sample(instance_time(instance, animation.max_time), pose);
+                sum += checksum(pose);
+            }
+        });
+
+        print_rate("splines", spline_ms, samples);
+        print_rate("resampled", resampled_ms, samples);
+        print_rate("compressed", compressed_ms, samples);
+        std::cout << "  speedup " << spline_ms / resampled_ms << "x (checksum " << sum << ")" << std::endl;
+    }
+
+    std::cout << "All animations: " << total_keyframe_memory / 1024 << " KB of keyframes, " << total_compressed_memory / 1024 << " KB compressed ("
+        << float(total_keyframe_memory) / total_compressed_memory << "x smaller)" << std::endl;
+
+    // Every skeleton plays the first animation at its own time
+    if (!model.resampled_animations.empty())
+    {
+        auto const & [name, animation] = *model.resampled_animations.begin();
+        auto const skeleton = make_skeleton(model);
+        std::size_t const count = options.skeletons;
+        std::size_t const bone_count = skeleton.size();
+
+        std::vector<skeleton_pose> poses(count);
+        pose_batch batch;
+        batch.resize(bone_count, count);
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            animation.sample(instance_time(i, animation.max_time), poses[i]);
+            batch.set(i, poses[i]);
+        }
+
+        std::vector<glm::mat4> reference(count * bone_count);
+        std::vector<glm::mat3x4> palettes(count * bone_count);
+        std::vector<glm::mat4> globals(bone_count);
+
+        double const glm_ms = best_time(options.repeat, [&]{
+            for (std::size_t i = 0; i < count; ++i)
+                evaluate_pose(skeleton, poses[i], globals, reference.data() + i * bone_count);
+        });
+        double const batched_ms = best_time(options.repeat, [&]{ evaluate_poses(skeleton, batch, palettes, 1); });
+        double const threaded_ms = best_time(options.repeat, [&]{ evaluate_poses(skeleton, batch, palettes, options.thread_count); });
+
+        float error = 0.f;
+        for (std::size_t i = 0; i < palettes.size(); ++i)
+            for (int r = 0; r < 3; ++r)
+                for (int c = 0; c < 4; ++c)
+                    error = std::max(error, std::abs(palettes[i][r][c] - reference[i][c][r]));
+
+        auto print_skeletons = [&](char const * stage, double ms){
+            std::cout << "  " << stage << ": " << ms << " ms, " << count / ms * 1e3 << " skeletons/s" << std::endl;
+        };
+
+        std::cout << "Pose evaluation of " << count << " skeletons x " << bone_count << " bones playing " << name << ":" << std::endl;
+        print_skeletons("glm per skeleton", glm_ms);
+        print_skeletons("batched, 1 thread", batched_ms);
+        std::cout << "  batched, " << options.thread_count << " threads: " << threaded_ms << " ms, " << count / threaded_ms * 1e3 << " skeletons/s" << std::endl;
+        std::cout << "  largest difference to glm " << error << std::endl;
+    }
+
+    // Walk blended with run, creep added on top and the head playing idle
+    auto clip = [&](char const * name) -> resampled_animation const * {
+        auto it = model.resampled_animations.find(name);
+        return (it == model.resampled_animations.end()) ? nullptr : &it->second;
+    };
+    auto const * walk = clip("02_walk");
+    auto const * run = clip("01_Run");
+    auto const * creep = clip("03_creep");
+    auto const * idle = model.compressed_animations.contains("04_Idle") ? &model.compressed_animations.at("04_Idle") : nullptr;
+
+    if (walk && run && creep && idle)
+    {
+        auto const skeleton = make_skeleton(model);
+        std::size_t const count = options.skeletons;
+        std::size_t const bone_count = skeleton.size();
+
+        std::uint32_t head = 0;
+        for (std::size_t i = 0; i < model.bones.size(); ++i)
+            if (model.bones[i].name == "Hals_013")
+                head = i;
+
+        enum parameter : std::size_t { walk_time, run_time, speed, creep_time, creep_reference_time, creep_weight, idle_time, idle_weight };
+
+        pose_graph graph(bone_count);
+        auto const locomotion = graph.blend(graph.sample(walk, walk_time), graph.sample(run, run_time), speed);
+        auto const crouched = graph.additive(locomotion, graph.sample(creep, creep_time), graph.sample(creep, creep_reference_time, false), creep_weight);
+        graph.mask(crouched, graph.sample(idle, idle_time), subtree_mask(skeleton, head), idle_weight);
+
+        auto set_parameters = [&](std::size_t i, std::span<float> parameters){
+            parameters[walk_time] = instance_time(i, 10.f);
+            parameters[run_time] = parameters[walk_time] * 1.3f;
+            parameters[speed] = (i % 11) / 10.f;
+            parameters[creep_time] = parameters[walk_time];
+            parameters[creep_reference_time] = 0.f;
+            parameters[creep_weight] = (i % 3) / 2.f;
+            parameters[idle_time] = instance_time(i, idle->max_time);
+            parameters[idle_weight] = (i % 5) / 4.f;
+        };
+
+        std::vector<float> parameters(count * graph.parameter_count());
+        for (std::size_t i = 0; i < count; ++i)
+            set_parameters(i, std::span(parameters).subspan(i * graph.parameter_count(), graph.parameter_count()));
+
+        pose_graph::scratch scratch;
+        pose_batch batch;
+        batch.resize(bone_count, count);
+        std::vector<glm::mat3x4> reference(count * bone_count);
+
+        double const single_ms = best_time(options.repeat, [&]{
+            for (std::size_t i = 0; i < count; ++i)
+                batch.set(i, graph.evaluate(std::span(parameters).subspan(i * graph.parameter_count(), graph.parameter_count()), scratch));
+            evaluate_poses(skeleton, batch, reference, 1);
+        });
+
+        crowd_animator animator(graph, skeleton, count, options.thread_count);
+        for (std::size_t i = 0; i < count; ++i)
+            set_parameters(i, animator.parameters(i));
+
+        // Frames as the render loop runs them: the palettes of the previous update are copied
+        // out, as the upload does, while the workers fill the other buffer, and the front
+        // buffer must still match the copy when the update finishes
+        animator.start_update();
+        animator.finish_update();
+
+        std::vector<glm::mat3x4> uploaded(count * bone_count);
+        bool stable = true;
+        double wait_ms = 0.0;
+        double const animator_ms = best_time(options.repeat, [&]{
+            auto const front = animator.palettes();
+            animator.start_update();
+
+            std::copy(front.begin(), front.end(), uploaded.begin());
+            stable = stable && animator.palettes().data() == front.data();
+
+            auto const wait_start = std::chrono::steady_clock::now();
+            animator.finish_update();
+            wait_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - wait_start).count();
+
+            stable = stable && std::equal(front.begin(), front.end(), uploaded.begin());
+        });
+
+        if (!stable)
+            throw std::runtime_error("crowd_animator changed the front palettes during an update");
+
+        auto const palettes = animator.palettes();
+
+        float error = 0.f;
+        for (std::size_t i = 0; i < palettes.size(); ++i)
+            for (int r = 0; r < 3; ++r)
+                for (int c = 0; c < 4; ++c)
+                    error = std::max(error, std::abs(palettes[i][r][c] - reference[i][r][c]));
+
+        std::cout << "Pose graph of " << graph.node_count() << " nodes for " << count << " characters:" << std::endl;
+        std::cout << "  1 thread: " << single_ms << " ms, " << count / single_ms * 1e3 << " characters/s" << std::endl;
+        std::cout << "  crowd_animator, " << options.thread_count << " threads: " << animator_ms << " ms per frame, " << count / animator_ms * 1e3
+            << " characters/s, " << wait_ms / options.repeat << " ms of it waiting in finish_update on average" << std::endl;
+        std::cout << "  largest difference " << error << std::endl;
+    }
+
+    // One pose of the first animation, skinned on the CPU and as the vertex shader does
+    if (!model.resampled_animations.empty())
+    {
+        auto const & [name, animation] = *model.resampled_animations.begin();
+        auto const skeleton = make_skeleton(model);
+
+        pose_batch batch;
+        batch.resize(skeleton.size(), 1);
+        animation.sample(animation.max_time / 2.f, batch, 0);
+        std::vector<glm::mat3x4> palette(skeleton.size());
+        evaluate_poses(skeleton, batch, palette);
+
+        std::cout << "Skinning playing " << name << ":" << std::endl;
+        for (auto const & mesh : model.meshes)
+        {
+            auto const influences = read_influences(model, mesh);
+            std::size_t const count = influences.size();
+            std::vector<glm::vec3> positions(count), normals(count);
+
+            double const single_ms = best_time(options.repeat, [&]{ skin_mesh(model, mesh, influences, palette, positions, normals, 1); });
+            double const threaded_ms = best_time(options.repeat, [&]{ skin_mesh(model, mesh, influences, palette, positions, normals, options.thread_count); });
+
+            auto const * bind_positions = reinterpret_cast<glm::vec3 const *>(model.buffer.data() + mesh.position.view.offset);
+            auto const * bind_normals = reinterpret_cast<glm::vec3 const *>(model.buffer.data() + mesh.normal.view.offset);
+
+            float position_error = 0.f, normal_error = 0.f;
+            glm::vec3 bind_min(INFINITY), bind_max(-INFINITY), min(INFINITY), max(-INFINITY);
+            for (std::size_t v = 0; v < count; ++v)
+            {
+                // As written in the vertex shader
+                glm::mat3x4 matrix(0.f);
+                for (int k = 0; k < 4; ++k)
+                    matrix += influences[v].weights[k] * palette[influences[v].joints[k]];
+                glm::vec3 const position = glm::vec4(bind_positions[v], 1.f) * matrix;
+                glm::vec3 const normal = glm::normalize(glm::vec4(bind_normals[v], 0.f) * matrix);
+
+                position_error = std::max(position_error, glm::length(positions[v] - position));
+                normal_error = std::max(normal_error, glm::length(normals[v] - normal));
+
+                bind_min = glm::min(bind_min, bind_positions[v]);
+                bind_max = glm::max(bind_max, bind_positions[v]);
+                min = glm::min(min, positions[v]);
+                max = glm::max(max, positions[v]);
+            }
+
+            std::cout << "  " << mesh.name << ", " << count << " vertices: " << single_ms << " ms on 1 thread, " << threaded_ms << " ms on "
+                << options.thread_count << " threads, " << count / single_ms / 1e3 << " M vertices/s; difference to the shader "
+                << position_error << " / " << normal_error << " (normals); bounds " << glm::to_string(bind_max - bind_min) << " in bind pose, "
+                << glm::to_string(max - min) << " skinned" << std::endl;
+        }
+    }
+}
+catch (std::exception const & e)
+{
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+}
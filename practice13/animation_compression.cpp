@@ -0,0 +1,292 @@
+#include "animation_compression.hpp"
+
+#include <cmath>
+#include <limits>
+#include <numbers>
+#include <algorithm>
+
+namespace
+{
+
+    constexpr float quantization_steps = std::numeric_limits<std::uint16_t>::max();
+    constexpr float rotation_steps = 0x7fff;
+
+    // Components of the smallest three lie within +-1/sqrt(2)
+    constexpr float rotation_range = std::numbers::sqrt2_v<float>;
+
+    std::uint16_t quantize(float value, float steps)
+    {
+        return std::clamp(std::round(value * steps), 0.f, steps);
+    }
+
+    glm::vec3 decode_vector(compressed_animation::track const & track, std::uint16_t const * words)
+    {
+        return track.min + glm::vec3(words[0], words[1], words[2]) * (track.extent / quantization_steps);
+    }
+
+    float distance(glm::vec3 const & a, glm::vec3 const & b)
+    {
+        return glm::length(a - b);
+    }
+
+    float distance(glm::quat const & a, glm::quat const & b)
+    {
+        return rotation_difference(a, b);
+    }
+
+    glm::vec3 interpolate(glm::vec3 const & a, glm::vec3 const & b, float t)
+    {
+        return glm::lerp(a, b, t);
+    }
+
+    glm::quat interpolate(glm::quat const & a, glm::quat const & b, float t)
+    {
+        return glm::slerp(a, b, t);
+    }
+
+    // Indices of the keys to keep, so that interpolating between kept keys stays within the
+    // tolerance of the dropped keys and of the points halfway between the original keys.
+    // Each kept key reaches as far as possible, found by doubling then bisecting the span
+    template <typename T>
+    std::vector<std::size_t> reduce_keys(std::span<float const> times, std::span<T const> reference,
+        std::span<float const> decoded_times, std::span<T const> decoded, float tolerance)
+    {
+        std::size_t const count = times.size();
+
+        auto within = [&](std::size_t first, std::size_t last)
+        {
+            float const duration = decoded_times[last] - decoded_times[first];
+            if (!(duration > 0.f))
+                return false;
+
+            auto check = [&](float time, T const & expected)
+            {
+                float const t = std::clamp((time - decoded_times[first]) / duration, 0.f, 1.f);
+                return distance(interpolate(decoded[first], decoded[last], t), expected) <= tolerance;
+            };
+
+            for (std::size_t k = first; k < last; ++k)
+            {
+                if (k > first && !check(times[k], reference[k]))
+                    return false;
+                if (!check((times[k] + times[k + 1]) / 2.f, interpolate(reference[k], reference[k + 1], 0.5f)))
+                    return false;
+            }
+            return true;
+        };
+
+        std::vector<std::size_t> result{0};
+        for (std::size_t first = 0; first + 1 < count;)
+        {
+            std::size_t good = first + 1;
+            std::size_t bad = count;
+            for (std::size_t step = 2; first + step < count; step *= 2)
+            {
+                if (!within(first, first + step))
+                {
+                    bad = first + step;
+                    break;
+                }
+                good = first + step;
+            }
+
+            while (bad - good > 1)
+            {
+                std::size_t const middle = (good + bad) / 2;
+                if (within(first, middle))
+                    good = middle;
+                else
+                    bad = middle;
+            }
+
+            result.push_back(good);
+            first = good;
+        }
+        return result;
+    }
+
+    // Quantizes the keys, drops those the interpolation restores and appends the rest
+    template <typename T, typename Encode, typename Decode>
+    compressed_animation::track append_keys(compressed_animation & animation, compressed_animation::track track,
+        std::span<float const> timestamps, std::span<T const> values, float tolerance, Encode const & encode, Decode const & decode)
+    {
+        track.first_key = animation.times.size();
+
+        std::size_t const count = std::min(timestamps.size(), values.size());
+        if (count == 0)
+            return track;
+
+        std::vector<std::uint16_t> quantized_times(count);
+        std::vector<float> decoded_times(count);
+        std::vector<std::array<std::uint16_t, 3>> encoded(count);
+        std::vector<T> decoded(count);
+        for (std::size_t k = 0; k < count; ++k)
+        {
+            quantized_times[k] = quantize(timestamps[k] / animation.time_step / quantization_steps, quantization_steps);
+            decoded_times[k] = quantized_times[k] * animation.time_step;
+            encoded[k] = encode(values[k]);
+            decoded[k] = decode(encoded[k].data());
+        }
+
+        std::vector<std::size_t> kept;
+
+        // A constant channel is a single key, which samples like a spline with one keyframe
+        if (std::all_of(values.begin(), values.begin() + count, [&](T const & value){ return distance(decoded[0], value) <= tolerance; }))
+            kept = {0};
+        else
+            kept = reduce_keys<T>(timestamps.first(count), values.first(count), decoded_times, decoded, tolerance);
+
+        for (std::size_t k : kept)
+        {
+            animation.times.push_back(quantized_times[k]);
+            animation.values.insert(animation.values.end(), encoded[k].begin(), encoded[k].end());
+        }
+
+        track.key_count = kept.size();
+        return track;
+    }
+
+    // Interpolates a track like gltf_model::spline: before the first key and after the last
+    // one it holds the last key
+    template <typename T, typename Decode>
+    T sample_track(compressed_animation const & animation, compressed_animation::track const & track, float time, T const & identity, Decode const & decode)
+    {
+        if (track.key_count == 0)
+            return identity;
+
+        auto const begin = animation.times.begin() + track.first_key;
+        auto const end = begin + track.key_count;
+        auto const key = [&](std::size_t index){ return decode(animation.values.data() + 3 * (track.first_key + index)); };
+
+        float const position = time / animation.time_step;
+        auto const it = std::lower_bound(begin, end, position, [](std::uint16_t key, float position){ return key < position; });
+        if (it == begin || it == end)
+            return key(track.key_count - 1);
+
+        std::size_t const i = it - begin;
+        float const t = (position - it[-1]) / (it[0] - it[-1]);
+        return interpolate(key(i - 1), key(i), t);
+    }
+
+}
+
+std::array<std::uint16_t, 3> encode_rotation(glm::quat const & rotation)
+{
+    float components[4] = {rotation.x, rotation.y, rotation.z, rotation.w};
+
+    int largest = 0;
+    for (int i = 1; i < 4; ++i)
+        if (std::abs(components[i]) > std::abs(components[largest]))
+            largest = i;
+
+    float const sign = (components[largest] < 0.f) ? -1.f : 1.f;
+    float const length = std::sqrt(components[0] * components[0] + components[1] * components[1] + components[2] * components[2] + components[3] * components[3]);
+    float const scale = (length > 0.f) ? sign / length : 1.f;
+
+    std::array<std::uint16_t, 3> result;
+    for (int i = 0, j = 0; i < 4; ++i)
+        if (i != largest)
+            result[j++] = quantize((components[i] * scale) / rotation_range + 0.5f, rotation_steps);
+
+    result[0] |= (largest >> 1) << 15;
+    result[1] |= (largest & 1) << 15;
+    return result;
+}
+
+glm::quat decode_rotation(std::uint16_t const * words)
+{
+    int const largest = ((words[0] >> 15) << 1) | (words[1] >> 15);
+
+    float components[4];
+    float sum = 0.f;
+    for (int i = 0, j = 0; i < 4; ++i)
+    {
+        if (i == largest)
+            continue;
+        components[i] = ((words[j++] & 0x7fff) / rotation_steps - 0.5f) * rotation_range;
+        sum += components[i] * components[i];
+    }
+    components[largest] = std::sqrt(std::max(0.f, 1.f - sum));
+
+    return glm::quat(components[3], components[0], components[1], components[2]);
+}
+
+void compressed_animation::reset(std::size_t bone_count, float max_time)
+{
+    this->bone_count = bone_count;
+    this->max_time = max_time;
+    time_step = (max_time > 0.f) ? max_time / quantization_steps : 1.f;
+
+    translations.assign(bone_count, {});
+    rotations.assign(bone_count, {});
+    scales.assign(bone_count, {});
+    times.clear();
+    values.clear();
+    error = {};
+}
+
+compressed_animation::track compressed_animation::append_track(std::span<float const> timestamps, std::span<glm::vec3 const> values, float tolerance)
+{
+    track result;
+    if (!values.empty())
+    {
+        glm::vec3 max = values[0];
+        result.min = values[0];
+        for (auto const & value : values)
+        {
+            result.min = glm::min(result.min, value);
+            max = glm::max(max, value);
+        }
+        result.extent = max - result.min;
+    }
+
+    auto encode = [&](glm::vec3 const & value)
+    {
+        std::array<std::uint16_t, 3> words;
+        for (int c = 0; c < 3; ++c)
+            words[c] = (result.extent[c] > 0.f) ? quantize((value[c] - result.min[c]) / result.extent[c], quantization_steps) : 0;
+        return words;
+    };
+
+    auto decode = [&](std::uint16_t const * words){ return decode_vector(result, words); };
+
+    return append_keys<glm::vec3>(*this, result, timestamps, values, tolerance, encode, decode);
+}
+
+compressed_animation::track compressed_animation::append_track(std::span<float const> timestamps, std::span<glm::quat const> values, float tolerance)
+{
+    return append_keys<glm::quat>(*this, {}, timestamps, values, tolerance, encode_rotation, decode_rotation);
+}
+
+void compressed_animation::sample_bone(float time, std::size_t bone, glm::vec3 & translation, glm::quat & rotation, glm::vec3 & scale) const
+{
+    auto const & translation_track = translations[bone];
+    auto const & scale_track = scales[bone];
+
+    translation = sample_track(*this, translation_track, time, glm::vec3(0.f), [&](std::uint16_t const * words){ return decode_vector(translation_track, words); });
+    rotation = sample_track(*this, rotations[bone], time, glm::quat(1.f, 0.f, 0.f, 0.f), decode_rotation);
+    scale = sample_track(*this, scale_track, time, glm::vec3(1.f), [&](std::uint16_t const * words){ return decode_vector(scale_track, words); });
+}
+
+void compressed_animation::sample(float time, skeleton_pose & pose) const
+{
+    pose.resize(bone_count);
+    for (std::size_t i = 0; i < bone_count; ++i)
+        sample_bone(time, i, pose.translations[i], pose.rotations[i], pose.scales[i]);
+}
+
+void compressed_animation::sample(float time, pose_batch & batch, std::size_t instance) const
+{
+    glm::vec3 translation, scale;
+    glm::quat rotation;
+    for (std::size_t i = 0; i < bone_count; ++i)
+    {
+        sample_bone(time, i, translation, rotation, scale);
+        batch.set(instance, i, translation, rotation, scale);
+    }
+}
+
+std::size_t compressed_animation::memory_usage() const
+{
+    return (times.size() + values.size()) * sizeof(std::uint16_t) + (translations.size() + rotations.size() + scales.size()) * sizeof(track);
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "animation.hpp"
+
+#include <span>
+#include <array>
+#include <cstdint>
+
+struct compression_options
+{
+    // Largest error allowed when dropping keys, in model units for translation and scale
+    // and in radians for rotation; it also covers the quantization error
+    float translation_tolerance = 1e-4f;
+    float rotation_tolerance = 1e-3f;
+    float scale_tolerance = 1e-4f;
+};
+
+// Quaternions in 48 bits: the index of the largest component in the top bits of the first two
+// words and the three others in 15 bits each. The largest component is made positive and
+// recomputed from the unit length
+std::array<std::uint16_t, 3> encode_rotation(glm::quat const & rotation);
+glm::quat decode_rotation(std::uint16_t const * words);
+
+// An animation with redundant keys dropped and the remaining ones quantized to 16 bits per
+// component: times in steps of max_time / 65535, translations and scales within the range of
+// their track, rotations as smallest three. Sampling looks up the key pair of every channel and
+// interpolates like gltf_model::spline, which it matches within the tolerances
+struct compressed_animation
+{
+    struct track
+    {
+        std::uint32_t first_key = 0;
+        std::uint32_t key_count = 0;
+        // Range of the quantized values, unused by rotations
+        glm::vec3 min{0.f};
+        glm::vec3 extent{0.f};
+    };
+
+    std::size_t bone_count = 0;
+    float max_time = 0.f;
+    float time_step = 1.f;
+
+    // bone_count tracks each; bones without keyframes for a channel have empty tracks and
+    // keep the identity transform
+    std::vector<track> translations;
+    std::vector<track> rotations;
+    std::vector<track> scales;
+
+    // Keys of all tracks: one time and three value words per key
+    std::vector<std::uint16_t> times;
+    std::vector<std::uint16_t> values;
+
+    animation_error error;
+
+    // Starts an animation of the given duration with empty tracks
+    void reset(std::size_t bone_count, float max_time);
+
+    // Reduces and quantizes the keyframes of a channel into a new track
+    track append_track(std::span<float const> timestamps, std::span<glm::vec3 const> values, float tolerance);
+    track append_track(std::span<float const> timestamps, std::span<glm::quat const> values, float tolerance);
+
+    void sample(float time, skeleton_pose & pose) const;
+    void sample(float time, pose_batch & batch, std::size_t instance) const;
+
+    void sample_bone(float time, std::size_t bone, glm::vec3 & translation, glm::quat & rotation, glm::vec3 & scale) const;
+
+    std::size_t key_count() const { return times.size(); }
+    std::size_t memory_usage() const;
+};
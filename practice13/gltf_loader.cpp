@@ -1,10 +1,13 @@
 #include "gltf_loader.hpp"
 
 #include <rapidjson/document.h>
-#include <rapidjson/istreamwrapper.h>
+#include <rapidjson/error/en.h>
 
-#include <fstream>
+#include <chrono>
+#include <cmath>
+#include <cstring>
 #include <stdexcept>
+#include <type_traits>
 
 static unsigned int attribute_type_to_size(std::string const & type)
 {
@@ -16,52 +19,244 @@ static unsigned int attribute_type_to_size(std::string const & type)
     throw std::runtime_error("Unknown attribute type: " + type);
 }
 
-gltf_model load_gltf(std::filesystem::path const & path)
+static unsigned int component_type_to_size(unsigned int type)
 {
-    rapidjson::Document document;
+    switch (type)
+    {
+    case 0x1400: // GL_BYTE
+    case 0x1401: // GL_UNSIGNED_BYTE
+        return 1;
+    case 0x1402: // GL_SHORT
+    case 0x1403: // GL_UNSIGNED_SHORT
+        return 2;
+    default:
+        return 4;
+    }
+}
 
+gltf_buffer::gltf_buffer(mapped_file file, std::size_t offset, std::size_t size)
+    : file_(std::move(file))
+    , data_(file_.mutable_data() + offset)
+    , size_(size)
+{}
+
+void gltf_buffer::resize(std::size_t size)
+{
+    if (storage_.empty())
     {
-        std::ifstream input(path, std::ios::binary);
-        rapidjson::IStreamWrapper stream(input);
-        document.ParseStream(stream);
+        storage_.reserve(size);
+        storage_.assign(data_, data_ + std::min(size, size_));
+        file_ = mapped_file();
     }
 
-    gltf_model result;
+    storage_.resize(size);
+    data_ = storage_.data();
+    size_ = size;
+}
+
+namespace
+{
 
+    // Layout of a .glb: a header followed by a JSON chunk and an optional BIN chunk,
+    // all little-endian and 4-byte aligned
+    constexpr std::uint32_t glb_magic = 0x46546C67; // "glTF"
+    constexpr std::uint32_t glb_chunk_json = 0x4E4F534A; // "JSON"
+    constexpr std::uint32_t glb_chunk_bin = 0x004E4942; // "BIN\0"
+
+    struct glb_chunk
     {
-        auto buffers = document["buffers"].GetArray();
-        assert(buffers.Size() == 1);
+        std::size_t offset = 0;
+        std::size_t size = 0;
+    };
 
-        auto const buffer_uri = buffers[0]["uri"].GetString();
+    std::uint32_t read_u32(char const * data)
+    {
+        std::uint32_t value;
+        std::memcpy(&value, data, sizeof(value));
+        return value;
+    }
+
+    // Returns the JSON and BIN chunks; the BIN chunk is empty if the file has none
+    std::pair<glb_chunk, glb_chunk> parse_glb_chunks(mapped_file const & file, std::filesystem::path const & path)
+    {
+        auto fail = [&](char const * reason){
+            throw std::runtime_error("Bad GLB file " + path.string() + ": " + reason);
+        };
+
+        if (file.size() < 12 || read_u32(file.data() + 4) != 2)
+            fail("unsupported header");
 
-        auto const buffer_path = path.parent_path() / buffer_uri;
+        std::size_t const length = std::min<std::size_t>(read_u32(file.data() + 8), file.size());
 
-        result.buffer.resize(std::filesystem::file_size(buffer_path));
-        std::ifstream buffer(buffer_path, std::ios::binary);
-        buffer.read(result.buffer.data(), result.buffer.size());
+        std::pair<glb_chunk, glb_chunk> result;
+        for (std::size_t offset = 12, index = 0; offset + 8 <= length; ++index)
+        {
+            glb_chunk const chunk{offset + 8, read_u32(file.data() + offset)};
+            std::uint32_t const type = read_u32(file.data() + offset + 4);
+            if (chunk.size > length - chunk.offset)
+                fail("chunk out of bounds");
+
+            if (index == 0 && type != glb_chunk_json)
+                fail("the first chunk is not JSON");
+            if (index == 0)
+                result.first = chunk;
+            else if (index == 1 && type == glb_chunk_bin)
+                result.second = chunk;
+
+            offset = chunk.offset + (chunk.size + 3) / 4 * 4;
+        }
+
+        if (result.first.size == 0)
+            fail("no JSON chunk");
+
+        return result;
     }
 
-    auto parse_buffer_view = [&](int index) -> gltf_model::buffer_view
+    unsigned int uint_member(rapidjson::Value const & object, char const * name, unsigned int default_value)
     {
-        auto view = document["bufferViews"].GetArray()[index].GetObject();
-        return {view["byteOffset"].GetUint(), view["byteLength"].GetUint()};
-    };
+        auto const member = object.FindMember(name);
+        return (member == object.MemberEnd()) ? default_value : member->value.GetUint();
+    }
 
-    auto parse_accessor = [&](int index) -> gltf_model::accessor
+    // Compares a processed animation with the splines at every keyframe and halfway to the next one
+    template <typename Animation>
+    animation_error measure_error(gltf_model::animation const & animation, Animation const & processed)
+    {
+        animation_error error;
+
+        auto for_each_time = [](std::vector<float> const & timestamps, auto const & function)
+        {
+            for (std::size_t i = 0; i < timestamps.size(); ++i)
+            {
+                function(timestamps[i]);
+                if (i + 1 < timestamps.size())
+                    function((timestamps[i] + timestamps[i + 1]) / 2.f);
+            }
+        };
+
+        for (std::size_t i = 0; i < animation.bones.size(); ++i)
+        {
+            auto const & bone = animation.bones[i];
+            glm::vec3 translation, scale;
+            glm::quat rotation;
+
+            for_each_time(bone.translation.timestamps, [&](float time){
+                processed.sample_bone(time, i, translation, rotation, scale);
+                error.translation = std::max(error.translation, glm::length(translation - bone.translation(time)));
+            });
+            for_each_time(bone.rotation.timestamps, [&](float time){
+                processed.sample_bone(time, i, translation, rotation, scale);
+                error.rotation = std::max(error.rotation, rotation_difference(rotation, bone.rotation(time)));
+            });
+            for_each_time(bone.scale.timestamps, [&](float time){
+                processed.sample_bone(time, i, translation, rotation, scale);
+                error.scale = std::max(error.scale, glm::length(scale - bone.scale(time)));
+            });
+        }
+
+        return error;
+    }
+
+}
+
+gltf_model load_gltf(std::filesystem::path const & path, gltf_load_options const & options)
+{
+    auto const load_start = std::chrono::steady_clock::now();
+
+    // For a .glb the same mapping holds the JSON and the buffer
+    mapped_file file(path, mapped_file::copy_on_write);
+    bool const binary = file.size() >= 4 && read_u32(file.data()) == glb_magic;
+
+    glb_chunk json{0, file.size()};
+    glb_chunk bin;
+    if (binary)
+        std::tie(json, bin) = parse_glb_chunks(file, path);
+
+    // The JSON is parsed in situ from a null-terminated copy, so that strings point into
+    // the text instead of being copied, with values taken from a pool sized after the
+    // text: glTF files take about 0.85 bytes of values per byte of JSON
+    std::vector<char> json_text;
+    json_text.reserve(json.size + 1);
+    json_text.assign(file.data() + json.offset, file.data() + json.offset + json.size);
+    json_text.push_back('\0');
+
+    std::vector<char> json_pool(json.size + 4096);
+    rapidjson::MemoryPoolAllocator<> allocator(json_pool.data(), json_pool.size(), json_pool.size());
+    rapidjson::Document document(&allocator);
+
+    auto const parse_start = std::chrono::steady_clock::now();
+    document.ParseInsitu(json_text.data());
+    if (document.HasParseError())
+        throw std::runtime_error("Failed to parse " + path.string() + ": " + rapidjson::GetParseError_En(document.GetParseError()));
+
+    gltf_model result;
+    result.json_size = json.size;
+    result.json_parse_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - parse_start).count();
+
+    {
+        auto buffers = document["buffers"].GetArray();
+        if (buffers.Size() != 1)
+            throw std::runtime_error("Only models with a single buffer are supported");
+
+        std::size_t const byte_length = buffers[0]["byteLength"].GetUint();
+
+        // A .glb buffer without a uri is the BIN chunk
+        if (binary && !buffers[0].HasMember("uri"))
+        {
+            if (byte_length > bin.size)
+                throw std::runtime_error("Bad GLB file " + path.string() + ": buffer larger than the BIN chunk");
+            result.buffer = gltf_buffer(std::move(file), bin.offset, byte_length);
+        }
+        else
+        {
+            std::string const buffer_uri = buffers[0]["uri"].GetString();
+            if (buffer_uri.starts_with("data:"))
+                throw std::runtime_error("Buffers embedded as data URIs are not supported");
+
+            mapped_file buffer_file(path.parent_path() / buffer_uri, mapped_file::copy_on_write);
+            if (byte_length > buffer_file.size())
+                throw std::runtime_error("Buffer " + buffer_uri + " is shorter than its byteLength");
+            result.buffer = gltf_buffer(std::move(buffer_file), 0, byte_length);
+        }
+    }
+
+    // Views and accessors are resolved once into flat arrays that the meshes, the skin
+    // and the animations index
+    std::vector<gltf_model::buffer_view> buffer_views;
+    for (auto const & view : document["bufferViews"].GetArray())
+        buffer_views.push_back({uint_member(view, "byteOffset", 0), view["byteLength"].GetUint()});
+
+    std::vector<gltf_model::accessor> accessors;
+    for (auto const & accessor : document["accessors"].GetArray())
     {
-        auto accessor = document["accessors"].GetArray()[index].GetObject();
-        return {
-            parse_buffer_view(accessor["bufferView"].GetInt()),
+        if (!accessor.HasMember("bufferView"))
+            throw std::runtime_error("Accessors without a buffer view are not supported");
+
+        auto view = buffer_views.at(accessor["bufferView"].GetUint());
+        unsigned int const offset = std::min(uint_member(accessor, "byteOffset", 0), view.size);
+        view.offset += offset;
+        view.size -= offset;
+
+        accessors.push_back({
+            view,
             accessor["componentType"].GetUint(),
             attribute_type_to_size(accessor["type"].GetString()),
             accessor["count"].GetUint(),
-        };
+        });
+    }
+
+    auto parse_accessor = [&](int index) -> gltf_model::accessor
+    {
+        return accessors.at(index);
     };
 
     auto parse_texture = [&](int index) -> std::string
     {
         auto const source_index = document["textures"].GetArray()[index]["source"].GetInt();
-        return document["images"].GetArray()[source_index]["uri"].GetString();
+        auto const & image = document["images"].GetArray()[source_index];
+        if (!image.HasMember("uri"))
+            throw std::runtime_error("Images stored in the buffer are not supported");
+        return image["uri"].GetString();
     };
 
     auto parse_color = [&](auto const & array)
@@ -88,6 +283,8 @@ gltf_model load_gltf(std::filesystem::path const & path)
         result_mesh.position = parse_accessor(attributes["POSITION"].GetInt());
         result_mesh.normal = parse_accessor(attributes["NORMAL"].GetInt());
         result_mesh.texcoord = parse_accessor(attributes["TEXCOORD_0"].GetInt());
+        if (attributes.HasMember("TANGENT"))
+            result_mesh.tangent = parse_accessor(attributes["TANGENT"].GetInt());
         result_mesh.joints = parse_accessor(attributes["JOINTS_0"].GetInt());
         result_mesh.weights = parse_accessor(attributes["WEIGHTS_0"].GetInt());
 
@@ -128,17 +325,17 @@ gltf_model load_gltf(std::filesystem::path const & path)
 
         result.bones.resize(joints.Size());
 
+        auto nodes = document["nodes"].GetArray();
+
         std::unordered_map<int, int> bone_node_to_index;
         for (int i = 0; i < joints.Size(); ++i)
         {
             int const node_id = joints[i].GetInt();
             bone_node_to_index[node_id] = i;
-            result.bones[i].name = document["nodes"].GetArray()[node_id]["name"].GetString();
+            result.bones[i].name = nodes[node_id]["name"].GetString();
             result.bones[i].inverse_bind_matrix = inverse_bind_matrices[i];
         }
 
-        auto nodes = document["nodes"].GetArray();
-
         for (int i = 0; i < nodes.Size(); ++i)
         {
             if (!bone_node_to_index.contains(i)) continue;
@@ -216,5 +413,327 @@ gltf_model load_gltf(std::filesystem::path const & path)
         }
     }
 
+    if (options.resample)
+        for (auto const & [name, animation] : result.animations)
+            result.resampled_animations[name] = resample_animation(animation, *options.resample);
+    if (options.compress)
+        for (auto const & [name, animation] : result.animations)
+            result.compressed_animations[name] = compress_animation(animation, *options.compress);
+    if (!options.keep_keyframes)
+        result.animations.clear();
+
+    result.load_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - load_start).count();
+    return result;
+}
+
+skeleton make_skeleton(gltf_model const & model)
+{
+    skeleton result;
+    for (auto const & bone : model.bones)
+    {
+        result.parents.push_back(bone.parent == static_cast<unsigned int>(-1) ? skeleton::no_parent : bone.parent);
+        result.inverse_bind_matrices.push_back(bone.inverse_bind_matrix);
+    }
+    return result;
+}
+
+std::vector<vertex_influences> read_influences(gltf_model const & model, gltf_model::mesh const & mesh)
+{
+    std::size_t const count = mesh.joints.count;
+    if (mesh.weights.count != count || mesh.joints.size != 4 || mesh.weights.size != 4)
+        throw std::runtime_error("Skinned meshes need four joints and weights per vertex");
+
+    // Reads component c of vertex v of an accessor, tightly packed like every other attribute
+    auto read = [&](gltf_model::accessor const & accessor, std::size_t v, int c, bool normalized) -> float
+    {
+        char const * data = model.buffer.data() + accessor.view.offset;
+        std::size_t const index = v * 4 + c;
+        switch (accessor.type)
+        {
+        case 0x1401: // GL_UNSIGNED_BYTE
+            return reinterpret_cast<std::uint8_t const *>(data)[index] / (normalized ? 255.f : 1.f);
+        case 0x1403: // GL_UNSIGNED_SHORT
+            return reinterpret_cast<std::uint16_t const *>(data)[index] / (normalized ? 65535.f : 1.f);
+        case 0x1406: // GL_FLOAT
+            if (normalized)
+                return reinterpret_cast<float const *>(data)[index];
+            [[fallthrough]];
+        default:
+            throw std::runtime_error("Unsupported skinning attribute type: " + std::to_string(accessor.type));
+        }
+    };
+
+    std::vector<vertex_influences> result(count);
+    for (std::size_t v = 0; v < count; ++v)
+        for (int c = 0; c < 4; ++c)
+        {
+            result[v].joints[c] = read(mesh.joints, v, c, false);
+            result[v].weights[c] = read(mesh.weights, v, c, true);
+        }
     return result;
 }
+
+void skin_mesh(gltf_model const & model, gltf_model::mesh const & mesh, std::span<vertex_influences const> influences,
+    std::span<glm::mat3x4 const> palette, std::span<glm::vec3> positions, std::span<glm::vec3> normals, unsigned int thread_count)
+{
+    assert(mesh.position.type == 0x1406 && mesh.position.size == 3); // GL_FLOAT vec3
+    assert(mesh.normal.type == 0x1406 && mesh.normal.size == 3);
+
+    auto attribute = [&](gltf_model::accessor const & accessor)
+    {
+        return std::span(reinterpret_cast<glm::vec3 const *>(model.buffer.data() + accessor.view.offset), accessor.count);
+    };
+
+    skin_vertices(attribute(mesh.position), attribute(mesh.normal), influences, palette, positions, normals, thread_count);
+}
+
+resampled_animation resample_animation(gltf_model::animation const & animation, resample_options const & options)
+{
+    std::size_t const bone_count = animation.bones.size();
+
+    auto build = [&](float rate)
+    {
+        resampled_animation result;
+        result.bone_count = bone_count;
+        result.max_time = animation.max_time;
+        result.frame_count = std::max<std::size_t>(2, std::ceil(animation.max_time * rate) + 1);
+        result.frame_duration = animation.max_time / (result.frame_count - 1);
+
+        std::size_t const size = result.frame_count * bone_count;
+        result.translations.assign(size, glm::vec3(0.f));
+        result.rotations.assign(size, glm::quat(1.f, 0.f, 0.f, 0.f));
+        result.scales.assign(size, glm::vec3(1.f));
+
+        for (std::size_t frame = 0; frame < result.frame_count; ++frame)
+        {
+            float const time = (frame + 1 == result.frame_count) ? animation.max_time : frame * result.frame_duration;
+            for (std::size_t i = 0; i < bone_count; ++i)
+            {
+                auto const & bone = animation.bones[i];
+                std::size_t const index = frame * bone_count + i;
+                if (!bone.translation.values.empty())
+                    result.translations[index] = bone.translation(time);
+                if (!bone.rotation.values.empty())
+                    result.rotations[index] = bone.rotation(time);
+                if (!bone.scale.values.empty())
+                    result.scales[index] = bone.scale(time);
+            }
+        }
+
+        return result;
+    };
+
+    float rate = options.rate;
+    while (true)
+    {
+        auto result = build(rate);
+        result.error = measure_error(animation, result);
+        if (result.error.max() <= options.tolerance || rate >= options.max_rate)
+            return result;
+        rate = std::min(2.f * rate, options.max_rate);
+    }
+}
+
+compressed_animation compress_animation(gltf_model::animation const & animation, compression_options const & options)
+{
+    compressed_animation result;
+    result.reset(animation.bones.size(), animation.max_time);
+
+    for (std::size_t i = 0; i < animation.bones.size(); ++i)
+    {
+        auto const & bone = animation.bones[i];
+        result.translations[i] = result.append_track(bone.translation.timestamps, bone.translation.values, options.translation_tolerance);
+        result.rotations[i] = result.append_track(bone.rotation.timestamps, bone.rotation.values, options.rotation_tolerance);
+        result.scales[i] = result.append_track(bone.scale.timestamps, bone.scale.values, options.scale_tolerance);
+    }
+
+    result.error = measure_error(animation, result);
+    return result;
+}
+
+std::vector<vertex_cache_report> optimize_vertex_cache(gltf_model & model)
+{
+    std::vector<vertex_cache_report> result;
+
+    for (auto const & mesh : model.meshes)
+    {
+        auto const & indices = mesh.indices;
+        auto const vertex_count = mesh.position.count;
+        auto const data = model.buffer.data() + indices.view.offset;
+
+        auto optimize = [&](auto * begin)
+        {
+            return optimize_vertex_cache(std::span(begin, indices.count), vertex_count);
+        };
+
+        switch (indices.type)
+        {
+        case 0x1401: // GL_UNSIGNED_BYTE
+            result.push_back(optimize(reinterpret_cast<std::uint8_t *>(data)));
+            break;
+        case 0x1403: // GL_UNSIGNED_SHORT
+            result.push_back(optimize(reinterpret_cast<std::uint16_t *>(data)));
+            break;
+        case 0x1405: // GL_UNSIGNED_INT
+            result.push_back(optimize(reinterpret_cast<std::uint32_t *>(data)));
+            break;
+        default:
+            throw std::runtime_error("Unsupported index type: " + std::to_string(indices.type));
+        }
+    }
+
+    return result;
+}
+
+meshlet_table build_meshlets(gltf_model & model, gltf_model::mesh const & mesh)
+{
+    auto const & indices = mesh.indices;
+    auto const data = model.buffer.data() + indices.view.offset;
+
+    assert(mesh.position.type == 0x1406 && mesh.position.size == 3); // GL_FLOAT vec3
+    auto const positions = reinterpret_cast<float const *>(model.buffer.data() + mesh.position.view.offset);
+
+    auto build = [&](auto * begin)
+    {
+        return build_meshlets(std::span(begin, indices.count), positions, mesh.position.count, 3 * sizeof(float));
+    };
+
+    switch (indices.type)
+    {
+    case 0x1401: // GL_UNSIGNED_BYTE
+        return build(reinterpret_cast<std::uint8_t *>(data));
+    case 0x1403: // GL_UNSIGNED_SHORT
+        return build(reinterpret_cast<std::uint16_t *>(data));
+    case 0x1405: // GL_UNSIGNED_INT
+        return build(reinterpret_cast<std::uint32_t *>(data));
+    default:
+        throw std::runtime_error("Unsupported index type: " + std::to_string(indices.type));
+    }
+}
+
+std::vector<gltf_lod> build_lod_chain(gltf_model & model, gltf_model::mesh const & mesh, std::span<float const> ratios, unsigned int thread_count)
+{
+    auto const & indices = mesh.indices;
+
+    assert(mesh.position.type == 0x1406 && mesh.position.size == 3); // GL_FLOAT vec3
+
+    std::vector<gltf_lod> result;
+
+    auto build = [&](auto const * begin)
+    {
+        using index = std::remove_cv_t<std::remove_pointer_t<decltype(begin)>>;
+
+        auto const positions = reinterpret_cast<float const *>(model.buffer.data() + mesh.position.view.offset);
+        auto lods = build_lod_chain(std::span(begin, indices.count), positions, mesh.position.count, 3 * sizeof(float), ratios, thread_count);
+
+        for (auto & lod : lods)
+        {
+            optimize_vertex_cache(std::span(lod.indices), mesh.position.count);
+
+            // Keep every index buffer aligned to 4 bytes
+            std::size_t const offset = (model.buffer.size() + 3) / 4 * 4;
+            std::size_t const size = lod.indices.size() * sizeof(index);
+            model.buffer.resize(offset + size);
+            std::memcpy(model.buffer.data() + offset, lod.indices.data(), size);
+
+            gltf_model::accessor accessor = indices;
+            accessor.view = {static_cast<unsigned int>(offset), static_cast<unsigned int>(size)};
+            accessor.count = lod.indices.size();
+            result.push_back({accessor, lod.ratio, lod.error});
+        }
+    };
+
+    // The source indices are copied first, as appending to the buffer may move it
+    std::vector<char> const source(model.buffer.data() + indices.view.offset,
+        model.buffer.data() + indices.view.offset + indices.count * (indices.type == 0x1401 ? 1 : indices.type == 0x1403 ? 2 : 4));
+
+    switch (indices.type)
+    {
+    case 0x1401: // GL_UNSIGNED_BYTE
+        build(reinterpret_cast<std::uint8_t const *>(source.data()));
+        break;
+    case 0x1403: // GL_UNSIGNED_SHORT
+        build(reinterpret_cast<std::uint16_t const *>(source.data()));
+        break;
+    case 0x1405: // GL_UNSIGNED_INT
+        build(reinterpret_cast<std::uint32_t const *>(source.data()));
+        break;
+    default:
+        throw std::runtime_error("Unsupported index type: " + std::to_string(indices.type));
+    }
+
+    return result;
+}
+
+std::size_t generate_tangents(gltf_model & model, gltf_model::mesh & mesh, unsigned int thread_count)
+{
+    assert(mesh.position.type == 0x1406 && mesh.position.size == 3); // GL_FLOAT vec3
+    assert(mesh.normal.type == 0x1406 && mesh.normal.size == 3);
+    assert(mesh.texcoord.type == 0x1406 && mesh.texcoord.size == 2);
+
+    auto stream = [&](gltf_model::accessor const & accessor)
+    {
+        return vertex_stream{reinterpret_cast<float const *>(model.buffer.data() + accessor.view.offset), accessor.size * sizeof(float)};
+    };
+
+    // Indices are patched in place, before anything is appended to the buffer
+    auto generate = [&](auto * begin)
+    {
+        return generate_tangents(std::span(begin, mesh.indices.count), stream(mesh.position), stream(mesh.normal), stream(mesh.texcoord),
+            mesh.position.count, thread_count);
+    };
+
+    auto const indices = model.buffer.data() + mesh.indices.view.offset;
+
+    generated_tangents result;
+    switch (mesh.indices.type)
+    {
+    case 0x1401: // GL_UNSIGNED_BYTE
+        result = generate(reinterpret_cast<std::uint8_t *>(indices));
+        break;
+    case 0x1403: // GL_UNSIGNED_SHORT
+        result = generate(reinterpret_cast<std::uint16_t *>(indices));
+        break;
+    case 0x1405: // GL_UNSIGNED_INT
+        result = generate(reinterpret_cast<std::uint32_t *>(indices));
+        break;
+    default:
+        throw std::runtime_error("Unsupported index type: " + std::to_string(mesh.indices.type));
+    }
+
+    // Appends room for a tightly packed array, keeping it aligned to 4 bytes
+    auto append = [&](std::size_t size)
+    {
+        std::size_t const offset = (model.buffer.size() + 3) / 4 * 4;
+        model.buffer.resize(offset + size);
+        return gltf_model::buffer_view{static_cast<unsigned int>(offset), static_cast<unsigned int>(size)};
+    };
+
+    if (!result.split_vertices.empty())
+    {
+        for (auto accessor : {&mesh.position, &mesh.normal, &mesh.texcoord, &mesh.joints, &mesh.weights})
+        {
+            std::size_t const element_size = accessor->size * component_type_to_size(accessor->type);
+            std::size_t const source_size = accessor->count * element_size;
+
+            auto const view = append(source_size + result.split_vertices.size() * element_size);
+            std::memcpy(model.buffer.data() + view.offset, model.buffer.data() + accessor->view.offset, source_size);
+
+            char * target = model.buffer.data() + view.offset + source_size;
+            for (auto v : result.split_vertices)
+            {
+                std::memcpy(target, model.buffer.data() + accessor->view.offset + v * element_size, element_size);
+                target += element_size;
+            }
+
+            accessor->view = view;
+            accessor->count += result.split_vertices.size();
+        }
+    }
+
+    auto const view = append(result.tangents.size() * sizeof(result.tangents[0]));
+    std::memcpy(model.buffer.data() + view.offset, result.tangents.data(), view.size);
+    mesh.tangent = gltf_model::accessor{view, 0x1406, 4, static_cast<unsigned int>(result.tangents.size())};
+
+    return result.split_vertices.size();
+}
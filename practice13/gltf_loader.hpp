@@ -7,6 +7,16 @@
 #include <unordered_map>
 #include <algorithm>
 
+#include "mapped_file.hpp"
+#include "mesh_optimizer.hpp"
+#include "meshlets.hpp"
+#include "mesh_simplifier.hpp"
+#include "tangent_generation.hpp"
+#include "animation.hpp"
+#include "animation_compression.hpp"
+#include "pose_evaluation.hpp"
+#include "skinning.hpp"
+
 #define GLM_FORCE_SWIZZLE
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/vec3.hpp>
@@ -14,6 +24,28 @@
 #include <glm/gtx/quaternion.hpp>
 #include <glm/gtx/compatibility.hpp>
 
+// Binary data of a model: a copy-on-write mapping of the .bin file or of the BIN
+// chunk of a .glb, so that vertex data goes from the page cache to glBufferData
+// without an intermediate copy. In-place edits only copy the pages they touch;
+// growing the buffer moves it into memory of its own
+struct gltf_buffer
+{
+    gltf_buffer() = default;
+    gltf_buffer(mapped_file file, std::size_t offset, std::size_t size);
+
+    char * data() { return data_; }
+    char const * data() const { return data_; }
+    std::size_t size() const { return size_; }
+
+    void resize(std::size_t size);
+
+private:
+    mapped_file file_;
+    std::vector<char> storage_;
+    char * data_ = nullptr;
+    std::size_t size_ = 0;
+};
+
 struct gltf_model
 {
     struct buffer_view
@@ -77,17 +109,63 @@ struct gltf_model
         accessor position;
         accessor normal;
         accessor texcoord;
+        // Tangents from the file or from generate_tangents, vec4 with the bitangent sign in w
+        std::optional<accessor> tangent;
         accessor joints;
         accessor weights;
     };
 
-    std::vector<char> buffer;
+    gltf_buffer buffer;
     std::vector<mesh> meshes;
     std::vector<bone> bones;
     std::unordered_map<std::string, animation> animations;
+    // Filled by load_gltf when resampling or compression are asked for, under the same names
+    std::unordered_map<std::string, resampled_animation> resampled_animations;
+    std::unordered_map<std::string, compressed_animation> compressed_animations;
+
+    // Size of the JSON text, and the time load_gltf spent parsing it out of the whole load
+    std::size_t json_size = 0;
+    double json_parse_ms = 0.0;
+    double load_ms = 0.0;
 };
 
-gltf_model load_gltf(std::filesystem::path const & path);
+struct gltf_load_options
+{
+    // Resamples every animation into resampled_animations
+    std::optional<resample_options> resample;
+    // Reduces and quantizes the keys of every animation into compressed_animations
+    std::optional<compression_options> compress;
+    // Without it, only the resampled or compressed animations remain after loading
+    bool keep_keyframes = true;
+};
+
+// Loads a .gltf with its .bin, or a binary .glb, mapping the binary data in place
+gltf_model load_gltf(std::filesystem::path const & path, gltf_load_options const & options = {});
+
+// Drops the keys that interpolation restores within the tolerances and quantizes the others
+compressed_animation compress_animation(gltf_model::animation const & animation, compression_options const & options);
+
+// Parents and inverse bind matrices of the model's bones
+skeleton make_skeleton(gltf_model const & model);
+
+// Joints and weights of every vertex of a mesh, for skin_mesh; integer weights are normalized
+// like the vertex attributes
+std::vector<vertex_influences> read_influences(gltf_model const & model, gltf_model::mesh const & mesh);
+
+// Skins the positions and normals of a mesh with skin_vertices
+void skin_mesh(gltf_model const & model, gltf_model::mesh const & mesh, std::span<vertex_influences const> influences,
+    std::span<glm::mat3x4 const> palette, std::span<glm::vec3> positions, std::span<glm::vec3> normals, unsigned int thread_count = 1);
+
+// Resamples the keyframes of an animation at a fixed rate, raised until the error is within
+// the tolerance
+resampled_animation resample_animation(gltf_model::animation const & animation, resample_options const & options);
+
+// Reorders the triangles of every mesh for the post-transform vertex cache,
+// in place in the model buffer; returns one report per mesh
+std::vector<vertex_cache_report> optimize_vertex_cache(gltf_model & model);
+
+// Splits a mesh into meshlets, reordering its index accessor in place in the model buffer
+meshlet_table build_meshlets(gltf_model & model, gltf_model::mesh const & mesh);
 
 template <>
 inline glm::vec3 gltf_model::spline<glm::vec3>::operator()(float time) const
@@ -122,3 +200,22 @@ inline glm::quat gltf_model::spline<glm::quat>::operator()(float time) const
     float t = (time - timestamps[i - 1]) / (timestamps[i] - timestamps[i - 1]);
     return glm::slerp(values[i - 1], values[i], t);
 }
+
+struct gltf_lod
+{
+    // Index accessor of the level, of the same type as the mesh's own
+    gltf_model::accessor indices;
+    float ratio;
+    float error;
+};
+
+// Simplifies a mesh for every ratio on thread_count threads (0 meaning all hardware
+// threads), appending the index buffers of the levels to the model buffer; the levels
+// share the mesh's vertex accessors
+std::vector<gltf_lod> build_lod_chain(gltf_model & model, gltf_model::mesh const & mesh, std::span<float const> ratios, unsigned int thread_count = 0);
+
+// Computes MikkTSpace tangents for the mesh and appends them to the model buffer as a new
+// tangent accessor. Vertices used with both texture orientations are split: the index
+// accessor is patched in place and the vertex attributes are copied to the end of the buffer
+// with the split vertices appended. Returns the number of split vertices
+std::size_t generate_tangents(gltf_model & model, gltf_model::mesh & mesh, unsigned int thread_count = 0);
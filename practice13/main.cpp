@@ -15,6 +15,7 @@
 #include <vector>
 #include <random>
 #include <map>
+#include <optional>
 #include <cmath>
 
 #define GLM_FORCE_SWIZZLE
@@ -28,7 +29,9 @@
 #include <glm/gtx/string_cast.hpp>
 
 #include "gltf_loader.hpp"
-#include "stb_image.h"
+#include "pose_graph.hpp"
+#include "texture_loader.hpp"
+#include "texture_upload.hpp"
 
 std::string to_string(std::string_view str)
 {
@@ -52,21 +55,45 @@ uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
 
+// Palettes as written by evaluate_poses: the rows of each affine transform in a mat3x4
+layout (std140) uniform bones_block
+{
+    mat3x4 bones[128];
+};
+
+// 0 when the vertices come already skinned by the CPU
+uniform int skinned;
+
 layout (location = 0) in vec3 in_position;
 layout (location = 1) in vec3 in_normal;
 layout (location = 2) in vec2 in_texcoord;
+layout (location = 3) in ivec4 in_joints;
+layout (location = 4) in vec4 in_weights;
 
 out vec3 normal;
 out vec2 texcoord;
 
 void main()
 {
-    gl_Position = projection * view * model * vec4(in_position, 1.0);
-    normal = mat3(model) * in_normal;
+    vec3 position = in_position;
+    vec3 bone_normal = in_normal;
+    if (skinned == 1)
+    {
+        mat3x4 bone = in_weights.x * bones[in_joints.x] + in_weights.y * bones[in_joints.y]
+            + in_weights.z * bones[in_joints.z] + in_weights.w * bones[in_joints.w];
+        position = vec4(in_position, 1.0) * bone;
+        bone_normal = vec4(in_normal, 0.0) * bone;
+    }
+
+    gl_Position = projection * view * model * vec4(position, 1.0);
+    normal = mat3(model) * bone_normal;
     texcoord = in_texcoord;
 }
 )";
 
+// Size of the bones array of the vertex shader
+constexpr std::size_t max_bones = 128;
+
 const char fragment_shader_source[] =
 R"(#version 330 core
 
@@ -185,11 +212,21 @@ int main() try
     GLuint color_location = glGetUniformLocation(program, "color");
     GLuint use_texture_location = glGetUniformLocation(program, "use_texture");
     GLuint light_direction_location = glGetUniformLocation(program, "light_direction");
+    GLuint skinned_location = glGetUniformLocation(program, "skinned");
+
+    glUniformBlockBinding(program, glGetUniformBlockIndex(program, "bones_block"), 0);
 
     const std::string project_root = PROJECT_ROOT;
     const std::string model_path = project_root + "/wolf/Wolf-Blender-2.82a.gltf";
 
-    auto const input_model = load_gltf(model_path);
+    gltf_load_options load_options;
+    load_options.resample = resample_options{};
+    auto input_model = load_gltf(model_path, load_options);
+    std::cout << "Loaded " << model_path << " in " << input_model.load_ms << " ms, parsing "
+        << input_model.json_size << " bytes of JSON in " << input_model.json_parse_ms << " ms" << std::endl;
+    for (std::size_t i = 0; auto const & report : optimize_vertex_cache(input_model))
+        std::cout << "Mesh " << input_model.meshes[i++].name << ": ACMR " << report.before.acmr << " -> " << report.after.acmr
+            << ", ATVR " << report.before.atvr << " -> " << report.after.atvr << std::endl;
     GLuint vbo;
     glGenBuffers(1, &vbo);
     glBindBuffer(GL_ARRAY_BUFFER, vbo);
@@ -200,15 +237,23 @@ int main() try
         GLuint vao;
         gltf_model::accessor indices;
         gltf_model::material material;
+
+        // CPU skinning: positions then normals in skinned_vbo, drawn through skinned_vao
+        GLuint skinned_vao;
+        GLuint skinned_vbo;
+        std::vector<vertex_influences> influences;
+        std::vector<glm::vec3> positions;
+        std::vector<glm::vec3> normals;
     };
 
+    // Integer weights are normalized, joints stay integers
     auto setup_attribute = [](int index, gltf_model::accessor const & accessor, bool integer = false)
     {
         glEnableVertexAttribArray(index);
         if (integer)
             glVertexAttribIPointer(index, accessor.size, accessor.type, 0, reinterpret_cast<void *>(accessor.view.offset));
         else
-            glVertexAttribPointer(index, accessor.size, accessor.type, GL_FALSE, 0, reinterpret_cast<void *>(accessor.view.offset));
+            glVertexAttribPointer(index, accessor.size, accessor.type, accessor.type != GL_FLOAT, 0, reinterpret_cast<void *>(accessor.view.offset));
     };
 
     std::vector<mesh> meshes;
@@ -228,31 +273,88 @@ int main() try
         setup_attribute(4, mesh.weights);
 
         result.material = mesh.material;
+
+        std::size_t const vertex_count = mesh.position.count;
+        result.influences = read_influences(input_model, mesh);
+        result.positions.resize(vertex_count);
+        result.normals.resize(vertex_count);
+
+        glGenBuffers(1, &result.skinned_vbo);
+        glBindBuffer(GL_ARRAY_BUFFER, result.skinned_vbo);
+        glBufferData(GL_ARRAY_BUFFER, 2 * vertex_count * sizeof(glm::vec3), nullptr, GL_STREAM_DRAW);
+
+        glGenVertexArrays(1, &result.skinned_vao);
+        glBindVertexArray(result.skinned_vao);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vbo);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, reinterpret_cast<void *>(vertex_count * sizeof(glm::vec3)));
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        setup_attribute(2, mesh.texcoord);
     }
 
-    std::map<std::string, GLuint> textures;
-    for (auto const & mesh : meshes)
+    // The wolf runs through a pose graph, evaluated by a crowd animator of one character off
+    // the main thread; its palette goes to the shader through a uniform buffer, or skins the
+    // vertices on the CPU when toggled with C
+    auto const skeleton = make_skeleton(input_model);
+    if (skeleton.size() > max_bones)
+        throw std::runtime_error("Too many bones for the skinning shader: " + std::to_string(skeleton.size()));
+
+    // Models without a clip, or with an empty one, are drawn in their bind pose
+    resampled_animation const * animation = nullptr;
+    if (auto it = input_model.resampled_animations.find("01_Run"); it != input_model.resampled_animations.end())
+        animation = &it->second;
+    else if (!input_model.resampled_animations.empty())
+        animation = &input_model.resampled_animations.begin()->second;
+    if (animation && !(animation->max_time > 0.f))
+        animation = nullptr;
+
+    enum animation_parameter : std::size_t { clip_time };
+
+    pose_graph graph(skeleton.size());
+    std::optional<crowd_animator> animator;
+    if (animation)
     {
-        if (!mesh.material.texture_path) continue;
-        if (textures.contains(*mesh.material.texture_path)) continue;
+        graph.sample(animation, clip_time);
+        animator.emplace(graph, skeleton, 1);
+        animator->start_update();
+    }
 
-        auto path = std::filesystem::path(model_path).parent_path() / *mesh.material.texture_path;
+    GLuint bones_ubo;
+    glGenBuffers(1, &bones_ubo);
+    glBindBuffer(GL_UNIFORM_BUFFER, bones_ubo);
+    glBufferData(GL_UNIFORM_BUFFER, max_bones * sizeof(glm::mat3x4), nullptr, GL_DYNAMIC_DRAW);
+    glBindBufferBase(GL_UNIFORM_BUFFER, 0, bones_ubo);
 
-        int width, height, channels;
-        auto data = stbi_load(path.c_str(), &width, &height, &channels, 4);
-        assert(data);
+    bool cpu_skinning = false;
 
-        GLuint texture;
-        glGenTextures(1, &texture);
-        glBindTexture(GL_TEXTURE_2D, texture);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
+    // Images are loaded concurrently, through the decoded texture cache, and uploaded
+    // here as soon as each one is ready
+    std::map<std::string, GLuint> textures;
+    {
+        auto const textures_start = std::chrono::steady_clock::now();
 
-        stbi_image_free(data);
+        std::vector<std::string> texture_names;
+        std::vector<std::filesystem::path> texture_paths;
+        for (auto const & mesh : meshes)
+        {
+            if (!mesh.material.texture_path) continue;
+            if (textures.contains(*mesh.material.texture_path)) continue;
 
-        textures[*mesh.material.texture_path] = texture;
+            textures[*mesh.material.texture_path] = 0;
+            texture_names.push_back(*mesh.material.texture_path);
+            texture_paths.push_back(std::filesystem::path(model_path).parent_path() / *mesh.material.texture_path);
+        }
+
+        texture_decoder decoder(std::move(texture_paths));
+        while (auto image = decoder.next())
+        {
+            textures[texture_names[image->index]] = upload_texture(image->texture);
+        }
+
+        std::cout << "Loaded " << texture_names.size() << " textures in "
+            << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - textures_start).count() << " ms" << std::endl;
     }
 
     auto last_frame_start = std::chrono::high_resolution_clock::now();
@@ -290,6 +392,11 @@ int main() try
             button_down[event.key.keysym.sym] = true;
             if (event.key.keysym.sym == SDLK_SPACE)
                 paused = !paused;
+            if (event.key.keysym.sym == SDLK_c)
+            {
+                cpu_skinning = !cpu_skinning;
+                std::cout << (cpu_skinning ? "CPU" : "GPU") << " skinning" << std::endl;
+            }
             break;
         case SDL_KEYUP:
             button_down[event.key.keysym.sym] = false;
@@ -345,7 +452,42 @@ int main() try
 
         glm::vec3 light_direction = glm::normalize(glm::vec3(1.f, 2.f, 3.f));
 
+        bool const animated = animator.has_value();
+        bool const cpu_skinned = animated && cpu_skinning;
+
+        // Each frame draws with the palette of the update started during the previous one,
+        // and starts the next update once the palette is uploaded
+        std::span<glm::mat3x4 const> palette;
+        if (animated)
+            palette = animator->finish_update();
+
+        if (cpu_skinned)
+        {
+            for (std::size_t i = 0; i < meshes.size(); ++i)
+            {
+                auto & mesh = meshes[i];
+                skin_mesh(input_model, input_model.meshes[i], mesh.influences, palette, mesh.positions, mesh.normals, 0);
+
+                std::size_t const size = mesh.positions.size() * sizeof(glm::vec3);
+                glBindBuffer(GL_ARRAY_BUFFER, mesh.skinned_vbo);
+                glBufferSubData(GL_ARRAY_BUFFER, 0, size, mesh.positions.data());
+                glBufferSubData(GL_ARRAY_BUFFER, size, size, mesh.normals.data());
+            }
+        }
+        else if (animated)
+        {
+            glBindBuffer(GL_UNIFORM_BUFFER, bones_ubo);
+            glBufferSubData(GL_UNIFORM_BUFFER, 0, palette.size() * sizeof(glm::mat3x4), palette.data());
+        }
+
+        if (animated)
+        {
+            animator->parameters(0)[clip_time] = time;
+            animator->start_update();
+        }
+
         glUseProgram(program);
+        glUniform1i(skinned_location, (animated && !cpu_skinned) ? 1 : 0);
         glUniformMatrix4fv(model_location, 1, GL_FALSE, reinterpret_cast<float *>(&model));
         glUniformMatrix4fv(view_location, 1, GL_FALSE, reinterpret_cast<float *>(&view));
         glUniformMatrix4fv(projection_location, 1, GL_FALSE, reinterpret_cast<float *>(&projection));
@@ -381,7 +523,7 @@ int main() try
                 else
                     continue;
 
-                glBindVertexArray(mesh.vao);
+                glBindVertexArray(cpu_skinned ? mesh.skinned_vao : mesh.vao);
                 glDrawElements(GL_TRIANGLES, mesh.indices.count, mesh.indices.type, reinterpret_cast<void *>(mesh.indices.view.offset));
             }
         };
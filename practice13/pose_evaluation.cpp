@@ -0,0 +1,217 @@
+#include "pose_evaluation.hpp"
+#include "parallel.hpp"
+
+#include <stdexcept>
+#include <vector>
+#include <cstdint>
+#include <type_traits>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#include <xmmintrin.h>
+#endif
+
+namespace
+{
+
+#if defined(__SSE2__)
+    // Four lanes of a pose_batch block, so that the transform code below is shared with
+    // the scalar path
+    struct float4
+    {
+        __m128 v;
+    };
+
+    float4 operator + (float4 a, float4 b) { return {_mm_add_ps(a.v, b.v)}; }
+    float4 operator - (float4 a, float4 b) { return {_mm_sub_ps(a.v, b.v)}; }
+    float4 operator * (float4 a, float4 b) { return {_mm_mul_ps(a.v, b.v)}; }
+    float4 operator / (float4 a, float4 b) { return {_mm_div_ps(a.v, b.v)}; }
+
+    template <typename V>
+    V splat(float value)
+    {
+        if constexpr (std::is_same_v<V, float4>)
+            return {_mm_set1_ps(value)};
+        else
+            return value;
+    }
+#else
+    template <typename V>
+    V splat(float value)
+    {
+        return value;
+    }
+#endif
+
+    // Affine transform as three rows: the linear part in the first three columns and the
+    // translation in the last one
+    template <typename V>
+    struct affine
+    {
+        V m[3][4];
+    };
+
+    template <typename V>
+    affine<V> multiply(affine<V> const & a, affine<V> const & b)
+    {
+        affine<V> result;
+        for (int i = 0; i < 3; ++i)
+        {
+            for (int j = 0; j < 4; ++j)
+                result.m[i][j] = a.m[i][0] * b.m[0][j] + a.m[i][1] * b.m[1][j] + a.m[i][2] * b.m[2][j];
+            result.m[i][3] = result.m[i][3] + a.m[i][3];
+        }
+        return result;
+    }
+
+    // Translation * rotation * scale; the rotation is scaled by 2 / |q|^2, which also
+    // normalizes it
+    template <typename V, typename Load>
+    affine<V> local_transform(Load const & load)
+    {
+        V const x = load(pose_batch::rotation_x), y = load(pose_batch::rotation_y), z = load(pose_batch::rotation_z), w = load(pose_batch::rotation_w);
+        V const s = splat<V>(2.f) / (x * x + y * y + z * z + w * w);
+
+        V const xs = x * s, ys = y * s, zs = z * s;
+        V const xx = x * xs, yy = y * ys, zz = z * zs;
+        V const xy = x * ys, xz = x * zs, yz = y * zs;
+        V const wx = w * xs, wy = w * ys, wz = w * zs;
+        V const one = splat<V>(1.f);
+
+        V const sx = load(pose_batch::scale_x), sy = load(pose_batch::scale_y), sz = load(pose_batch::scale_z);
+
+        affine<V> result;
+        result.m[0][0] = (one - (yy + zz)) * sx;
+        result.m[0][1] = (xy - wz) * sy;
+        result.m[0][2] = (xz + wy) * sz;
+        result.m[0][3] = load(pose_batch::translation_x);
+        result.m[1][0] = (xy + wz) * sx;
+        result.m[1][1] = (one - (xx + zz)) * sy;
+        result.m[1][2] = (yz - wx) * sz;
+        result.m[1][3] = load(pose_batch::translation_y);
+        result.m[2][0] = (xz - wy) * sx;
+        result.m[2][1] = (yz + wx) * sy;
+        result.m[2][2] = (one - (xx + yy)) * sz;
+        result.m[2][3] = load(pose_batch::translation_z);
+        return result;
+    }
+
+    template <typename V>
+    affine<V> splat(glm::mat4 const & matrix)
+    {
+        affine<V> result;
+        for (int i = 0; i < 3; ++i)
+            for (int j = 0; j < 4; ++j)
+                result.m[i][j] = splat<V>(matrix[j][i]);
+        return result;
+    }
+
+    // Walks the hierarchy once, keeping the global transforms of the block in `globals`
+    template <typename V, typename Load, typename Store>
+    void evaluate_block(skeleton const & skeleton, std::vector<affine<V>> const & inverse_binds, std::vector<affine<V>> & globals,
+        Load const & load, Store const & store)
+    {
+        for (std::size_t bone = 0; bone < skeleton.size(); ++bone)
+        {
+            auto const local = local_transform<V>([&](pose_batch::component c){ return load(bone, c); });
+            std::uint32_t const parent = skeleton.parents[bone];
+            globals[bone] = (parent == skeleton::no_parent) ? local : multiply(globals[parent], local);
+            store(bone, multiply(globals[bone], inverse_binds[bone]));
+        }
+    }
+
+}
+
+void evaluate_poses(skeleton const & skeleton, pose_batch const & batch, std::span<glm::mat3x4> palettes, unsigned int thread_count)
+{
+    std::size_t const bone_count = skeleton.size();
+    if (batch.bone_count != bone_count || skeleton.inverse_bind_matrices.size() != bone_count)
+        throw std::runtime_error("Pose batch does not match the skeleton");
+    if (palettes.size() < batch.instance_count * bone_count)
+        throw std::runtime_error("Palette buffer is too small for the batch");
+    for (std::size_t bone = 0; bone < bone_count; ++bone)
+        if (skeleton.parents[bone] != skeleton::no_parent && skeleton.parents[bone] >= bone)
+            throw std::runtime_error("Skeleton bones must come after their parents");
+
+    // Blocks of pose_batch::width instances
+    constexpr std::size_t min_blocks_per_thread = 64;
+    std::size_t const block_count = batch.block_count();
+    std::size_t const chunk_count = parallel_chunk_count(block_count, min_blocks_per_thread, thread_count);
+
+    constexpr std::size_t width = pose_batch::width;
+
+    std::vector<affine<float>> inverse_binds;
+    for (auto const & matrix : skeleton.inverse_bind_matrices)
+        inverse_binds.push_back(splat<float>(matrix));
+
+#if defined(__SSE2__)
+    std::vector<affine<float4>> inverse_binds4;
+    for (auto const & matrix : skeleton.inverse_bind_matrices)
+        inverse_binds4.push_back(splat<float4>(matrix));
+#endif
+
+    run_parallel(chunk_count, [&](std::size_t chunk){
+        std::size_t const begin = block_count * chunk / chunk_count;
+        std::size_t const end = block_count * (chunk + 1) / chunk_count;
+
+        std::size_t block = begin;
+
+#if defined(__SSE2__)
+        std::vector<affine<float4>> globals(bone_count);
+
+        // Full blocks go through SSE, transposing the rows of four instances into their
+        // matrices. Palettes are written once and read by someone else, so aligned ones are
+        // streamed past the cache
+        bool const aligned = reinterpret_cast<std::uintptr_t>(palettes.data()) % 16 == 0;
+
+        for (; block < end && (block + 1) * width <= batch.instance_count; ++block)
+        {
+            glm::mat3x4 * const output = palettes.data() + block * width * bone_count;
+
+            evaluate_block<float4>(skeleton, inverse_binds4, globals,
+                [&](std::size_t bone, pose_batch::component c){ return float4{_mm_loadu_ps(batch.lanes(block, bone, c))}; },
+                [&](std::size_t bone, affine<float4> const & palette){
+                    for (int i = 0; i < 3; ++i)
+                    {
+                        __m128 a = palette.m[i][0].v, b = palette.m[i][1].v, c = palette.m[i][2].v, d = palette.m[i][3].v;
+                        _MM_TRANSPOSE4_PS(a, b, c, d);
+                        float * const row = &output[bone][i][0];
+                        std::size_t const stride = bone_count * 12;
+                        if (aligned)
+                        {
+                            _mm_stream_ps(row, a);
+                            _mm_stream_ps(row + stride, b);
+                            _mm_stream_ps(row + 2 * stride, c);
+                            _mm_stream_ps(row + 3 * stride, d);
+                        }
+                        else
+                        {
+                            _mm_storeu_ps(row, a);
+                            _mm_storeu_ps(row + stride, b);
+                            _mm_storeu_ps(row + 2 * stride, c);
+                            _mm_storeu_ps(row + 3 * stride, d);
+                        }
+                    }
+                });
+        }
+
+        _mm_sfence();
+#endif
+
+        std::vector<affine<float>> globals_scalar(bone_count);
+        for (; block < end; ++block)
+        {
+            for (std::size_t lane = 0; lane < width && block * width + lane < batch.instance_count; ++lane)
+            {
+                glm::mat3x4 * const output = palettes.data() + (block * width + lane) * bone_count;
+
+                evaluate_block<float>(skeleton, inverse_binds, globals_scalar,
+                    [&](std::size_t bone, pose_batch::component c){ return batch.lanes(block, bone, c)[lane]; },
+                    [&](std::size_t bone, affine<float> const & palette){
+                        for (int i = 0; i < 3; ++i)
+                            output[bone][i] = glm::vec4(palette.m[i][0], palette.m[i][1], palette.m[i][2], palette.m[i][3]);
+                    });
+            }
+        }
+    });
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "animation.hpp"
+
+#include <span>
+#include <cstdint>
+
+#include <glm/mat4x4.hpp>
+#include <glm/mat3x4.hpp>
+
+// Bone hierarchy for pose evaluation, every parent coming before its children
+struct skeleton
+{
+    static constexpr std::uint32_t no_parent = -1;
+
+    std::vector<std::uint32_t> parents;
+    std::vector<glm::mat4> inverse_bind_matrices;
+
+    std::size_t size() const { return parents.size(); }
+};
+
+// Computes the skinning palette of every instance of a batch: the global transform of each
+// bone, composed in a single pass down the hierarchy, times its inverse bind matrix. Local and
+// inverse bind transforms are taken as affine, rotations need not be normalized.
+//
+// Palettes are packed instance-major, bone_count matrices per instance, each stored as the
+// three rows of the affine transform, 48 bytes ready to upload: the columns of a glm::mat3x4
+// or a GLSL mat3x4 are the rows of the transform, which applies as vec4(position, 1) * m.
+//
+// Blocks of instances are evaluated with SSE when available, spread over thread_count
+// threads (0 meaning all hardware threads)
+void evaluate_poses(skeleton const & skeleton, pose_batch const & batch, std::span<glm::mat3x4> palettes, unsigned int thread_count = 1);
@@ -0,0 +1,308 @@
+#include "pose_graph.hpp"
+#include "parallel.hpp"
+
+#include <cmath>
+#include <stdexcept>
+#include <utility>
+#include <algorithm>
+
+namespace
+{
+
+    // Shortest-path normalized lerp, cheaper than slerp and as good for blend weights
+    glm::quat nlerp(glm::quat const & a, glm::quat const & b, float t)
+    {
+        float const s = (glm::dot(a, b) < 0.f) ? -t : t;
+        glm::quat const result = a * (1.f - t) + b * s;
+        return result * (1.f / std::sqrt(glm::dot(result, result)));
+    }
+
+    template <typename Weight>
+    void blend_poses(skeleton_pose const & a, skeleton_pose const & b, Weight const & weight, skeleton_pose & result)
+    {
+        for (std::size_t i = 0; i < result.size(); ++i)
+        {
+            float const t = weight(i);
+
+            // Masks leave most bones entirely to one side
+            if (t <= 0.f || t >= 1.f)
+            {
+                auto const & source = (t <= 0.f) ? a : b;
+                result.translations[i] = source.translations[i];
+                result.rotations[i] = source.rotations[i];
+                result.scales[i] = source.scales[i];
+                continue;
+            }
+
+            result.translations[i] = glm::lerp(a.translations[i], b.translations[i], t);
+            result.rotations[i] = nlerp(a.rotations[i], b.rotations[i], t);
+            result.scales[i] = glm::lerp(a.scales[i], b.scales[i], t);
+        }
+    }
+
+    float relative_scale(float value, float reference)
+    {
+        return (reference != 0.f) ? value / reference : 1.f;
+    }
+
+}
+
+pose_graph::pose_graph(std::size_t bone_count)
+    : bone_count_(bone_count)
+{}
+
+pose_graph::node_index pose_graph::add(node node, std::initializer_list<node_index> inputs)
+{
+    std::size_t i = 0;
+    for (node_index input : inputs)
+    {
+        if (input >= nodes_.size())
+            throw std::runtime_error("Pose graph nodes can only read earlier nodes");
+        node.inputs[i++] = input;
+    }
+
+    parameter_count_ = std::max(parameter_count_, node.parameter + 1);
+    nodes_.push_back(std::move(node));
+    return nodes_.size() - 1;
+}
+
+pose_graph::node_index pose_graph::sample(clip clip, std::size_t time_parameter, bool loop)
+{
+    std::size_t const clip_bones = std::visit([](auto const * clip){ return clip->bone_count; }, clip);
+    if (clip_bones != bone_count_)
+        throw std::runtime_error("Clip does not match the pose graph skeleton");
+
+    return add({.type = node_type::sample, .parameter = time_parameter, .source = clip, .loop = loop}, {});
+}
+
+pose_graph::node_index pose_graph::blend(node_index a, node_index b, std::size_t weight_parameter)
+{
+    return add({.type = node_type::blend, .parameter = weight_parameter}, {a, b});
+}
+
+pose_graph::node_index pose_graph::additive(node_index base, node_index layer, node_index reference, std::size_t weight_parameter)
+{
+    return add({.type = node_type::additive, .parameter = weight_parameter}, {base, layer, reference});
+}
+
+pose_graph::node_index pose_graph::mask(node_index base, node_index layer, std::vector<float> bone_weights, std::size_t weight_parameter)
+{
+    if (bone_weights.size() != bone_count_)
+        throw std::runtime_error("Mask does not match the pose graph skeleton");
+
+    masks_.push_back(std::move(bone_weights));
+    return add({.type = node_type::mask, .parameter = weight_parameter, .mask = masks_.size() - 1}, {base, layer});
+}
+
+skeleton_pose const & pose_graph::evaluate(std::span<float const> parameters, scratch & scratch) const
+{
+    if (nodes_.empty())
+        throw std::runtime_error("Pose graph is empty");
+    if (parameters.size() < parameter_count_)
+        throw std::runtime_error("Not enough pose graph parameters");
+
+    scratch.poses.resize(nodes_.size());
+
+    for (std::size_t n = 0; n < nodes_.size(); ++n)
+    {
+        auto const & node = nodes_[n];
+        auto & result = scratch.poses[n];
+        result.resize(bone_count_);
+
+        float const parameter = parameters[node.parameter];
+        auto const & a = scratch.poses[node.inputs[0]];
+        auto const & b = scratch.poses[node.inputs[1]];
+
+        switch (node.type)
+        {
+        case node_type::sample:
+            std::visit([&](auto const * clip){
+                float time = parameter;
+                if (node.loop && clip->max_time > 0.f)
+                {
+                    time = std::fmod(time, clip->max_time);
+                    if (time < 0.f)
+                        time += clip->max_time;
+                }
+                clip->sample(time, result);
+            }, node.source);
+            break;
+
+        case node_type::blend:
+            blend_poses(a, b, [&](std::size_t){ return parameter; }, result);
+            break;
+
+        case node_type::mask:
+        {
+            auto const & weights = masks_[node.mask];
+            blend_poses(a, b, [&](std::size_t i){ return weights[i] * parameter; }, result);
+            break;
+        }
+
+        case node_type::additive:
+        {
+            // The layer's difference to its reference, applied in the bones' local space
+            auto const & reference = scratch.poses[node.inputs[2]];
+            glm::quat const identity(1.f, 0.f, 0.f, 0.f);
+            for (std::size_t i = 0; i < bone_count_; ++i)
+            {
+                glm::quat const delta = glm::conjugate(reference.rotations[i]) * b.rotations[i];
+                glm::vec3 const scale(
+                    relative_scale(b.scales[i].x, reference.scales[i].x),
+                    relative_scale(b.scales[i].y, reference.scales[i].y),
+                    relative_scale(b.scales[i].z, reference.scales[i].z));
+
+                result.translations[i] = a.translations[i] + (b.translations[i] - reference.translations[i]) * parameter;
+                result.rotations[i] = glm::normalize(a.rotations[i] * nlerp(identity, delta, parameter));
+                result.scales[i] = a.scales[i] * glm::lerp(glm::vec3(1.f), scale, parameter);
+            }
+            break;
+        }
+        }
+    }
+
+    return scratch.poses.back();
+}
+
+std::vector<float> subtree_mask(skeleton const & skeleton, std::uint32_t root)
+{
+    std::vector<float> result(skeleton.size(), 0.f);
+    if (root >= skeleton.size())
+        return result;
+
+    // Parents come first, so one pass reaches the whole subtree
+    result[root] = 1.f;
+    for (std::size_t i = root + 1; i < skeleton.size(); ++i)
+        if (std::uint32_t const parent = skeleton.parents[i]; parent != skeleton::no_parent && result[parent] == 1.f)
+            result[i] = 1.f;
+    return result;
+}
+
+crowd_animator::crowd_animator(pose_graph const & graph, skeleton const & skeleton, std::size_t character_count,
+    unsigned int thread_count, std::size_t batch_size)
+    : graph_(graph)
+    , skeleton_(skeleton)
+    , character_count_(character_count)
+    , batch_size_(std::max<std::size_t>(batch_size, 1))
+    , job_count_((character_count + batch_size_ - 1) / batch_size_)
+    , parameters_(character_count * graph.parameter_count(), 0.f)
+{
+    if (graph.bone_count() != skeleton.size())
+        throw std::runtime_error("Pose graph does not match the skeleton");
+
+    for (auto & buffer : buffers_)
+        buffer.assign(character_count * skeleton.size(), glm::mat3x4(1.f));
+
+    std::size_t const worker_count = parallel_chunk_count(job_count_, 1, thread_count);
+    workers_.reserve(worker_count);
+    for (std::size_t i = 0; i < worker_count; ++i)
+        workers_.emplace_back([this]{ work(); });
+}
+
+crowd_animator::~crowd_animator()
+{
+    {
+        std::lock_guard lock(mutex_);
+        stopping_ = true;
+    }
+    start_.notify_all();
+
+    for (auto & worker : workers_)
+        worker.join();
+}
+
+std::span<float> crowd_animator::parameters(std::size_t character)
+{
+    std::size_t const count = graph_.parameter_count();
+    return {parameters_.data() + character * count, count};
+}
+
+void crowd_animator::start_update()
+{
+    {
+        std::lock_guard lock(mutex_);
+        if (updating_)
+            throw std::runtime_error("The previous crowd update was not finished");
+
+        updating_ = true;
+        remaining_jobs_ = job_count_;
+        next_job_ = 0;
+        ++generation_;
+    }
+    start_.notify_all();
+}
+
+std::span<glm::mat3x4 const> crowd_animator::finish_update()
+{
+    std::unique_lock lock(mutex_);
+    if (updating_)
+    {
+        done_.wait(lock, [this]{ return remaining_jobs_ == 0; });
+        updating_ = false;
+        front_ = 1 - front_;
+    }
+
+    if (error_)
+        std::rethrow_exception(std::exchange(error_, nullptr));
+
+    return buffers_[front_];
+}
+
+std::span<glm::mat3x4 const> crowd_animator::palettes() const
+{
+    return buffers_[front_];
+}
+
+void crowd_animator::work()
+{
+    pose_graph::scratch scratch;
+    pose_batch batch;
+    std::uint64_t seen_generation = 0;
+    std::size_t const bone_count = skeleton_.size();
+
+    while (true)
+    {
+        {
+            std::unique_lock lock(mutex_);
+            start_.wait(lock, [&]{ return stopping_ || generation_ != seen_generation; });
+            if (stopping_)
+                return;
+            seen_generation = generation_;
+        }
+
+        while (true)
+        {
+            // Taking a job orders it after the start_update that handed it out, so the
+            // buffers cannot have been swapped since
+            std::size_t const job = next_job_++;
+            if (job >= job_count_)
+                break;
+
+            std::size_t const back = 1 - front_;
+
+            std::size_t const begin = job * batch_size_;
+            std::size_t const count = std::min(batch_size_, character_count_ - begin);
+
+            try
+            {
+                if (batch.instance_count != count || batch.bone_count != bone_count)
+                    batch.resize(bone_count, count);
+
+                for (std::size_t i = 0; i < count; ++i)
+                    batch.set(i, graph_.evaluate(parameters(begin + i), scratch));
+
+                evaluate_poses(skeleton_, batch, std::span(buffers_[back]).subspan(begin * bone_count, count * bone_count), 1);
+            }
+            catch (...)
+            {
+                std::lock_guard lock(mutex_);
+                if (!error_)
+                    error_ = std::current_exception();
+            }
+
+            std::lock_guard lock(mutex_);
+            if (--remaining_jobs_ == 0)
+                done_.notify_all();
+        }
+    }
+}
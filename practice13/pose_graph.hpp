@@ -0,0 +1,144 @@
+#pragma once
+
+#include "animation.hpp"
+#include "animation_compression.hpp"
+#include "pose_evaluation.hpp"
+
+#include <span>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <variant>
+#include <cstdint>
+#include <exception>
+#include <condition_variable>
+
+// Blends clips of one skeleton into a pose through a list of nodes, each reading the outputs
+// of earlier ones; the last node added is the output. Every character evaluates the same
+// graph with its own parameters: the clip times of sample nodes and the weights of the others
+struct pose_graph
+{
+    using node_index = std::uint32_t;
+    using clip = std::variant<resampled_animation const *, compressed_animation const *>;
+
+    explicit pose_graph(std::size_t bone_count);
+
+    // Samples a clip at the time held by a parameter, wrapped to the clip's length when looping
+    node_index sample(clip clip, std::size_t time_parameter, bool loop = true);
+
+    // Interpolates from a to b by the weight parameter
+    node_index blend(node_index a, node_index b, std::size_t weight_parameter);
+
+    // Applies the difference of the layer to its reference pose on top of the base, scaled by
+    // the weight parameter
+    node_index additive(node_index base, node_index layer, node_index reference, std::size_t weight_parameter);
+
+    // Blends the layer over the base by per-bone weights, scaled by the weight parameter, to
+    // play a clip on part of the body
+    node_index mask(node_index base, node_index layer, std::vector<float> bone_weights, std::size_t weight_parameter);
+
+    std::size_t bone_count() const { return bone_count_; }
+    std::size_t node_count() const { return nodes_.size(); }
+    std::size_t parameter_count() const { return parameter_count_; }
+
+    // Node outputs, reused between evaluations
+    struct scratch
+    {
+        std::vector<skeleton_pose> poses;
+    };
+
+    // Evaluates the graph for one character; returns the output pose, owned by the scratch
+    skeleton_pose const & evaluate(std::span<float const> parameters, scratch & scratch) const;
+
+private:
+    enum class node_type
+    {
+        sample,
+        blend,
+        additive,
+        mask,
+    };
+
+    struct node
+    {
+        node_type type;
+        node_index inputs[3] = {0, 0, 0};
+        std::size_t parameter = 0;
+        clip source = {};
+        bool loop = true;
+        std::size_t mask = 0;
+    };
+
+    std::size_t bone_count_;
+    std::size_t parameter_count_ = 0;
+    std::vector<node> nodes_;
+    std::vector<std::vector<float>> masks_;
+
+    node_index add(node node, std::initializer_list<node_index> inputs);
+};
+
+// Weights of 1 for a bone and everything below it, 0 elsewhere, for mask nodes
+std::vector<float> subtree_mask(skeleton const & skeleton, std::uint32_t root);
+
+// Evaluates a pose graph for a crowd of characters on a pool of worker threads, one job per
+// batch of characters: the graph fills a pose_batch and evaluate_poses turns it into the
+// batch's palettes. Palettes are double-buffered, so the render loop draws with those of the
+// previous update while the workers fill the other buffer:
+//
+//   auto palettes = animator.finish_update();   // wait for the workers, swap the buffers
+//   ... write the parameters of the next update ...
+//   animator.start_update();
+//   ... upload the palettes and draw ...
+//
+// Parameters must not be touched between start_update and finish_update
+struct crowd_animator
+{
+    crowd_animator(pose_graph const & graph, skeleton const & skeleton, std::size_t character_count,
+        unsigned int thread_count = 0, std::size_t batch_size = 256);
+    ~crowd_animator();
+
+    crowd_animator(crowd_animator const &) = delete;
+    crowd_animator & operator = (crowd_animator const &) = delete;
+
+    std::size_t character_count() const { return character_count_; }
+
+    // The graph parameters of a character
+    std::span<float> parameters(std::size_t character);
+
+    // Starts evaluating every character into the back buffer
+    void start_update();
+
+    // Waits for the update started last, makes its palettes the front buffer and returns them:
+    // bone_count packed matrices per character, as written by evaluate_poses. Rethrows the
+    // first error of the workers
+    std::span<glm::mat3x4 const> finish_update();
+
+    // The palettes of the last finished update
+    std::span<glm::mat3x4 const> palettes() const;
+
+private:
+    pose_graph const & graph_;
+    skeleton const & skeleton_;
+    std::size_t character_count_;
+    std::size_t batch_size_;
+    std::size_t job_count_;
+
+    std::vector<float> parameters_;
+    std::vector<glm::mat3x4> buffers_[2];
+    std::size_t front_ = 0;
+
+    std::mutex mutex_;
+    std::condition_variable start_;
+    std::condition_variable done_;
+    std::uint64_t generation_ = 0;
+    std::size_t remaining_jobs_ = 0;
+    bool updating_ = false;
+    bool stopping_ = false;
+    std::atomic<std::size_t> next_job_{0};
+    std::exception_ptr error_;
+
+    std::vector<std::thread> workers_;
+
+    void work();
+};
@@ -0,0 +1,84 @@
+#include "skinning.hpp"
+#include "parallel.hpp"
+
+#include <cmath>
+#include <stdexcept>
+
+#if defined(__SSE2__)
+#include <xmmintrin.h>
+#endif
+
+namespace
+{
+
+    glm::vec3 normalized(glm::vec3 const & v)
+    {
+        float const length = std::sqrt(v.x * v.x + v.y * v.y + v.z * v.z);
+        return (length > 0.f) ? v / length : v;
+    }
+
+    void skin_range(std::size_t begin, std::size_t end, std::span<glm::vec3 const> positions, std::span<glm::vec3 const> normals,
+        std::span<vertex_influences const> influences, std::span<glm::mat3x4 const> palette,
+        std::span<glm::vec3> skinned_positions, std::span<glm::vec3> skinned_normals)
+    {
+        for (std::size_t v = begin; v < end; ++v)
+        {
+            auto const & influence = influences[v];
+            for (auto joint : influence.joints)
+                if (joint >= palette.size())
+                    throw std::runtime_error("Vertex joint is outside of the palette");
+
+#if defined(__SSE2__)
+            // The blended rows, then transposed into columns so that transforming a vector
+            // is three multiply-adds
+            __m128 rows[4] = {_mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps()};
+            for (int k = 0; k < 4; ++k)
+            {
+                __m128 const weight = _mm_set1_ps(influence.weights[k]);
+                float const * matrix = &palette[influence.joints[k]][0][0];
+                for (int i = 0; i < 3; ++i)
+                    rows[i] = _mm_add_ps(rows[i], _mm_mul_ps(weight, _mm_loadu_ps(matrix + 4 * i)));
+            }
+            _MM_TRANSPOSE4_PS(rows[0], rows[1], rows[2], rows[3]);
+
+            auto transform = [&](glm::vec3 const & p){
+                return _mm_add_ps(_mm_add_ps(_mm_mul_ps(rows[0], _mm_set1_ps(p.x)), _mm_mul_ps(rows[1], _mm_set1_ps(p.y))),
+                    _mm_mul_ps(rows[2], _mm_set1_ps(p.z)));
+            };
+
+            alignas(16) float result[4];
+            _mm_store_ps(result, _mm_add_ps(transform(positions[v]), rows[3]));
+            skinned_positions[v] = glm::vec3(result[0], result[1], result[2]);
+            _mm_store_ps(result, transform(normals[v]));
+            skinned_normals[v] = normalized(glm::vec3(result[0], result[1], result[2]));
+#else
+            glm::mat3x4 matrix(0.f);
+            for (int k = 0; k < 4; ++k)
+                matrix += influence.weights[k] * palette[influence.joints[k]];
+
+            skinned_positions[v] = glm::vec4(positions[v], 1.f) * matrix;
+            skinned_normals[v] = normalized(glm::vec4(normals[v], 0.f) * matrix);
+#endif
+        }
+    }
+
+}
+
+void skin_vertices(std::span<glm::vec3 const> positions, std::span<glm::vec3 const> normals,
+    std::span<vertex_influences const> influences, std::span<glm::mat3x4 const> palette,
+    std::span<glm::vec3> skinned_positions, std::span<glm::vec3> skinned_normals, unsigned int thread_count)
+{
+    std::size_t const count = positions.size();
+    if (normals.size() != count || influences.size() != count)
+        throw std::runtime_error("Vertex attributes differ in size");
+    if (skinned_positions.size() < count || skinned_normals.size() < count)
+        throw std::runtime_error("Skinned vertex buffers are too small");
+
+    constexpr std::size_t min_vertices_per_thread = 4096;
+    std::size_t const chunk_count = parallel_chunk_count(count, min_vertices_per_thread, thread_count);
+
+    run_parallel(chunk_count, [&](std::size_t chunk){
+        skin_range(count * chunk / chunk_count, count * (chunk + 1) / chunk_count, positions, normals, influences, palette,
+            skinned_positions, skinned_normals);
+    });
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <span>
+#include <array>
+#include <cstdint>
+
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <glm/mat3x4.hpp>
+
+// Up to four joints of a vertex with their weights, as the JOINTS_0 and WEIGHTS_0 attributes
+struct vertex_influences
+{
+    std::array<std::uint16_t, 4> joints;
+    glm::vec4 weights;
+};
+
+// Linear blend skinning on the CPU, with the math of the skinning vertex shader: every vertex
+// is transformed by the weighted sum of the palette matrices of its joints, packed as
+// evaluate_poses writes them. Normals are transformed by the same matrix and renormalized.
+// Gives skinned meshes to code without a GPU, and to bounds and raycasts against the posed mesh.
+//
+// Vertices are spread over thread_count threads (0 meaning all hardware threads) and
+// transformed with SSE when available
+void skin_vertices(std::span<glm::vec3 const> positions, std::span<glm::vec3 const> normals,
+    std::span<vertex_influences const> influences, std::span<glm::mat3x4 const> palette,
+    std::span<glm::vec3> skinned_positions, std::span<glm::vec3> skinned_normals, unsigned int thread_count = 1);
@@ -0,0 +1,73 @@
+#include "texture_loader.hpp"
+#include "texture_upload.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+texture_decoder::texture_decoder(std::vector<std::filesystem::path> paths, unsigned int thread_count)
+    : paths_(std::move(paths))
+{
+    if (thread_count == 0)
+        thread_count = std::max(1u, std::thread::hardware_concurrency());
+
+    std::size_t const worker_count = std::min<std::size_t>(thread_count, paths_.size());
+    workers_.reserve(worker_count);
+    for (std::size_t i = 0; i < worker_count; ++i)
+        workers_.emplace_back([this]{ work(); });
+}
+
+texture_decoder::~texture_decoder()
+{
+    // Images nobody asked for yet are not decoded anymore
+    next_path_ = paths_.size();
+    for (auto & worker : workers_)
+        worker.join();
+}
+
+std::optional<decoded_image> texture_decoder::next()
+{
+    if (returned_ == paths_.size())
+        return std::nullopt;
+
+    std::unique_lock lock(mutex_);
+    ready_.wait(lock, [this]{ return !results_.empty(); });
+
+    auto result = std::move(results_.front());
+    results_.pop_front();
+    lock.unlock();
+
+    ++returned_;
+
+    if (!result.error.empty())
+        throw std::runtime_error(result.error);
+
+    return std::move(result.image);
+}
+
+void texture_decoder::work()
+{
+    while (true)
+    {
+        std::size_t const index = next_path_++;
+        if (index >= paths_.size())
+            break;
+
+        result result;
+        result.image.index = index;
+
+        try
+        {
+            result.image.texture = load_texture_cached(paths_[index], decode_image);
+        }
+        catch (std::exception const & e)
+        {
+            result.error = "Failed to load " + paths_[index].string() + ": " + e.what();
+        }
+
+        {
+            std::lock_guard lock(mutex_);
+            results_.push_back(std::move(result));
+        }
+        ready_.notify_one();
+    }
+}
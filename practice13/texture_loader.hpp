@@ -0,0 +1,55 @@
+#pragma once
+
+#include "texture_cache.hpp"
+
+#include <filesystem>
+#include <vector>
+#include <deque>
+#include <string>
+#include <optional>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+
+struct decoded_image
+{
+    // Index of the image in the list given to the decoder
+    std::size_t index;
+    cached_texture texture;
+};
+
+// Loads images through the texture cache on a pool of worker threads (0 meaning all
+// hardware threads), decoding those not cached yet, while the caller, usually the GL
+// thread, takes them in completion order to upload them
+struct texture_decoder
+{
+    explicit texture_decoder(std::vector<std::filesystem::path> paths, unsigned int thread_count = 0);
+    ~texture_decoder();
+
+    texture_decoder(texture_decoder const &) = delete;
+    texture_decoder & operator = (texture_decoder const &) = delete;
+
+    // Blocks until the next image is decoded, nullopt once all of them were returned.
+    // Throws if the image failed to decode; the remaining images can still be taken
+    std::optional<decoded_image> next();
+
+private:
+    struct result
+    {
+        decoded_image image;
+        std::string error;
+    };
+
+    std::vector<std::filesystem::path> paths_;
+    std::atomic<std::size_t> next_path_{0};
+    std::size_t returned_ = 0;
+
+    std::mutex mutex_;
+    std::condition_variable ready_;
+    std::deque<result> results_;
+
+    std::vector<std::thread> workers_;
+
+    void work();
+};
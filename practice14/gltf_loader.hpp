@@ -7,11 +7,39 @@
 #include <unordered_map>
 #include <algorithm>
 
+#include "mapped_file.hpp"
+#include "mesh_optimizer.hpp"
+#include "meshlets.hpp"
+#include "mesh_simplifier.hpp"
+#include "tangent_generation.hpp"
+
 #include <glm/vec3.hpp>
 #include <glm/mat4x4.hpp>
 #include <glm/gtx/quaternion.hpp>
 #include <glm/gtx/compatibility.hpp>
 
+// Binary data of a model: a copy-on-write mapping of the .bin file or of the BIN
+// chunk of a .glb, so that vertex data goes from the page cache to glBufferData
+// without an intermediate copy. In-place edits only copy the pages they touch;
+// growing the buffer moves it into memory of its own
+struct gltf_buffer
+{
+    gltf_buffer() = default;
+    gltf_buffer(mapped_file file, std::size_t offset, std::size_t size);
+
+    char * data() { return data_; }
+    char const * data() const { return data_; }
+    std::size_t size() const { return size_; }
+
+    void resize(std::size_t size);
+
+private:
+    mapped_file file_;
+    std::vector<char> storage_;
+    char * data_ = nullptr;
+    std::size_t size_ = 0;
+};
+
 struct gltf_model
 {
     struct buffer_view
@@ -46,13 +74,47 @@ struct gltf_model
         accessor position;
         accessor normal;
         accessor texcoord;
+        // Tangents from the file or from generate_tangents, vec4 with the bitangent sign in w
+        std::optional<accessor> tangent;
 
         glm::vec3 min;
         glm::vec3 max;
     };
 
-    std::vector<char> buffer;
+    gltf_buffer buffer;
     std::vector<mesh> meshes;
+
+    // Size of the JSON text, and the time load_gltf spent parsing it out of the whole load
+    std::size_t json_size = 0;
+    double json_parse_ms = 0.0;
+    double load_ms = 0.0;
 };
 
+// Loads a .gltf with its .bin, or a binary .glb, mapping the binary data in place
 gltf_model load_gltf(std::filesystem::path const & path);
+
+// Reorders the triangles of every mesh for the post-transform vertex cache,
+// in place in the model buffer; returns one report per mesh
+std::vector<vertex_cache_report> optimize_vertex_cache(gltf_model & model);
+
+// Splits a mesh into meshlets, reordering its index accessor in place in the model buffer
+meshlet_table build_meshlets(gltf_model & model, gltf_model::mesh const & mesh);
+
+struct gltf_lod
+{
+    // Index accessor of the level, of the same type as the mesh's own
+    gltf_model::accessor indices;
+    float ratio;
+    float error;
+};
+
+// Simplifies a mesh for every ratio on thread_count threads (0 meaning all hardware
+// threads), appending the index buffers of the levels to the model buffer; the levels
+// share the mesh's vertex accessors
+std::vector<gltf_lod> build_lod_chain(gltf_model & model, gltf_model::mesh const & mesh, std::span<float const> ratios, unsigned int thread_count = 0);
+
+// Computes MikkTSpace tangents for the mesh and appends them to the model buffer as a new
+// tangent accessor. Vertices used with both texture orientations are split: the index
+// accessor is patched in place and the vertex attributes are copied to the end of the buffer
+// with the split vertices appended. Returns the number of split vertices
+std::size_t generate_tangents(gltf_model & model, gltf_model::mesh & mesh, unsigned int thread_count = 0);
@@ -26,7 +26,7 @@
 #include <glm/gtx/string_cast.hpp>
 
 #include "gltf_loader.hpp"
-#include "stb_image.h"
+#include "texture_upload.hpp"
 #include "aabb.hpp"
 #include "frustum.hpp"
 #include "intersect.hpp"
@@ -184,7 +184,42 @@ int main() try
     const std::string project_root = PROJECT_ROOT;
     const std::string model_path = project_root + "/bunny/bunny.gltf";
 
-    auto const input_model = load_gltf(model_path);
+    auto input_model = load_gltf(model_path);
+    std::cout << "Loaded " << model_path << " in " << input_model.load_ms << " ms, parsing "
+        << input_model.json_size << " bytes of JSON in " << input_model.json_parse_ms << " ms" << std::endl;
+    for (std::size_t i = 0; auto const & report : optimize_vertex_cache(input_model))
+        std::cout << "Mesh " << input_model.meshes[i++].name << ": ACMR " << report.before.acmr << " -> " << report.after.acmr
+            << ", ATVR " << report.before.atvr << " -> " << report.after.atvr << std::endl;
+
+    // The drawn mesh is split into meshlets, culled every frame against the view frustum
+    // and by their normal cones; visible ones are drawn as ranges of its index buffer
+    auto const & drawn_mesh = input_model.meshes[0];
+    meshlet_table const meshlets = build_meshlets(input_model, drawn_mesh);
+    std::cout << "Mesh " << drawn_mesh.name << ": " << meshlets.size() << " meshlets" << std::endl;
+
+    std::vector<aabb> meshlet_boxes;
+    for (std::size_t i = 0; i < meshlets.size(); ++i)
+    {
+        auto const & min = meshlets.aabb_min[i];
+        auto const & max = meshlets.aabb_max[i];
+        meshlet_boxes.emplace_back(glm::vec3(min[0], min[1], min[2]), glm::vec3(max[0], max[1], max[2]));
+    }
+
+    // Coarser levels replace the meshlets once their error projects to less than a pixel
+    auto const lods = build_lod_chain(input_model, drawn_mesh, default_lod_ratios);
+    for (auto const & lod : lods)
+        std::cout << "Mesh " << drawn_mesh.name << " LOD " << lod.ratio << ": " << lod.indices.count / 3 << " triangles, error " << lod.error << std::endl;
+
+    glm::vec3 const drawn_mesh_center = (drawn_mesh.min + drawn_mesh.max) * 0.5f;
+    glm::vec3 const drawn_mesh_size = drawn_mesh.max - drawn_mesh.min;
+    float const drawn_mesh_extent = std::max({drawn_mesh_size.x, drawn_mesh_size.y, drawn_mesh_size.z});
+    float const drawn_mesh_radius = glm::length(drawn_mesh_size) * 0.5f;
+
+    std::size_t const index_size = (drawn_mesh.indices.type == GL_UNSIGNED_BYTE) ? 1 : (drawn_mesh.indices.type == GL_UNSIGNED_SHORT) ? 2 : 4;
+
+    std::vector<GLsizei> draw_counts;
+    std::vector<void const *> draw_offsets;
+
     GLuint vbo;
     glGenBuffers(1, &vbo);
     glBindBuffer(GL_ARRAY_BUFFER, vbo);
@@ -219,18 +254,7 @@ int main() try
 
         auto path = std::filesystem::path(model_path).parent_path() / *mesh.material.texture_path;
 
-        int width, height, channels;
-        auto data = stbi_load(path.c_str(), &width, &height, &channels, 4);
-        assert(data);
-
-        glGenTextures(1, &texture);
-        glBindTexture(GL_TEXTURE_2D, texture);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        stbi_image_free(data);
+        texture = upload_texture(load_texture_cached(path, decode_image));
     }
 
     auto last_frame_start = std::chrono::high_resolution_clock::now();
@@ -336,10 +360,50 @@ int main() try
 
         glBindTexture(GL_TEXTURE_2D, texture);
 
+        // The field of view is 90 degrees, so a unit at distance d spans height / (2 d) pixels
+        float const drawn_mesh_distance = std::max(glm::distance(camera_position, drawn_mesh_center) - drawn_mesh_radius, near);
+        float const pixels_per_unit = 0.5f * height / drawn_mesh_distance;
+
+        std::size_t level = 0;
+        while (level < lods.size() && lods[level].error * drawn_mesh_extent * pixels_per_unit <= 1.f)
+            ++level;
+
+        if (level > 0)
+        {
+            auto const & indices = lods[level - 1].indices;
+            glBindVertexArray(vaos[0]);
+            glDrawElements(GL_TRIANGLES, indices.count, indices.type, reinterpret_cast<void const *>(indices.view.offset));
+        }
+        else
         {
-            auto const & mesh = input_model.meshes[0];
+            frustum const view_frustum(projection * view * model);
+            std::array<float, 3> const model_camera_position{camera_position.x, camera_position.y, camera_position.z};
+
+            draw_counts.clear();
+            draw_offsets.clear();
+
+            std::size_t draw_end = -1;
+            for (std::size_t i = 0; i < meshlets.size(); ++i)
+            {
+                if (meshlet_backfacing(meshlets, i, model_camera_position) || !intersect(view_frustum, meshlet_boxes[i]))
+                    continue;
+
+                std::size_t const begin = meshlets.index_offset[i];
+                std::size_t const count = 3 * meshlets.triangle_count[i];
+
+                // Merge with the previous range if the meshlets are adjacent in the index buffer
+                if (begin == draw_end)
+                    draw_counts.back() += count;
+                else
+                {
+                    draw_counts.push_back(count);
+                    draw_offsets.push_back(reinterpret_cast<void const *>(drawn_mesh.indices.view.offset + begin * index_size));
+                }
+                draw_end = begin + count;
+            }
+
             glBindVertexArray(vaos[0]);
-            glDrawElements(GL_TRIANGLES, mesh.indices.count, mesh.indices.type, reinterpret_cast<void *>(mesh.indices.view.offset));
+            glMultiDrawElements(GL_TRIANGLES, draw_counts.data(), drawn_mesh.indices.type, draw_offsets.data(), draw_counts.size());
         }
 
         SDL_GL_SwapWindow(window);
@@ -26,7 +26,7 @@
 #include <glm/gtx/string_cast.hpp>
 
 #include "msdf_loader.hpp"
-#include "stb_image.h"
+#include "texture_upload.hpp"
 
 std::string to_string(std::string_view str)
 {
@@ -150,23 +150,9 @@ int main() try
     const std::string font_path = project_root + "/font/font-msdf.json";
 
     auto const font = load_msdf_font(font_path);
+    std::cout << "Loaded " << font.glyphs.size() << " glyphs, parsing JSON in " << font.parse_ms << " ms" << std::endl;
 
-    GLuint texture;
-    int texture_width, texture_height;
-    {
-        int channels;
-        auto data = stbi_load(font.texture_path.c_str(), &texture_width, &texture_height, &channels, 4);
-        assert(data);
-
-        glGenTextures(1, &texture);
-        glBindTexture(GL_TEXTURE_2D, texture);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, texture_width, texture_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        stbi_image_free(data);
-    }
+    GLuint texture = upload_texture(load_texture_cached(font.texture_path, decode_image));
 
     auto last_frame_start = std::chrono::high_resolution_clock::now();
 
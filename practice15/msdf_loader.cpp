@@ -1,23 +1,42 @@
 #include "msdf_loader.hpp"
 
+#include "mapped_file.hpp"
+
 #include <rapidjson/document.h>
-#include <rapidjson/istreamwrapper.h>
+#include <rapidjson/error/en.h>
 
-#include <fstream>
+#include <chrono>
+#include <cstring>
 #include <stdexcept>
 #include <filesystem>
+#include <vector>
 
 msdf_font load_msdf_font(std::string const & path)
 {
-    rapidjson::Document document;
-
+    // Parsed in situ from a null-terminated copy of the mapped file, with values taken
+    // from a pool sized after the text: the glyph table takes about 3 bytes of values
+    // per byte of JSON
+    std::vector<char> text;
     {
-        std::ifstream input(path, std::ios::binary);
-        rapidjson::IStreamWrapper stream(input);
-        document.ParseStream(stream);
+        mapped_file file(path);
+        text.resize(file.size() + 1);
+        // An empty file maps to no memory at all, and parses as an empty document
+        if (file.size() != 0)
+            std::memcpy(text.data(), file.data(), file.size());
+        text.back() = '\0';
     }
 
+    std::vector<char> pool(4 * text.size() + 4096);
+    rapidjson::MemoryPoolAllocator<> allocator(pool.data(), pool.size(), pool.size());
+    rapidjson::Document document(&allocator);
+
+    auto const parse_start = std::chrono::steady_clock::now();
+    document.ParseInsitu(text.data());
+    if (document.HasParseError())
+        throw std::runtime_error("Failed to parse " + path + ": " + rapidjson::GetParseError_En(document.GetParseError()));
+
     msdf_font result;
+    result.parse_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - parse_start).count();
 
     {
         auto pages = document["pages"].GetArray();
@@ -17,6 +17,9 @@ struct msdf_font
 
     std::unordered_map<char32_t, glyph> glyphs;
     float sdf_scale;
+
+    // Time load_msdf_font spent parsing the JSON
+    double parse_ms = 0.0;
 };
 
 msdf_font load_msdf_font(std::string const & path);
@@ -14,7 +14,7 @@
 #include <vector>
 #include <map>
 
-#include "obj_parser.hpp"
+#include "mesh_cache.hpp"
 
 std::string to_string(std::string_view str)
 {
@@ -168,7 +168,10 @@ int main() try
     GLuint projection_location = glGetUniformLocation(program, "projection");
 
     std::string project_root = PROJECT_ROOT;
-    obj_data bunny = parse_obj(project_root + "/bunny.obj");
+    auto bunny_load_start = std::chrono::high_resolution_clock::now();
+    cached_mesh bunny = load_obj_cached(project_root + "/bunny.obj");
+    std::cout << "Loaded bunny " << (bunny.from_cache ? "from cache" : "from OBJ text") << " in "
+        << std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - bunny_load_start).count() << " ms" << std::endl;
 
     auto last_frame_start = std::chrono::high_resolution_clock::now();
 
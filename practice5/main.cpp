@@ -15,7 +15,7 @@
 #include <map>
 #include <cmath>
 
-#include "obj_parser.hpp"
+#include "mesh_cache.hpp"
 #include "stb_image.h"
 
 std::string to_string(std::string_view str)
@@ -154,7 +154,10 @@ int main() try
 
     std::string project_root = PROJECT_ROOT;
     std::string cow_texture_path = project_root + "/cow.png";
-    obj_data cow = parse_obj(project_root + "/cow.obj");
+    auto cow_load_start = std::chrono::high_resolution_clock::now();
+    cached_mesh cow = load_obj_cached(project_root + "/cow.obj");
+    std::cout << "Loaded cow " << (cow.from_cache ? "from cache" : "from OBJ text") << " in "
+        << std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - cow_load_start).count() << " ms" << std::endl;
 
     auto last_frame_start = std::chrono::high_resolution_clock::now();
 
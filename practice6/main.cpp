@@ -13,6 +13,7 @@
 #include <chrono>
 #include <vector>
 #include <map>
+#include <algorithm>
 #include <cmath>
 #include <fstream>
 #include <sstream>
@@ -26,7 +27,9 @@
 #include <glm/ext/scalar_constants.hpp>
 #include <glm/gtx/string_cast.hpp>
 
-#include "obj_parser.hpp"
+#include "mesh_cache.hpp"
+#include "vertex_quantization.hpp"
+#include "index_compaction.hpp"
 
 std::string to_string(std::string_view str)
 {
@@ -44,23 +47,24 @@ void glew_fail(std::string_view message, GLenum error)
 }
 
 const char dragon_vertex_shader_source[] =
-R"(#version 330 core
+R"(
 
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
 
 layout (location = 0) in vec3 in_position;
-layout (location = 1) in vec3 in_normal;
+layout (location = 1) in vec2 in_normal;
 
 out vec3 normal;
 out vec3 position;
 
 void main()
 {
-    gl_Position = projection * view * model * vec4(in_position, 1.0);
-    position = (model * vec4(in_position, 1.0)).xyz;
-    normal = normalize(mat3(model) * in_normal);
+    vec3 object_position = decode_position(in_position);
+    gl_Position = projection * view * model * vec4(object_position, 1.0);
+    position = (model * vec4(object_position, 1.0)).xyz;
+    normal = normalize(mat3(model) * decode_normal(in_normal));
 }
 )";
 
@@ -206,19 +210,46 @@ int main() try
 
     glClearColor(0.8f, 0.8f, 1.f, 0.f);
 
-    auto dragon_vertex_shader = create_shader(GL_VERTEX_SHADER, dragon_vertex_shader_source);
+    auto dragon_vertex_shader = create_shader(GL_VERTEX_SHADER, (std::string("#version 330 core\n") + packed_vertex_glsl + dragon_vertex_shader_source).c_str());
     auto dragon_fragment_shader = create_shader(GL_FRAGMENT_SHADER, dragon_fragment_shader_source);
     auto dragon_program = create_program(dragon_vertex_shader, dragon_fragment_shader);
 
     GLuint model_location = glGetUniformLocation(dragon_program, "model");
     GLuint view_location = glGetUniformLocation(dragon_program, "view");
     GLuint projection_location = glGetUniformLocation(dragon_program, "projection");
+    GLuint position_offset_location = glGetUniformLocation(dragon_program, "position_offset");
+    GLuint position_scale_location = glGetUniformLocation(dragon_program, "position_scale");
 
     GLuint camera_position_location = glGetUniformLocation(dragon_program, "camera_position");
 
     std::string project_root = PROJECT_ROOT;
     std::string dragon_model_path = project_root + "/dragon.obj";
-    obj_data dragon = parse_obj(dragon_model_path);
+    auto dragon_load_start = std::chrono::high_resolution_clock::now();
+    cached_mesh dragon = load_obj_cached(dragon_model_path);
+    std::cout << "Loaded dragon " << (dragon.from_cache ? "from cache" : "from OBJ text") << " in "
+        << std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - dragon_load_start).count() << " ms" << std::endl;
+    for (auto const & lod : dragon.lods)
+        std::cout << "Dragon LOD " << lod.ratio << ": " << lod.index_count / 3 << " triangles, error " << lod.error << std::endl;
+
+    packed_vertices dragon_packed = pack_vertices(dragon.vertices);
+    std::cout << "Packed dragon vertices from " << dragon.vertices.size_bytes() << " to " << dragon_packed.vertices.size() * sizeof(packed_vertex)
+        << " bytes, max position error " << dragon_packed.error.position_max << ", max normal error " << dragon_packed.error.normal_max << " degrees" << std::endl;
+
+    // All levels of detail share one 16-bit index buffer
+    compact_index_buffer dragon_index_buffer;
+    std::vector<index_buffer_range> dragon_levels;
+    std::size_t dragon_index_bytes = 0;
+    for (std::size_t level = 0; level <= dragon.lods.size(); ++level)
+    {
+        dragon_levels.push_back(append_indices(dragon_index_buffer, dragon.level_indices(level), dragon.vertices.size()));
+        dragon_index_bytes += dragon.level_indices(level).size_bytes();
+    }
+
+    if (!dragon_index_buffer.vertex_remap.empty())
+        dragon_packed.vertices = split_vertices<packed_vertex>(dragon_packed.vertices, dragon_index_buffer);
+
+    std::cout << "Dragon indices take " << dragon_index_buffer.indices.size() * sizeof(std::uint16_t) << " bytes instead of " << dragon_index_bytes
+        << " in " << dragon_index_buffer.parts.size() << " parts, " << dragon_packed.vertices.size() << " vertices after splitting" << std::endl;
 
     GLuint dragon_vao, dragon_vbo, dragon_ebo;
     glGenVertexArrays(1, &dragon_vao);
@@ -226,16 +257,20 @@ int main() try
 
     glGenBuffers(1, &dragon_vbo);
     glBindBuffer(GL_ARRAY_BUFFER, dragon_vbo);
-    glBufferData(GL_ARRAY_BUFFER, dragon.vertices.size() * sizeof(dragon.vertices[0]), dragon.vertices.data(), GL_STATIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, dragon_packed.vertices.size() * sizeof(packed_vertex), dragon_packed.vertices.data(), GL_STATIC_DRAW);
 
     glGenBuffers(1, &dragon_ebo);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, dragon_ebo);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, dragon.indices.size() * sizeof(dragon.indices[0]), dragon.indices.data(), GL_STATIC_DRAW);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, dragon_index_buffer.indices.size() * sizeof(std::uint16_t), dragon_index_buffer.indices.data(), GL_STATIC_DRAW);
 
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(obj_data::vertex), (void*)(0));
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(obj_data::vertex), (void*)(12));
+    float const dragon_extent = std::max({dragon_packed.dequantization.position_scale[0], dragon_packed.dequantization.position_scale[1],
+        dragon_packed.dequantization.position_scale[2]});
+
+    for (auto const & attribute : packed_vertex_attributes)
+    {
+        glEnableVertexAttribArray(attribute.location);
+        glVertexAttribPointer(attribute.location, attribute.size, attribute.type, attribute.normalized, sizeof(packed_vertex), (void *)(attribute.offset));
+    }
 
     auto rectangle_vertex_shader = create_shader(GL_VERTEX_SHADER, rectangle_vertex_shader_source);
     auto rectangle_fragment_shader = create_shader(GL_FRAGMENT_SHADER, rectangle_fragment_shader_source);
@@ -324,11 +359,21 @@ int main() try
         glUniformMatrix4fv(model_location, 1, GL_FALSE, reinterpret_cast<float *>(&model));
         glUniformMatrix4fv(view_location, 1, GL_FALSE, reinterpret_cast<float *>(&view));
         glUniformMatrix4fv(projection_location, 1, GL_FALSE, reinterpret_cast<float *>(&projection));
+        glUniform3fv(position_offset_location, 1, dragon_packed.dequantization.position_offset.data());
+        glUniform3fv(position_scale_location, 1, dragon_packed.dequantization.position_scale.data());
 
         glUniform3fv(camera_position_location, 1, (float*)(&camera_position));
 
+        // Coarsest level whose error projects to at most a pixel; the field of view is 90 degrees
+        float const pixels_per_unit = 0.5f * height / std::max(camera_distance, near);
+        std::size_t dragon_level = 0;
+        while (dragon_level < dragon.lods.size() && dragon.lods[dragon_level].error * dragon_extent * model_scale * pixels_per_unit <= 1.f)
+            ++dragon_level;
+
         glBindVertexArray(dragon_vao);
-        glDrawElements(GL_TRIANGLES, dragon.indices.size(), GL_UNSIGNED_INT, nullptr);
+        auto const & dragon_range = dragon_levels[dragon_level];
+        for (auto const & part : std::span(dragon_index_buffer.parts).subspan(dragon_range.first_part, dragon_range.part_count))
+            glDrawElementsBaseVertex(GL_TRIANGLES, part.index_count, GL_UNSIGNED_SHORT, (void *)(part.index_offset * sizeof(std::uint16_t)), part.base_vertex);
 
         glUseProgram(rectangle_program);
         glUniform2f(center_location, -0.5f, -0.5f);
@@ -29,7 +29,9 @@
 #include <glm/ext/scalar_constants.hpp>
 #include <glm/gtx/string_cast.hpp>
 
-#include "obj_parser.hpp"
+#include "mesh_cache.hpp"
+#include "index_compaction.hpp"
+#include "vertex_quantization.hpp"
 
 std::string to_string(std::string_view str) {
     return std::string(str.begin(), str.end());
@@ -44,23 +46,23 @@ void glew_fail(std::string_view message, GLenum error) {
 }
 
 const char vertex_shader_source[] =
-        R"(#version 330 core
+        R"(
 
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
 
 layout (location = 0) in vec3 in_position;
-layout (location = 1) in vec3 in_normal;
+layout (location = 1) in vec2 in_normal;
 
 out vec3 position;
 out vec3 normal;
 
 void main()
 {
-    position = (model * vec4(in_position, 1.0)).xyz;
+    position = (model * vec4(decode_position(in_position), 1.0)).xyz;
     gl_Position = projection * view * vec4(position, 1.0);
-    normal = normalize(mat3(model) * in_normal);
+    normal = normalize(mat3(model) * decode_normal(in_normal));
 }
 )";
 
@@ -158,20 +160,34 @@ int main() try {
 
     glClearColor(0.8f, 0.8f, 1.f, 0.f);
 
-    auto vertex_shader = create_shader(GL_VERTEX_SHADER, vertex_shader_source);
+    auto vertex_shader = create_shader(GL_VERTEX_SHADER, (std::string("#version 330 core\n") + packed_vertex_glsl + vertex_shader_source).c_str());
     auto fragment_shader = create_shader(GL_FRAGMENT_SHADER, fragment_shader_source);
     auto program = create_program(vertex_shader, fragment_shader);
 
     GLuint model_location = glGetUniformLocation(program, "model");
     GLuint view_location = glGetUniformLocation(program, "view");
     GLuint projection_location = glGetUniformLocation(program, "projection");
+    GLuint position_offset_location = glGetUniformLocation(program, "position_offset");
+    GLuint position_scale_location = glGetUniformLocation(program, "position_scale");
     GLuint camera_position_location = glGetUniformLocation(program, "camera_position");
     GLuint albedo_location = glGetUniformLocation(program, "albedo");
     GLuint ambient_light_location = glGetUniformLocation(program, "ambient_light");
 
     std::string project_root = PROJECT_ROOT;
     std::string suzanne_model_path = project_root + "/suzanne.obj";
-    obj_data suzanne = parse_obj(suzanne_model_path);
+    auto suzanne_load_start = std::chrono::high_resolution_clock::now();
+    cached_mesh suzanne = load_obj_cached(suzanne_model_path);
+    std::cout << "Loaded suzanne " << (suzanne.from_cache ? "from cache" : "from OBJ text") << " in "
+        << std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - suzanne_load_start).count() << " ms" << std::endl;
+
+    packed_vertices suzanne_packed = pack_vertices(suzanne.vertices);
+    std::cout << "Packed suzanne vertices from " << suzanne.vertices.size_bytes() << " to " << suzanne_packed.vertices.size() * sizeof(packed_vertex)
+        << " bytes, max position error " << suzanne_packed.error.position_max << ", max normal error " << suzanne_packed.error.normal_max << " degrees" << std::endl;
+
+    compact_index_buffer suzanne_index_buffer;
+    append_indices(suzanne_index_buffer, suzanne.indices, suzanne.vertices.size());
+    if (!suzanne_index_buffer.vertex_remap.empty())
+        suzanne_packed.vertices = split_vertices<packed_vertex>(suzanne_packed.vertices, suzanne_index_buffer);
 
     GLuint suzanne_vao, suzanne_vbo, suzanne_ebo;
     glGenVertexArrays(1, &suzanne_vao);
@@ -179,18 +195,16 @@ int main() try {
 
     glGenBuffers(1, &suzanne_vbo);
     glBindBuffer(GL_ARRAY_BUFFER, suzanne_vbo);
-    glBufferData(GL_ARRAY_BUFFER, suzanne.vertices.size() * sizeof(suzanne.vertices[0]), suzanne.vertices.data(),
-                 GL_STATIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, suzanne_packed.vertices.size() * sizeof(packed_vertex), suzanne_packed.vertices.data(), GL_STATIC_DRAW);
 
     glGenBuffers(1, &suzanne_ebo);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, suzanne_ebo);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, suzanne.indices.size() * sizeof(suzanne.indices[0]), suzanne.indices.data(),
-                 GL_STATIC_DRAW);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, suzanne_index_buffer.indices.size() * sizeof(std::uint16_t), suzanne_index_buffer.indices.data(), GL_STATIC_DRAW);
 
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(obj_data::vertex), (void *) (0));
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(obj_data::vertex), (void *) (12));
+    for (auto const & attribute : packed_vertex_attributes) {
+        glEnableVertexAttribArray(attribute.location);
+        glVertexAttribPointer(attribute.location, attribute.size, attribute.type, attribute.normalized, sizeof(packed_vertex), (void *)(attribute.offset));
+    }
 
     auto last_frame_start = std::chrono::high_resolution_clock::now();
 
@@ -278,12 +292,15 @@ int main() try {
         glUniformMatrix4fv(model_location, 1, GL_FALSE, reinterpret_cast<float *>(&model));
         glUniformMatrix4fv(view_location, 1, GL_FALSE, reinterpret_cast<float *>(&view));
         glUniformMatrix4fv(projection_location, 1, GL_FALSE, reinterpret_cast<float *>(&projection));
+        glUniform3fv(position_offset_location, 1, suzanne_packed.dequantization.position_offset.data());
+        glUniform3fv(position_scale_location, 1, suzanne_packed.dequantization.position_scale.data());
         glUniform3fv(camera_position_location, 1, (float *) (&camera_position));
         glUniform3f(albedo_location, 0.7f, 0.4f, 0.2f);
         glUniform3f(ambient_light_location, 0.2f, 0.2f, 0.2f);
 
         glBindVertexArray(suzanne_vao);
-        glDrawElements(GL_TRIANGLES, suzanne.indices.size(), GL_UNSIGNED_INT, nullptr);
+        for (auto const & part : suzanne_index_buffer.parts)
+            glDrawElementsBaseVertex(GL_TRIANGLES, part.index_count, GL_UNSIGNED_SHORT, (void *) (part.index_offset * sizeof(std::uint16_t)), part.base_vertex);
 
         SDL_GL_SwapWindow(window);
     }
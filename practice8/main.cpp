@@ -29,7 +29,9 @@
 #include <glm/ext/scalar_constants.hpp>
 #include <glm/gtx/string_cast.hpp>
 
-#include "obj_parser.hpp"
+#include "mesh_cache.hpp"
+#include "index_compaction.hpp"
+#include "vertex_quantization.hpp"
 
 std::string to_string(std::string_view str)
 {
@@ -47,23 +49,23 @@ void glew_fail(std::string_view message, GLenum error)
 }
 
 const char vertex_shader_source[] =
-    R"(#version 330 core
+    R"(
 
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
 
 layout (location = 0) in vec3 in_position;
-layout (location = 1) in vec3 in_normal;
+layout (location = 1) in vec2 in_normal;
 
 out vec3 position;
 out vec3 normal;
 
 void main()
 {
-    position = (model * vec4(in_position, 1.0)).xyz;
+    position = (model * vec4(decode_position(in_position), 1.0)).xyz;
     gl_Position = projection * view * vec4(position, 1.0);
-    normal = normalize(mat3(model) * in_normal);
+    normal = normalize(mat3(model) * decode_normal(in_normal));
 }
 )";
 
@@ -183,13 +185,15 @@ try
 
     glClearColor(0.8f, 0.8f, 1.f, 0.f);
 
-    auto vertex_shader = create_shader(GL_VERTEX_SHADER, vertex_shader_source);
+    auto vertex_shader = create_shader(GL_VERTEX_SHADER, (std::string("#version 330 core\n") + packed_vertex_glsl + vertex_shader_source).c_str());
     auto fragment_shader = create_shader(GL_FRAGMENT_SHADER, fragment_shader_source);
     auto program = create_program(vertex_shader, fragment_shader);
 
     GLuint model_location = glGetUniformLocation(program, "model");
     GLuint view_location = glGetUniformLocation(program, "view");
     GLuint projection_location = glGetUniformLocation(program, "projection");
+    GLuint position_offset_location = glGetUniformLocation(program, "position_offset");
+    GLuint position_scale_location = glGetUniformLocation(program, "position_scale");
     GLuint camera_position_location = glGetUniformLocation(program, "camera_position");
     GLuint albedo_location = glGetUniformLocation(program, "albedo");
     GLuint sun_direction_location = glGetUniformLocation(program, "sun_direction");
@@ -197,7 +201,19 @@ try
 
     std::string project_root = PROJECT_ROOT;
     std::string scene_path = project_root + "/buddha.obj";
-    obj_data scene = parse_obj(scene_path);
+    auto scene_load_start = std::chrono::high_resolution_clock::now();
+    cached_mesh scene = load_obj_cached(scene_path);
+    std::cout << "Loaded scene " << (scene.from_cache ? "from cache" : "from OBJ text") << " in "
+        << std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - scene_load_start).count() << " ms" << std::endl;
+
+    packed_vertices scene_packed = pack_vertices(scene.vertices);
+    std::cout << "Packed scene vertices from " << scene.vertices.size_bytes() << " to " << scene_packed.vertices.size() * sizeof(packed_vertex)
+        << " bytes, max position error " << scene_packed.error.position_max << ", max normal error " << scene_packed.error.normal_max << " degrees" << std::endl;
+
+    compact_index_buffer scene_index_buffer;
+    append_indices(scene_index_buffer, scene.indices, scene.vertices.size());
+    if (!scene_index_buffer.vertex_remap.empty())
+        scene_packed.vertices = split_vertices<packed_vertex>(scene_packed.vertices, scene_index_buffer);
 
     GLuint scene_vao, scene_vbo, scene_ebo;
     glGenVertexArrays(1, &scene_vao);
@@ -205,16 +221,17 @@ try
 
     glGenBuffers(1, &scene_vbo);
     glBindBuffer(GL_ARRAY_BUFFER, scene_vbo);
-    glBufferData(GL_ARRAY_BUFFER, scene.vertices.size() * sizeof(scene.vertices[0]), scene.vertices.data(), GL_STATIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, scene_packed.vertices.size() * sizeof(packed_vertex), scene_packed.vertices.data(), GL_STATIC_DRAW);
 
     glGenBuffers(1, &scene_ebo);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, scene_ebo);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, scene.indices.size() * sizeof(scene.indices[0]), scene.indices.data(), GL_STATIC_DRAW);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, scene_index_buffer.indices.size() * sizeof(std::uint16_t), scene_index_buffer.indices.data(), GL_STATIC_DRAW);
 
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(obj_data::vertex), (void *)(0));
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(obj_data::vertex), (void *)(12));
+    for (auto const & attribute : packed_vertex_attributes)
+    {
+        glEnableVertexAttribArray(attribute.location);
+        glVertexAttribPointer(attribute.location, attribute.size, attribute.type, attribute.normalized, sizeof(packed_vertex), (void *)(attribute.offset));
+    }
 
     auto last_frame_start = std::chrono::high_resolution_clock::now();
 
@@ -299,13 +316,16 @@ try
         glUniformMatrix4fv(model_location, 1, GL_FALSE, reinterpret_cast<float *>(&model));
         glUniformMatrix4fv(view_location, 1, GL_FALSE, reinterpret_cast<float *>(&view));
         glUniformMatrix4fv(projection_location, 1, GL_FALSE, reinterpret_cast<float *>(&projection));
+        glUniform3fv(position_offset_location, 1, scene_packed.dequantization.position_offset.data());
+        glUniform3fv(position_scale_location, 1, scene_packed.dequantization.position_scale.data());
         glUniform3fv(camera_position_location, 1, (float *)(&camera_position));
         glUniform3f(albedo_location, .8f, .7f, .6f);
         glUniform3f(sun_color_location, 1.f, 1.f, 1.f);
         glUniform3fv(sun_direction_location, 1, reinterpret_cast<float *>(&sun_direction));
 
         glBindVertexArray(scene_vao);
-        glDrawElements(GL_TRIANGLES, scene.indices.size(), GL_UNSIGNED_INT, nullptr);
+        for (auto const & part : scene_index_buffer.parts)
+            glDrawElementsBaseVertex(GL_TRIANGLES, part.index_count, GL_UNSIGNED_SHORT, (void *)(part.index_offset * sizeof(std::uint16_t)), part.base_vertex);
 
         SDL_GL_SwapWindow(window);
     }
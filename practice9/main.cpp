@@ -26,7 +26,8 @@
 #include <glm/ext/scalar_constants.hpp>
 #include <glm/gtx/string_cast.hpp>
 
-#include "obj_parser.hpp"
+#include "mesh_cache.hpp"
+#include "index_compaction.hpp"
 
 std::string to_string(std::string_view str)
 {
@@ -271,7 +272,22 @@ int main() try
 
     std::string project_root = PROJECT_ROOT;
     std::string scene_path = project_root + "/bunny.obj";
-    obj_data scene = parse_obj(scene_path);
+    auto scene_load_start = std::chrono::high_resolution_clock::now();
+    cached_mesh scene = load_obj_cached(scene_path);
+    std::cout << "Loaded scene " << (scene.from_cache ? "from cache" : "from OBJ text") << " in "
+        << std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - scene_load_start).count() << " ms" << std::endl;
+
+    compact_index_buffer scene_index_buffer;
+    append_indices(scene_index_buffer, scene.indices, scene.vertices.size());
+
+    // Meshes too large for 16-bit indices get a split copy of their vertices
+    std::vector<obj_data::vertex> scene_split_vertices;
+    std::span<obj_data::vertex const> scene_vertices = scene.vertices;
+    if (!scene_index_buffer.vertex_remap.empty())
+    {
+        scene_split_vertices = split_vertices(scene.vertices, scene_index_buffer);
+        scene_vertices = scene_split_vertices;
+    }
 
     GLuint vao, vbo, ebo;
     glGenVertexArrays(1, &vao);
@@ -279,11 +295,11 @@ int main() try
 
     glGenBuffers(1, &vbo);
     glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferData(GL_ARRAY_BUFFER, scene.vertices.size() * sizeof(scene.vertices[0]), scene.vertices.data(), GL_STATIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, scene_vertices.size_bytes(), scene_vertices.data(), GL_STATIC_DRAW);
 
     glGenBuffers(1, &ebo);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, scene.indices.size() * sizeof(scene.indices[0]), scene.indices.data(), GL_STATIC_DRAW);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, scene_index_buffer.indices.size() * sizeof(std::uint16_t), scene_index_buffer.indices.data(), GL_STATIC_DRAW);
 
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(obj_data::vertex), (void*)(0));
@@ -402,7 +418,8 @@ int main() try
         glUniformMatrix4fv(shadow_transform_location, 1, GL_FALSE, reinterpret_cast<float *>(&transform));
 
         glBindVertexArray(vao);
-        glDrawElements(GL_TRIANGLES, scene.indices.size(), GL_UNSIGNED_INT, nullptr);
+        for (auto const & part : scene_index_buffer.parts)
+            glDrawElementsBaseVertex(GL_TRIANGLES, part.index_count, GL_UNSIGNED_SHORT, (void *)(part.index_offset * sizeof(std::uint16_t)), part.base_vertex);
 
         glBindTexture(GL_TEXTURE_2D, shadow_map);
         glGenerateMipmap(GL_TEXTURE_2D);
@@ -443,7 +460,8 @@ int main() try
         glUniform3f(light_color_location, 0.8f, 0.8f, 0.8f);
 
         glBindVertexArray(vao);
-        glDrawElements(GL_TRIANGLES, scene.indices.size(), GL_UNSIGNED_INT, nullptr);
+        for (auto const & part : scene_index_buffer.parts)
+            glDrawElementsBaseVertex(GL_TRIANGLES, part.index_count, GL_UNSIGNED_SHORT, (void *)(part.index_offset * sizeof(std::uint16_t)), part.base_vertex);
 
         glUseProgram(debug_program);
         glBindTexture(GL_TEXTURE_2D, shadow_map);
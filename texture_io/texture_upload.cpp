@@ -0,0 +1,36 @@
+#include "texture_upload.hpp"
+#include "stb_image.h"
+
+#include <string>
+#include <stdexcept>
+
+texture_image decode_image(std::span<unsigned char const> encoded)
+{
+    int width, height, channels;
+    auto pixels = stbi_load_from_memory(encoded.data(), encoded.size(), &width, &height, &channels, 4);
+    if (!pixels)
+        throw std::runtime_error(std::string("Failed to decode image: ") + stbi_failure_reason());
+
+    texture_image result;
+    result.width = width;
+    result.height = height;
+    result.pixels.assign(pixels, pixels + std::size_t(width) * height * 4);
+    stbi_image_free(pixels);
+    return result;
+}
+
+GLuint upload_texture(cached_texture const & texture)
+{
+    GLuint result;
+    glGenTextures(1, &result);
+    glBindTexture(GL_TEXTURE_2D, result);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, texture.levels.size() - 1);
+    for (std::size_t i = 0; i < texture.levels.size(); ++i)
+    {
+        auto const & level = texture.levels[i];
+        glTexImage2D(GL_TEXTURE_2D, i, GL_RGBA8, level.width, level.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, level.pixels.data());
+    }
+    return result;
+}
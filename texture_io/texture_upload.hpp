@@ -0,0 +1,13 @@
+#pragma once
+
+#include "texture_cache.hpp"
+
+#include <GL/glew.h>
+
+#include <span>
+
+// Decodes an image file with stb_image, for load_texture_cached
+texture_image decode_image(std::span<unsigned char const> encoded);
+
+// Uploads every cached level, instead of having the driver generate the mipmaps
+GLuint upload_texture(cached_texture const & texture);